@@ -1,43 +1,137 @@
 #ifndef DS_WET1_SPRING2024_AVL_H
 #define DS_WET1_SPRING2024_AVL_H
 
-#include <memory>
+#include "MemoryUsage.h"
+#include "SlabPool.h"
 #include <algorithm>
+#include <exception>
+#include <future>
+#include <thread>
+#include <utility>
+
+#if defined(__GNUC__)
+#define AVL_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define AVL_PREFETCH(addr) ((void)0)
+#endif
+
+// Augmentation policy for AVL. Data is kept in every node next to the
+// value; pull recomputes a node's Data from its value and children, and
+// push hands a node's pending update down to its children. A range update
+// is a Tag: apply puts it on a whole subtree lazily, applyOwn on a node's
+// own value only. Range queries fold Summaries: own is a node's value
+// alone, whole its subtree, combine joins two adjacent ranges in order.
+//
+// Readers never push, so any number of them can share a tree. They carry
+// the tags still pending above a node instead: pending is what a node
+// holds back from its children, compose adds a node's pending to the
+// tags above it, and seenValue and seenSummary show a copy of a value,
+// or a summary of count values, with those tags applied.
+//
+// The default stores and does nothing.
+struct NoAugment {
+    struct Data {};
+    struct Tag {};
+    struct Summary {};
+
+    template<typename Node> static void pull(Node&) {}
+    template<typename Node> static void push(Node&) {}
+    template<typename Node> static void apply(Node&, const Tag&) {}
+    template<typename Node> static void applyOwn(Node&, const Tag&) {}
+
+    template<typename Node> static Tag pending(const Node&) { return Tag(); }
+    static Tag compose(const Tag&, const Tag&) { return Tag(); }
+    template<typename Value> static const Value& seenValue(const Value& value, const Tag&) { return value; }
+    static Summary seenSummary(const Summary& summary, const Tag&, int) { return summary; }
+
+    static Summary none() { return Summary(); }
+    template<typename Node> static Summary own(const Node&) { return Summary(); }
+    template<typename Node> static Summary whole(const Node&) { return Summary(); }
+    static Summary combine(const Summary&, const Summary&) { return Summary(); }
+};
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Augment = NoAugment>
 class AVLNode {
 public:
     Key key;
-    std::shared_ptr<Value> value;
-    std::shared_ptr<AVLNode<Key, Value>> left;
-    std::shared_ptr<AVLNode<Key, Value>> right;
+    Value value;  // Stored inline, no separate allocation per value
+    AVLNode* left;
+    AVLNode* right;
     int height;
-
-    AVLNode(const Key& k, std::shared_ptr<Value> v) 
-        : key(k), value(v), left(nullptr), right(nullptr), height(1) {}
+    int size;     // Nodes in this subtree
+    typename Augment::Data aug;
+
+    template<typename... Args>
+    AVLNode(const Key& k, Args&&... args)
+        : key(k), value(std::forward<Args>(args)...), left(nullptr), right(nullptr),
+          height(1), size(1), aug() {
+        Augment::pull(*this);
+    }
 };
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Augment = NoAugment>
 class AVL {
+public:
+    typedef typename Augment::Tag Tag;
+    typedef typename Augment::Summary Summary;
+
 private:
-    std::shared_ptr<AVLNode<Key, Value>> root;
+    typedef AVLNode<Key, Value, Augment> Node;
+    typedef SlabPool<Node> NodePool;
+
+    // Taller than any AVL tree of 2^31 nodes
+    static const int MAX_HEIGHT = 64;
+
+    SlabPools::User poolUser;  // Outlives the nodes, see SlabPools
+    Node* root;
+    Node* finger;  // The rightmost node, so appends need no search
+
+    // Nodes come from a pool shared by every tree of this Key and Value
+    static NodePool& pool() {
+        return NodePool::instance();
+    }
+
+    static void destroyAll(Node* node) {
+        if (!node) return;
+        destroyAll(node->left);
+        destroyAll(node->right);
+        pool().destroy(node);
+    }
 
     // ---- Utility functions ----
-    int getHeight(const std::shared_ptr<AVLNode<Key, Value>>& node) const {
+    int getHeight(const Node* node) const {
         return node ? node->height : 0;
     }
 
-    int getBalance(const std::shared_ptr<AVLNode<Key, Value>>& node) const {
+    static int getSize(const Node* node) {
+        return node ? node->size : 0;
+    }
+
+    int getBalance(const Node* node) const {
         return node ? getHeight(node->left) - getHeight(node->right) : 0;
     }
 
-    void updateHeight(std::shared_ptr<AVLNode<Key, Value>>& node) {
+    void updateHeight(Node* node) {
         if (node) {
             node->height = 1 + std::max(getHeight(node->left), getHeight(node->right));
+            node->size = 1 + getSize(node->left) + getSize(node->right);
+            Augment::pull(*node);
+        }
+    }
+
+    // Pending updates are pushed before a node's children are rearranged
+    // or changed. Only writers push; const lookups compose the tags on the
+    // way down instead (see NoAugment).
+    static Node* push(Node* node) {
+        if (node) {
+            Augment::push(*node);
         }
+        return node;
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> rightRotate(std::shared_ptr<AVLNode<Key, Value>>& y) {
+    Node* rightRotate(Node* y) {
+        push(y);
+        push(y->left);
         auto x = y->left;
         auto T2 = x->right;
 
@@ -50,7 +144,9 @@ private:
         return x;
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> leftRotate(std::shared_ptr<AVLNode<Key, Value>>& x) {
+    Node* leftRotate(Node* x) {
+        push(x);
+        push(x->right);
         auto y = x->right;
         auto T2 = y->left;
 
@@ -63,7 +159,7 @@ private:
         return y;
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> balance(std::shared_ptr<AVLNode<Key, Value>>& node) {
+    Node* balance(Node* node) {
         if (!node) return node;
         
         updateHeight(node);
@@ -88,121 +184,728 @@ private:
         return node;
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> insertHelper(
-        std::shared_ptr<AVLNode<Key, Value>>& node, 
+    // Builds the value from args only if key is missing; result points at
+    // the value stored under key either way.
+    template<typename... Args>
+    Node* emplaceHelper(
+        Node* node, 
         const Key& key, 
-        std::shared_ptr<Value> value) {
+        Node*& result,
+        bool& inserted,
+        Args&&... args) {
         
         if (!node) {
-            return std::make_shared<AVLNode<Key, Value>>(key, value);
+            Node* newNode = pool().create(key, std::forward<Args>(args)...);
+            result = newNode;
+            inserted = true;
+            return newNode;
         }
 
+        push(node);
         if (key < node->key) {
-            node->left = insertHelper(node->left, key, value);
+            node->left = emplaceHelper(node->left, key, result, inserted, std::forward<Args>(args)...);
         } else if (key > node->key) {
-            node->right = insertHelper(node->right, key, value);
+            node->right = emplaceHelper(node->right, key, result, inserted, std::forward<Args>(args)...);
         } else {
-            // Key already exists, update value
-            node->value = value;
+            // Key already exists, leave it to the caller
+            result = node;
+            inserted = false;
             return node;
         }
 
         return balance(node);
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> findMin(
-        const std::shared_ptr<AVLNode<Key, Value>>& node) const 
-    {
-        auto current = node;
-        while (current && current->left) {
-            current = current->left;
+    // Links a node for key, which must be above every key in the tree,
+    // below the finger, then rebalances the right spine bottom-up. No key
+    // is compared on the way. Subtree sizes and summaries still change all
+    // along the spine, so this is O(log n) pointer steps, not O(1).
+    template<typename... Args>
+    Node* append(const Key& key, Args&&... args) {
+        Node* spine[MAX_HEIGHT];
+        int depth = 0;
+        for (Node* node = root; node; node = node->right) {
+            spine[depth++] = push(node);
+        }
+
+        Node* child = pool().create(key, std::forward<Args>(args)...);
+        finger = child;
+        while (depth > 0) {
+            Node* parent = spine[--depth];
+            parent->right = child;
+            child = balance(parent);
+        }
+        root = child;
+        return finger;
+    }
+
+    // Inserts or finds key, taking the append path when key is past the
+    // finger. Sets inserted; returns the node holding key.
+    template<typename... Args>
+    Node* emplaceNode(const Key& key, bool& inserted, Args&&... args) {
+        inserted = true;
+        if (!root) {
+            root = finger = pool().create(key, std::forward<Args>(args)...);
+            return root;
+        }
+        if (finger->key < key) {
+            return append(key, std::forward<Args>(args)...);
         }
-        return current;
+
+        Node* result = nullptr;
+        root = emplaceHelper(root, key, result, inserted, std::forward<Args>(args)...);
+        return result;
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> removeHelper(
-        std::shared_ptr<AVLNode<Key, Value>>& node, 
+    static Node* findMin(Node* node) {
+        push(node);
+        while (node && node->left) {
+            node = push(node->left);
+        }
+        return node;
+    }
+
+    static Node* findMax(Node* node) {
+        push(node);
+        while (node && node->right) {
+            node = push(node->right);
+        }
+        return node;
+    }
+
+    Node* removeHelper(
+        Node* node, 
         const Key& key) {
         
         if (!node) {
             return node;
         }
 
+        push(node);
         if (key < node->key) {
             node->left = removeHelper(node->left, key);
         } else if (key > node->key) {
             node->right = removeHelper(node->right, key);
         } else {
             // Node to be deleted found
-            if (!node->left) {
-                return node->right;
-            } else if (!node->right) {
-                return node->left;
+            if (!node->left || !node->right) {
+                Node* child = node->left ? node->left : node->right;
+                if (node == finger) {
+                    finger = nullptr;
+                }
+                pool().destroy(node);
+                return child;
             }
 
             // Node with two children: get inorder successor
             auto successor = findMin(node->right);
             node->key = successor->key;
-            node->value = successor->value;
-            node->right = removeHelper(node->right, successor->key);
+            node->value = std::move(successor->value);
+            node->right = removeHelper(node->right, node->key);
         }
 
         return balance(node);
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> findHelper(
-        const std::shared_ptr<AVLNode<Key, Value>>& node, 
-        const Key& key) const {
-        
-        if (!node || node->key == key) {
+    template<typename Visitor>
+    static void forEachHelper(const Node* node, Visitor& visit, const Tag& above) {
+        if (!node) return;
+        const Tag below = Augment::compose(above, Augment::pending(*node));
+        forEachHelper(node->left, visit, below);
+        visit(node->key, Augment::seenValue(node->value, above));
+        forEachHelper(node->right, visit, below);
+    }
+
+    // The node holding key, or null, and the tags pending above it
+    Node* findHelper(const Key& key, Tag& above) const {
+        above = Tag();
+        Node* node = root;
+        while (node && !(node->key == key)) {
+            above = Augment::compose(above, Augment::pending(*node));
+            node = (key < node->key) ? node->left : node->right;
+        }
+        return node;
+    }
+
+    // Applies tag to every key of node's subtree in [lo, hi]. Only the two
+    // boundary paths are walked; subtrees between them take the tag whole.
+    // Bounds that are known to hold are passed as null.
+    static void applyRangeHelper(Node* node, const Key* lo, const Key* hi, const Tag& tag) {
+        if (!node) return;
+        if (!lo && !hi) {
+            Augment::apply(*node, tag);
+            return;
+        }
+        push(node);
+        if (lo && node->key < *lo) {
+            applyRangeHelper(node->right, lo, hi, tag);
+        } else if (hi && *hi < node->key) {
+            applyRangeHelper(node->left, lo, hi, tag);
+        } else {
+            applyRangeHelper(node->left, lo, nullptr, tag);
+            Augment::applyOwn(*node, tag);
+            applyRangeHelper(node->right, nullptr, hi, tag);
+        }
+        Augment::pull(*node);
+    }
+
+    static Summary summarizeRangeHelper(const Node* node, const Key* lo, const Key* hi, const Tag& above) {
+        if (!node) return Augment::none();
+        if (!lo && !hi) {
+            return Augment::seenSummary(Augment::whole(*node), above, node->size);
+        }
+        const Tag below = Augment::compose(above, Augment::pending(*node));
+        if (lo && node->key < *lo) {
+            return summarizeRangeHelper(node->right, lo, hi, below);
+        }
+        if (hi && *hi < node->key) {
+            return summarizeRangeHelper(node->left, lo, hi, below);
+        }
+        return Augment::combine(
+            Augment::combine(summarizeRangeHelper(node->left, lo, nullptr, below),
+                             Augment::seenSummary(Augment::own(*node), above, 1)),
+            summarizeRangeHelper(node->right, nullptr, hi, below));
+    }
+
+    // ---- Join-based set operations ----
+    // Everything below is built on join, which links two trees and a
+    // middle node whose key lies between them. The operations recurse on
+    // both halves independently, so the top levels run them in parallel.
+    // Nodes are relinked, never copied; dropped ones are chained through
+    // their left pointers into a garbage list and freed by the calling
+    // thread afterwards, so every block goes back to that thread's pool.
+
+    // Subtrees below this many nodes are not worth a thread
+    static const int PARALLEL_GRAIN = 4096;
+
+    // Attaches middle, and right below it, into left's right spine.
+    // left must be taller than right by more than one.
+    Node* joinRight(Node* left, Node* middle, Node* right) {
+        push(left);
+        if (getHeight(left->right) <= getHeight(right) + 1) {
+            middle->left = left->right;
+            middle->right = right;
+            updateHeight(middle);
+            left->right = middle;
+        } else {
+            left->right = joinRight(left->right, middle, right);
+        }
+        return balance(left);
+    }
+
+    Node* joinLeft(Node* left, Node* middle, Node* right) {
+        push(right);
+        if (getHeight(right->left) <= getHeight(left) + 1) {
+            middle->left = left;
+            middle->right = right->left;
+            updateHeight(middle);
+            right->left = middle;
+        } else {
+            right->left = joinLeft(left, middle, right->left);
+        }
+        return balance(right);
+    }
+
+    // Every key of left < middle's key < every key of right. O(|h(left) -
+    // h(right)|).
+    Node* join(Node* left, Node* middle, Node* right) {
+        if (getHeight(left) > getHeight(right) + 1) {
+            return joinRight(left, middle, right);
+        }
+        if (getHeight(right) > getHeight(left) + 1) {
+            return joinLeft(left, middle, right);
+        }
+        middle->left = left;
+        middle->right = right;
+        updateHeight(middle);
+        return middle;
+    }
+
+    // Detaches the largest node of a non-empty tree; rest gets the others
+    Node* splitLast(Node* node, Node*& rest) {
+        push(node);
+        if (!node->right) {
+            rest = node->left;
             return node;
         }
-        
+        Node* remaining = nullptr;
+        Node* last = splitLast(node->right, remaining);
+        rest = join(node->left, node, remaining);
+        return last;
+    }
+
+    // Like join, for when there is no middle node
+    Node* joinTwo(Node* left, Node* right) {
+        if (!left) return right;
+        Node* rest = nullptr;
+        Node* last = splitLast(left, rest);
+        return join(rest, last, right);
+    }
+
+    // Splits node's tree into the keys below key and above it; the node
+    // holding key itself, if any, comes back detached.
+    Node* split(Node* node, const Key& key, Node*& left, Node*& right) {
+        if (!node) {
+            left = right = nullptr;
+            return nullptr;
+        }
+        push(node);
+        Node* found;
         if (key < node->key) {
-            return findHelper(node->left, key);
+            Node* below = nullptr;
+            found = split(node->left, key, left, below);
+            right = join(below, node, node->right);
+        } else if (node->key < key) {
+            Node* above = nullptr;
+            found = split(node->right, key, above, right);
+            left = join(node->left, node, above);
+        } else {
+            left = node->left;
+            right = node->right;
+            node->left = node->right = nullptr;
+            updateHeight(node);
+            found = node;
         }
-        
-        return findHelper(node->right, key);
+        return found;
+    }
+
+    // Chains one detached node, or a whole subtree, onto garbage
+    static void discardNode(Node* node, Node*& garbage) {
+        node->left = garbage;
+        garbage = node;
+    }
+
+    static void discardTree(Node* node, Node*& garbage) {
+        while (node) {
+            discardTree(node->right, garbage);
+            Node* next = node->left;
+            discardNode(node, garbage);
+            node = next;
+        }
+    }
+
+    static void appendGarbage(Node*& garbage, Node* more) {
+        if (!more) return;
+        Node* tail = more;
+        while (tail->left) {
+            tail = tail->left;
+        }
+        tail->left = garbage;
+        garbage = more;
+    }
+
+    // Runs first and second, first on its own thread when forks are left
+    // and the work is big enough. Falls back to running both here if no
+    // thread can be started; nothing has been touched by then.
+    template<typename First, typename Second>
+    static void forkJoin(int forks, int work, First first, Second second) {
+        if (forks > 0 && work >= PARALLEL_GRAIN) {
+            std::future<void> forked;
+            try {
+                forked = std::async(std::launch::async, first);
+            } catch (const std::exception&) {
+                forks = 0;
+            }
+            if (forks > 0) {
+                second();
+                forked.get();
+                return;
+            }
+        }
+        first();
+        second();
+    }
+
+    // Union keeping a's value for keys in both. Work O(m log(n/m + 1))
+    // for sizes m <= n; span O(log^2 n) with enough forks.
+    Node* unionHelper(Node* a, Node* b, int forks, Node*& garbage) {
+        if (!a) return b;
+        if (!b) return a;
+        push(a);
+        Node* bLeft = nullptr;
+        Node* bRight = nullptr;
+        Node* duplicate = split(b, a->key, bLeft, bRight);
+        if (duplicate) {
+            discardNode(duplicate, garbage);
+        }
+
+        Node* left = nullptr;
+        Node* right = nullptr;
+        Node* rightGarbage = nullptr;
+        forkJoin(forks, getSize(a) + getSize(b),
+            [&]() { left = unionHelper(a->left, bLeft, forks / 2, garbage); },
+            [&]() { right = unionHelper(a->right, bRight, forks / 2, rightGarbage); });
+        appendGarbage(garbage, rightGarbage);
+        return join(left, a, right);
+    }
+
+    // Keys in both, keeping a's values
+    Node* intersectionHelper(Node* a, Node* b, int forks, Node*& garbage) {
+        if (!a || !b) {
+            discardTree(a, garbage);
+            discardTree(b, garbage);
+            return nullptr;
+        }
+        push(a);
+        Node* bLeft = nullptr;
+        Node* bRight = nullptr;
+        Node* match = split(b, a->key, bLeft, bRight);
+
+        Node* left = nullptr;
+        Node* right = nullptr;
+        Node* rightGarbage = nullptr;
+        forkJoin(forks, getSize(a) + getSize(b),
+            [&]() { left = intersectionHelper(a->left, bLeft, forks / 2, garbage); },
+            [&]() { right = intersectionHelper(a->right, bRight, forks / 2, rightGarbage); });
+        appendGarbage(garbage, rightGarbage);
+
+        if (match) {
+            discardNode(match, garbage);
+            return join(left, a, right);
+        }
+        discardNode(a, garbage);
+        return joinTwo(left, right);
+    }
+
+    // Keys of a that are not in b
+    Node* differenceHelper(Node* a, Node* b, int forks, Node*& garbage) {
+        if (!a || !b) {
+            discardTree(b, garbage);
+            return a;
+        }
+        push(b);
+        Node* aLeft = nullptr;
+        Node* aRight = nullptr;
+        Node* match = split(a, b->key, aLeft, aRight);
+        if (match) {
+            discardNode(match, garbage);
+        }
+
+        Node* left = nullptr;
+        Node* right = nullptr;
+        Node* rightGarbage = nullptr;
+        Node* bLeft = b->left;
+        Node* bRight = b->right;
+        discardNode(b, garbage);
+        forkJoin(forks, getSize(aLeft) + getSize(aRight) + getSize(bLeft) + getSize(bRight),
+            [&]() { left = differenceHelper(aLeft, bLeft, forks / 2, garbage); },
+            [&]() { right = differenceHelper(aRight, bRight, forks / 2, rightGarbage); });
+        appendGarbage(garbage, rightGarbage);
+        return joinTwo(left, right);
+    }
+
+    static int forksFor(unsigned threads) {
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        return threads > 1 ? static_cast<int>(threads) - 1 : 0;
+    }
+
+    // Takes other's nodes for a set operation and tidies up afterwards
+    template<typename Operation>
+    void combineWith(AVL& other, Operation operation) {
+        Node* garbage = nullptr;
+        Node* otherRoot = other.root;
+        other.root = other.finger = nullptr;
+        root = operation(root, otherRoot, garbage);
+        finger = findMax(root);
+        while (garbage) {
+            Node* next = garbage->left;
+            pool().destroy(garbage);
+            garbage = next;
+        }
+    }
+
+    template<typename Visitor>
+    static void remapHelper(Node* node, Visitor& remap) {
+        if (!node) return;
+        push(node);
+        remapHelper(node->left, remap);
+        node->key = remap(node->key, node->value);
+        remapHelper(node->right, remap);
     }
 
 public:
-    AVL() : root(nullptr) {}
+    AVL() : root(nullptr), finger(nullptr) {}
     
-    ~AVL() = default;  // Smart pointers handle cleanup automatically
+    ~AVL() {
+        destroyAll(root);
+    }
+
+    // Trees own their nodes; moving is fine, sharing them is not
+    AVL(const AVL&) = delete;
+    AVL& operator=(const AVL&) = delete;
+
+    AVL(AVL&& other) : root(other.root), finger(other.finger) {
+        other.root = nullptr;
+        other.finger = nullptr;
+    }
+
+    AVL& operator=(AVL&& other) {
+        if (this != &other) {
+            destroyAll(root);
+            root = other.root;
+            finger = other.finger;
+            other.root = nullptr;
+            other.finger = nullptr;
+        }
+        return *this;
+    }
+
+    // Adds n free nodes to the pool this tree type draws from, so n more
+    // inserts (into any tree of this type) allocate nothing.
+    static void reserveNodes(size_t n) {
+        pool().reserve(pool().available() + n);
+    }
+
+    // What count nodes of this tree type take: keys and values are the
+    // payload, the rest of each pool block (links, height, size,
+    // augmentation, padding) is node overhead. Trees that hold n nodes
+    // between them can be accounted for at once this way.
+    static MemoryUsage nodeUsage(size_t count) {
+        MemoryUsage usage;
+        usage.payload = count * (sizeof(Key) + sizeof(Value));
+        usage.node = count * NodePool::blockSize() - usage.payload;
+        return usage;
+    }
 
-    void insert(const Key& key, std::shared_ptr<Value> value) {
-        root = insertHelper(root, key, value);
+    // O(1): the root knows the size of the tree
+    MemoryUsage memoryUsage() const {
+        return nodeUsage(size());
     }
 
+    // Constructs the value in place from args unless key is present.
+    // Returns the stored value and whether it was inserted. A key above
+    // every other one is appended at the finger without a search.
+    template<typename... Args>
+    std::pair<Value*, bool> try_emplace(const Key& key, Args&&... args) {
+        bool inserted = false;
+        Node* node = emplaceNode(key, inserted, std::forward<Args>(args)...);
+        return std::make_pair(&node->value, inserted);
+    }
+
+    template<typename... Args>
+    std::pair<Value*, bool> emplace(const Key& key, Args&&... args) {
+        return try_emplace(key, std::forward<Args>(args)...);
+    }
+
+    template<typename V>
+    std::pair<Value*, bool> insert_or_assign(const Key& key, V&& value) {
+        auto result = try_emplace(key, std::forward<V>(value));
+        if (!result.second) {
+            *result.first = std::forward<V>(value);
+        }
+        return result;
+    }
+
+    // There is no hinted insert: without parent links the only place a
+    // hint could skip the search is the back of the tree, which the finger
+    // already covers. Indexes loaded from sorted input with hints use BTree.
     void insert(const Key& key, const Value& value) {
-        root = insertHelper(root, key, std::make_shared<Value>(value));
+        insert_or_assign(key, value);
     }
 
     void remove(const Key& key) {
         root = removeHelper(root, key);
+        if (!finger) {
+            finger = findMax(root);
+        }
+    }
+
+    // Points into the tree: stays valid across inserts, not across a remove.
+    // With an augmentation, change values only through applyRange, so the
+    // summaries above them stay right, and read them through get: the node
+    // may not have received the tags still pending above it.
+    Value* find(const Key& key) const {
+        Tag above;
+        Node* node = findHelper(key, above);
+        return node ? &node->value : nullptr;
     }
 
-    std::shared_ptr<Value> find(const Key& key) const {
-        auto node = findHelper(root, key);
-        return node ? node->value : nullptr;
+    // Copies key's value, with every tag pending above it applied, into
+    // value; false if key is absent. Writes nothing, like every const
+    // lookup, so readers can share the tree.
+    bool get(const Key& key, Value& value) const {
+        Tag above;
+        const Node* node = findHelper(key, above);
+        if (!node) {
+            return false;
+        }
+        value = Augment::seenValue(node->value, above);
+        return true;
+    }
+
+    // Looks up count keys at once, writing find(keys[i]) into out[i].
+    // Descents are interleaved in groups so the next level of every
+    // lookup is prefetched while the others are still comparing.
+    void find_batch(const Key* keys, size_t count, Value** out) const {
+        const size_t GROUP = 16;
+        Node* cursor[GROUP];
+
+        for (size_t base = 0; base < count; base += GROUP) {
+            const size_t size = std::min(GROUP, count - base);
+            for (size_t i = 0; i < size; i++) {
+                cursor[i] = root;
+                if (!root) {
+                    out[base + i] = nullptr;
+                }
+            }
+
+            size_t active = root ? size : 0;
+            while (active > 0) {
+                active = 0;
+                for (size_t i = 0; i < size; i++) {
+                    Node* node = cursor[i];
+                    if (!node) continue;
+
+                    const Key& key = keys[base + i];
+                    if (key < node->key) {
+                        node = node->left;
+                    } else if (key > node->key) {
+                        node = node->right;
+                    } else {
+                        out[base + i] = &node->value;
+                        cursor[i] = nullptr;
+                        continue;
+                    }
+
+                    cursor[i] = node;
+                    if (node) {
+                        AVL_PREFETCH(node);
+                        active++;
+                    } else {
+                        out[base + i] = nullptr;
+                    }
+                }
+            }
+        }
+    }
+
+    // Calls visit(key, value) for every entry in ascending key order, each
+    // value seen with the tags pending above it
+    template<typename Visitor>
+    void forEach(Visitor visit) const {
+        forEachHelper(root, visit, Tag());
     }
 
     bool isEmpty() const {
         return root == nullptr;
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> getSmallest() const {
-        if (!root) return nullptr;
-        return findMin(root);
+    // Like find, for the smallest and biggest keys
+    Node* getSmallest() const {
+        Node* node = root;
+        while (node && node->left) {
+            node = node->left;
+        }
+        return node;
+    }
+
+    Node* getBiggest() const {
+        Node* node = root;
+        while (node && node->right) {
+            node = node->right;
+        }
+        return node;
+    }
+
+    int size() const {
+        return getSize(root);
+    }
+
+    // The entry with exactly rank smaller keys, or null if rank is out of
+    // range. O(log n) through the subtree sizes.
+    Node* select(int rank) const {
+        Node* node = root;
+        while (node) {
+            const int leftSize = getSize(node->left);
+            if (rank < leftSize) {
+                node = node->left;
+            } else if (rank > leftSize) {
+                rank -= leftSize + 1;
+                node = node->right;
+            } else {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    // Number of keys smaller than key
+    int rank(const Key& key) const {
+        int smaller = 0;
+        for (const Node* node = root; node; ) {
+            if (node->key < key) {
+                smaller += getSize(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return smaller;
+    }
+
+    // Applies tag to the values of every key in [lo, hi], in O(log n)
+    void applyRange(const Key& lo, const Key& hi, const Tag& tag) {
+        if (hi < lo) return;
+        applyRangeHelper(root, &lo, &hi, tag);
+    }
+
+    // Summary of the values of every key in [lo, hi], in O(log n)
+    Summary summarizeRange(const Key& lo, const Key& hi) const {
+        if (hi < lo) return Augment::none();
+        return summarizeRangeHelper(root, &lo, &hi, Tag());
+    }
+
+    Summary summarize() const {
+        return root ? Augment::whole(*root) : Augment::none();
     }
 
-    std::shared_ptr<AVLNode<Key, Value>> getBiggest() const {
-        if (!root) return nullptr;
-        auto current = root;
-        while (current->right) {
-            current = current->right;
+    // Applies tag to every value, in O(1)
+    void applyAll(const Tag& tag) {
+        if (root) {
+            Augment::apply(*root, tag);
         }
-        return current;
+    }
+
+    // Set operations. Each takes other's nodes, leaving it empty, and
+    // keeps this tree's value where a key is in both. Work is
+    // O(m log(n/m + 1)) for sizes m <= n; the two halves of each step run
+    // in parallel on up to threads threads (0: one per core).
+    void unionWith(AVL&& other, unsigned threads = 0) {
+        const int forks = forksFor(threads);
+        combineWith(other, [&](Node* a, Node* b, Node*& garbage) {
+            return unionHelper(a, b, forks, garbage);
+        });
+    }
+
+    void intersectWith(AVL&& other, unsigned threads = 0) {
+        const int forks = forksFor(threads);
+        combineWith(other, [&](Node* a, Node* b, Node*& garbage) {
+            return intersectionHelper(a, b, forks, garbage);
+        });
+    }
+
+    void subtract(AVL&& other, unsigned threads = 0) {
+        const int forks = forksFor(threads);
+        combineWith(other, [&](Node* a, Node* b, Node*& garbage) {
+            return differenceHelper(a, b, forks, garbage);
+        });
+    }
+
+    // Appends other, whose keys must all be above this tree's, in
+    // O(log n). other is left empty.
+    void concat(AVL&& other) {
+        combineWith(other, [&](Node* a, Node* b, Node*&) {
+            return joinTwo(a, b);
+        });
+    }
+
+    // Replaces every key k by remap(k, value) in one in-order pass. remap
+    // must be strictly increasing, so the tree stays ordered. O(n).
+    template<typename Visitor>
+    void remapKeys(Visitor remap) {
+        remapHelper(root, remap);
     }
 };
 
@@ -0,0 +1,141 @@
+#ifndef DS_WET1_SPRING2024_ALLIANCES_H
+#define DS_WET1_SPRING2024_ALLIANCES_H
+
+#include "MemoryUsage.h"
+#include <vector>
+#include <utility>
+
+// Weighted union-find over ship alliances. Every ship gets a slot when it
+// is added, starting out as an alliance of its own; all per-slot data
+// lives in parallel arrays indexed by slot.
+//
+// bonus[s] is a lazy treasure delta relative to the parent of s. A root
+// keeps its own delta: a battle adds to the root only, and the bonus of a
+// slot is the sum along its path including the root. Linking subtracts
+// the new parent's bonus from the old root, so nobody's total changes.
+//
+// Each alliance also keeps its slots on a circular list, which is spliced
+// in O(1) on a union, and at its root its total cannons and pirates.
+class Alliances {
+private:
+    std::vector<int> parent;
+    std::vector<int> bonus;
+    std::vector<int> next;         // Next slot of the same alliance
+    std::vector<int> shipIds;      // 0 once the ship is removed
+    std::vector<int> members;      // Valid at roots only
+    std::vector<int> cannonTotals; // Valid at roots only
+    std::vector<int> pirateTotals; // Valid at roots only
+    std::vector<char> staleFlags;  // See markStale
+
+public:
+    int size() const {
+        return static_cast<int>(parent.size());
+    }
+
+    void reserve(size_t n) {
+        parent.reserve(n);
+        bonus.reserve(n);
+        next.reserve(n);
+        shipIds.reserve(n);
+        members.reserve(n);
+        cannonTotals.reserve(n);
+        pirateTotals.reserve(n);
+        staleFlags.reserve(n);
+    }
+
+    // A new alliance of one ship with no pirates; returns its slot
+    int makeSet(int shipId, int cannons) {
+        const int slot = size();
+        parent.push_back(slot);
+        bonus.push_back(0);
+        next.push_back(slot);
+        shipIds.push_back(shipId);
+        members.push_back(1);
+        cannonTotals.push_back(cannons);
+        pirateTotals.push_back(0);
+        staleFlags.push_back(0);
+        return slot;
+    }
+
+    // Returns the root of slot and the treasure bonus owed to it. Path
+    // halving: every visited slot is re-pointed at its grandparent, folding
+    // the skipped parent's delta into its own.
+    int find(int slot, int& bonusOffset) {
+        bonusOffset = 0;
+        while (parent[slot] != slot) {
+            const int p = parent[slot];
+            if (parent[p] != p) {
+                bonus[slot] += bonus[p];
+                parent[slot] = parent[p];
+            }
+            bonusOffset += bonus[slot];
+            slot = parent[slot];
+        }
+        bonusOffset += bonus[slot];
+        return slot;
+    }
+
+    int find(int slot) {
+        int bonusOffset;
+        return find(slot, bonusOffset);
+    }
+
+    int cannons(int root) const { return cannonTotals[root]; }
+    int pirates(int root) const { return pirateTotals[root]; }
+    int shipId(int slot) const { return shipIds[slot]; }
+    int nextSlot(int slot) const { return next[slot]; }
+
+    // Adds to every ship of the alliance, including ships linked under it
+    void addBonus(int root, int amount) {
+        bonus[root] += amount;
+    }
+
+    void addPirates(int root, int count) {
+        pirateTotals[root] += count;
+    }
+
+    // The slot stays in its alliance, without a ship or its cannons
+    void removeShip(int slot, int cannons) {
+        cannonTotals[find(slot)] -= cannons;
+        shipIds[slot] = 0;
+    }
+
+    // Joins two different roots, the smaller under the larger, and returns
+    // the root of the union
+    int link(int root1, int root2) {
+        const int primary = members[root1] >= members[root2] ? root1 : root2;
+        const int secondary = primary == root1 ? root2 : root1;
+        parent[secondary] = primary;
+        bonus[secondary] -= bonus[primary];
+        members[primary] += members[secondary];
+        cannonTotals[primary] += cannonTotals[secondary];
+        pirateTotals[primary] += pirateTotals[secondary];
+        std::swap(next[primary], next[secondary]);
+        return primary;
+    }
+
+    // A flag per slot for whoever tracks alliances whose bonus changed
+    bool isStale(int slot) const {
+        return staleFlags[slot] != 0;
+    }
+
+    void setStale(int slot, bool stale) {
+        staleFlags[slot] = stale ? 1 : 0;
+    }
+
+    // The slot arrays are all payload
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(parent, usage.payload);
+        usage.addVector(bonus, usage.payload);
+        usage.addVector(next, usage.payload);
+        usage.addVector(shipIds, usage.payload);
+        usage.addVector(members, usage.payload);
+        usage.addVector(cannonTotals, usage.payload);
+        usage.addVector(pirateTotals, usage.payload);
+        usage.addVector(staleFlags, usage.payload);
+        return usage;
+    }
+};
+
+#endif // DS_WET1_SPRING2024_ALLIANCES_H
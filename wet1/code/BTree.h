@@ -0,0 +1,674 @@
+#ifndef DS_WET1_SPRING2024_BTREE_H
+#define DS_WET1_SPRING2024_BTREE_H
+
+#include "MemoryUsage.h"
+#include "SlabPool.h"
+#include <algorithm>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BTREE_SIMD 1
+#endif
+
+#if defined(__GNUC__)
+#define BTREE_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define BTREE_PREFETCH(addr) ((void)0)
+#endif
+
+// Position of key among the sorted keys[0..count): how many are smaller,
+// and how many are smaller or equal.
+template<typename Key>
+inline int btreeCountLess(const Key* keys, int count, const Key& key) {
+    int i = 0;
+    while (i < count && keys[i] < key) {
+        i++;
+    }
+    return i;
+}
+
+template<typename Key>
+inline int btreeCountLessEqual(const Key* keys, int count, const Key& key) {
+    int i = 0;
+    while (i < count && !(key < keys[i])) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef BTREE_SIMD
+// int keys are compared four at a time. A node's key array is a multiple
+// of four long, so the loads never leave it; lanes past count are masked.
+inline unsigned btreeLaneMask(int count) {
+    return (1u << count) - 1;
+}
+
+inline int btreeCountLess(const int* keys, int count, const int& key) {
+    const __m128i needle = _mm_set1_epi32(key);
+    unsigned less = 0;
+    for (int i = 0; i < count; i += 4) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        const __m128i lanes = _mm_cmplt_epi32(chunk, needle);
+        less |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(lanes))) << i;
+    }
+    return __builtin_popcount(less & btreeLaneMask(count));
+}
+
+inline int btreeCountLessEqual(const int* keys, int count, const int& key) {
+    const __m128i needle = _mm_set1_epi32(key);
+    unsigned greater = 0;
+    for (int i = 0; i < count; i += 4) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        const __m128i lanes = _mm_cmpgt_epi32(chunk, needle);
+        greater |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(lanes))) << i;
+    }
+    return count - __builtin_popcount(greater & btreeLaneMask(count));
+}
+#endif
+
+// B+-tree with the same interface as AVL, for indexes that are large
+// enough for cache misses to dominate. Every node holds up to ORDER keys,
+// so a lookup touches about log16(n) nodes instead of log2(n), and the
+// keys of one node are searched with SIMD compares.
+//
+// Values live in the leaves, which are linked left to right. Unlike AVL,
+// inserting can shift values inside a leaf, so a pointer returned by find
+// or try_emplace stays valid only until the next insert or remove.
+// Value must be default-constructible and movable.
+template<typename Key, typename Value>
+class BTree {
+public:
+    class Cursor;
+
+private:
+    static const int ORDER = 16;          // Keys per node, a multiple of 4
+    static const int MIN = ORDER / 2 - 1; // Fewest keys in a non-root node
+
+    struct Node {
+        bool leaf;
+        int count;
+        Key keys[ORDER];
+
+        explicit Node(bool leaf) : leaf(leaf), count(0), keys() {}
+    };
+
+    struct Leaf : Node {
+        Value values[ORDER];
+        Leaf* prev;
+        Leaf* next;
+
+        Leaf() : Node(true), values(), prev(nullptr), next(nullptr) {}
+    };
+
+    struct Inner : Node {
+        Node* children[ORDER + 1];  // children[i] holds keys below keys[i]
+
+        Inner() : Node(false), children() {}
+    };
+
+    SlabPools::User poolUser;  // Outlives the nodes, see SlabPools
+    Node* root;
+    Leaf* last;  // The rightmost leaf, so appends need no search
+
+    // Kept up to date for memoryUsage
+    size_t entries;
+    size_t leaves;
+    size_t inners;
+
+    // Nodes come from pools shared by every tree of this Key and Value
+    static SlabPool<Leaf>& leafPool() {
+        return SlabPool<Leaf>::instance();
+    }
+
+    static SlabPool<Inner>& innerPool() {
+        return SlabPool<Inner>::instance();
+    }
+
+    static Leaf* asLeaf(Node* node) {
+        return static_cast<Leaf*>(node);
+    }
+
+    static Inner* asInner(Node* node) {
+        return static_cast<Inner*>(node);
+    }
+
+    Leaf* newLeaf() {
+        Leaf* leaf = leafPool().create();
+        leaves++;
+        return leaf;
+    }
+
+    Inner* newInner() {
+        Inner* inner = innerPool().create();
+        inners++;
+        return inner;
+    }
+
+    void deleteLeaf(Leaf* leaf) {
+        leafPool().destroy(leaf);
+        leaves--;
+    }
+
+    void deleteInner(Inner* inner) {
+        innerPool().destroy(inner);
+        inners--;
+    }
+
+    static void destroyAll(Node* node) {
+        if (!node) return;
+        if (node->leaf) {
+            leafPool().destroy(asLeaf(node));
+            return;
+        }
+        Inner* inner = asInner(node);
+        for (int i = 0; i <= inner->count; i++) {
+            destroyAll(inner->children[i]);
+        }
+        innerPool().destroy(inner);
+    }
+
+    Leaf* firstLeaf() const {
+        Node* node = root;
+        while (node && !node->leaf) {
+            node = asInner(node)->children[0];
+        }
+        return asLeaf(node);
+    }
+
+    Leaf* findLeaf(const Key& key) const {
+        Node* node = root;
+        while (node && !node->leaf) {
+            Inner* inner = asInner(node);
+            node = inner->children[btreeCountLessEqual(inner->keys, inner->count, key)];
+        }
+        return asLeaf(node);
+    }
+
+    // Splits the full child parent->children[index] in two, moving its
+    // upper half into a new right sibling. parent must not be full.
+    void splitChild(Inner* parent, int index) {
+        Node* child = parent->children[index];
+        Node* sibling;
+        Key separator;
+
+        if (child->leaf) {
+            Leaf* left = asLeaf(child);
+            Leaf* right = newLeaf();
+            const int keep = ORDER / 2;
+            right->count = ORDER - keep;
+            for (int i = 0; i < right->count; i++) {
+                right->keys[i] = left->keys[keep + i];
+                right->values[i] = std::move(left->values[keep + i]);
+            }
+            left->count = keep;
+
+            right->next = left->next;
+            right->prev = left;
+            if (left->next) left->next->prev = right;
+            left->next = right;
+            if (left == last) last = right;
+
+            separator = right->keys[0];
+            sibling = right;
+        } else {
+            Inner* left = asInner(child);
+            Inner* right = newInner();
+            const int middle = ORDER / 2;
+            right->count = ORDER - middle - 1;
+            for (int i = 0; i < right->count; i++) {
+                right->keys[i] = left->keys[middle + 1 + i];
+            }
+            for (int i = 0; i <= right->count; i++) {
+                right->children[i] = left->children[middle + 1 + i];
+            }
+            left->count = middle;
+
+            separator = left->keys[middle];
+            sibling = right;
+        }
+
+        for (int i = parent->count; i > index; i--) {
+            parent->keys[i] = parent->keys[i - 1];
+            parent->children[i + 1] = parent->children[i];
+        }
+        parent->keys[index] = separator;
+        parent->children[index + 1] = sibling;
+        parent->count++;
+    }
+
+    // Refills parent->children[index] after it dropped below MIN keys, by
+    // borrowing from a sibling or merging with one.
+    void fixChild(Inner* parent, int index) {
+        Node* left = index > 0 ? parent->children[index - 1] : nullptr;
+        Node* right = index < parent->count ? parent->children[index + 1] : nullptr;
+
+        if (left && left->count > MIN) {
+            borrowFromLeft(parent, index);
+        } else if (right && right->count > MIN) {
+            borrowFromRight(parent, index);
+        } else if (left) {
+            merge(parent, index - 1);
+        } else {
+            merge(parent, index);
+        }
+    }
+
+    void borrowFromLeft(Inner* parent, int index) {
+        Node* child = parent->children[index];
+        Node* left = parent->children[index - 1];
+
+        if (child->leaf) {
+            Leaf* to = asLeaf(child);
+            Leaf* from = asLeaf(left);
+            for (int i = to->count; i > 0; i--) {
+                to->keys[i] = to->keys[i - 1];
+                to->values[i] = std::move(to->values[i - 1]);
+            }
+            to->keys[0] = from->keys[from->count - 1];
+            to->values[0] = std::move(from->values[from->count - 1]);
+            parent->keys[index - 1] = to->keys[0];
+        } else {
+            Inner* to = asInner(child);
+            Inner* from = asInner(left);
+            to->children[to->count + 1] = to->children[to->count];
+            for (int i = to->count; i > 0; i--) {
+                to->keys[i] = to->keys[i - 1];
+                to->children[i] = to->children[i - 1];
+            }
+            to->keys[0] = parent->keys[index - 1];
+            to->children[0] = from->children[from->count];
+            parent->keys[index - 1] = from->keys[from->count - 1];
+        }
+        child->count++;
+        left->count--;
+    }
+
+    void borrowFromRight(Inner* parent, int index) {
+        Node* child = parent->children[index];
+        Node* right = parent->children[index + 1];
+
+        if (child->leaf) {
+            Leaf* to = asLeaf(child);
+            Leaf* from = asLeaf(right);
+            to->keys[to->count] = from->keys[0];
+            to->values[to->count] = std::move(from->values[0]);
+            for (int i = 0; i + 1 < from->count; i++) {
+                from->keys[i] = from->keys[i + 1];
+                from->values[i] = std::move(from->values[i + 1]);
+            }
+            parent->keys[index] = from->keys[0];
+        } else {
+            Inner* to = asInner(child);
+            Inner* from = asInner(right);
+            to->keys[to->count] = parent->keys[index];
+            to->children[to->count + 1] = from->children[0];
+            parent->keys[index] = from->keys[0];
+            for (int i = 0; i + 1 < from->count; i++) {
+                from->keys[i] = from->keys[i + 1];
+            }
+            for (int i = 0; i < from->count; i++) {
+                from->children[i] = from->children[i + 1];
+            }
+        }
+        child->count++;
+        right->count--;
+    }
+
+    // Moves parent->children[index + 1] into parent->children[index] and
+    // frees it, dropping the separator between them.
+    void merge(Inner* parent, int index) {
+        Node* left = parent->children[index];
+        Node* right = parent->children[index + 1];
+
+        if (left->leaf) {
+            Leaf* to = asLeaf(left);
+            Leaf* from = asLeaf(right);
+            for (int i = 0; i < from->count; i++) {
+                to->keys[to->count + i] = from->keys[i];
+                to->values[to->count + i] = std::move(from->values[i]);
+            }
+            to->count += from->count;
+            to->next = from->next;
+            if (from->next) from->next->prev = to;
+            if (from == last) last = to;
+            deleteLeaf(from);
+        } else {
+            Inner* to = asInner(left);
+            Inner* from = asInner(right);
+            to->keys[to->count] = parent->keys[index];
+            for (int i = 0; i < from->count; i++) {
+                to->keys[to->count + 1 + i] = from->keys[i];
+            }
+            for (int i = 0; i <= from->count; i++) {
+                to->children[to->count + 1 + i] = from->children[i];
+            }
+            to->count += from->count + 1;
+            deleteInner(from);
+        }
+
+        for (int i = index; i + 1 < parent->count; i++) {
+            parent->keys[i] = parent->keys[i + 1];
+            parent->children[i + 1] = parent->children[i + 2];
+        }
+        parent->count--;
+    }
+
+    // Puts key and value at pos in leaf, which must have room and be the
+    // leaf key belongs in
+    void insertAt(Leaf* leaf, int pos, const Key& key, Value&& value) {
+        for (int i = leaf->count; i > pos; i--) {
+            leaf->keys[i] = leaf->keys[i - 1];
+            leaf->values[i] = std::move(leaf->values[i - 1]);
+        }
+        leaf->keys[pos] = key;
+        leaf->values[pos] = std::move(value);
+        leaf->count++;
+        entries++;
+    }
+
+    // Inserts or finds key; sets inserted. A key above every other one
+    // goes straight into the last leaf while it has room, so sorted
+    // appends search from the root only once per half leaf.
+    template<typename... Args>
+    Cursor emplaceCursor(const Key& key, bool& inserted, Args&&... args) {
+        inserted = true;
+        if (last && last->count < ORDER && last->keys[last->count - 1] < key) {
+            insertAt(last, last->count, key, Value(std::forward<Args>(args)...));
+            return Cursor(last, last->count - 1);
+        }
+
+        if (!root) {
+            root = last = newLeaf();
+        }
+        if (root->count == ORDER) {
+            Inner* newRoot = newInner();
+            newRoot->children[0] = root;
+            root = newRoot;
+            splitChild(newRoot, 0);
+        }
+
+        Node* node = root;
+        while (!node->leaf) {
+            Inner* inner = asInner(node);
+            int index = btreeCountLessEqual(inner->keys, inner->count, key);
+            if (inner->children[index]->count == ORDER) {
+                splitChild(inner, index);
+                if (!(key < inner->keys[index])) {
+                    index++;
+                }
+            }
+            node = inner->children[index];
+        }
+
+        Leaf* leaf = asLeaf(node);
+        const int pos = btreeCountLess(leaf->keys, leaf->count, key);
+        if (pos < leaf->count && leaf->keys[pos] == key) {
+            inserted = false;
+            return Cursor(leaf, pos);
+        }
+        insertAt(leaf, pos, key, Value(std::forward<Args>(args)...));
+        return Cursor(leaf, pos);
+    }
+
+    bool removeHelper(Node* node, const Key& key) {
+        if (node->leaf) {
+            Leaf* leaf = asLeaf(node);
+            const int pos = btreeCountLess(leaf->keys, leaf->count, key);
+            if (pos == leaf->count || !(leaf->keys[pos] == key)) {
+                return false;
+            }
+            for (int i = pos; i + 1 < leaf->count; i++) {
+                leaf->keys[i] = leaf->keys[i + 1];
+                leaf->values[i] = std::move(leaf->values[i + 1]);
+            }
+            leaf->values[leaf->count - 1] = Value();
+            leaf->count--;
+            entries--;
+            return true;
+        }
+
+        // Separators may outlive the keys they were copied from; they still
+        // route correctly, since everything right of one is not below it.
+        Inner* inner = asInner(node);
+        const int index = btreeCountLessEqual(inner->keys, inner->count, key);
+        if (!removeHelper(inner->children[index], key)) {
+            return false;
+        }
+        if (inner->children[index]->count < MIN) {
+            fixChild(inner, index);
+        }
+        return true;
+    }
+
+public:
+    // What getSmallest and getBiggest point at, read as entry->key and
+    // entry->value like an AVL node.
+    struct Entry {
+        const Key& key;
+        Value& value;
+    };
+
+    class Cursor {
+    private:
+        friend class BTree;
+
+        Leaf* leaf;
+        int index;
+
+        struct Arrow {
+            Entry entry;
+            Entry* operator->() { return &entry; }
+        };
+
+    public:
+        Cursor(Leaf* leaf, int index) : leaf(leaf), index(index) {}
+
+        explicit operator bool() const { return leaf != nullptr; }
+
+        Arrow operator->() const {
+            return Arrow{Entry{leaf->keys[index], leaf->values[index]}};
+        }
+    };
+
+    BTree() : root(nullptr), last(nullptr), entries(0), leaves(0), inners(0) {}
+
+    ~BTree() {
+        destroyAll(root);
+    }
+
+    // Trees own their nodes; moving is fine, sharing them is not
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    BTree(BTree&& other)
+        : root(other.root), last(other.last),
+          entries(other.entries), leaves(other.leaves), inners(other.inners) {
+        other.root = nullptr;
+        other.last = nullptr;
+        other.entries = other.leaves = other.inners = 0;
+    }
+
+    BTree& operator=(BTree&& other) {
+        if (this != &other) {
+            destroyAll(root);
+            root = other.root;
+            last = other.last;
+            entries = other.entries;
+            leaves = other.leaves;
+            inners = other.inners;
+            other.root = nullptr;
+            other.last = nullptr;
+            other.entries = other.leaves = other.inners = 0;
+        }
+        return *this;
+    }
+
+    // Adds room for n more keys to the pools this tree type draws from,
+    // enough even if every node ends up at its minimum fill.
+    static void reserveNodes(size_t n) {
+        const size_t leaves = n / MIN + 1;
+        leafPool().reserve(leafPool().available() + leaves);
+        innerPool().reserve(innerPool().available() + leaves / MIN + 1);
+    }
+
+    // Constructs the value from args unless key is present. Full nodes are
+    // split on the way down, so the leaf reached always has room.
+    template<typename... Args>
+    std::pair<Value*, bool> try_emplace(const Key& key, Args&&... args) {
+        bool inserted = false;
+        Cursor cursor = emplaceCursor(key, inserted, std::forward<Args>(args)...);
+        return std::make_pair(&cursor.leaf->values[cursor.index], inserted);
+    }
+
+    template<typename... Args>
+    std::pair<Value*, bool> emplace(const Key& key, Args&&... args) {
+        return try_emplace(key, std::forward<Args>(args)...);
+    }
+
+    template<typename V>
+    std::pair<Value*, bool> insert_or_assign(const Key& key, V&& value) {
+        auto result = try_emplace(key, std::forward<V>(value));
+        if (!result.second) {
+            *result.first = std::forward<V>(value);
+        }
+        return result;
+    }
+
+    void insert(const Key& key, const Value& value) {
+        insert_or_assign(key, value);
+    }
+
+    // Insert with a hint: the entry key should follow, such as the one the
+    // previous hinted insert returned (a cursor from before any other
+    // change). When key falls between the hint and its neighbour in the
+    // same leaf, or past the end of the last leaf, and the leaf has room,
+    // it goes in with no search; otherwise this is a plain insert.
+    // Returns the entry now holding key.
+    Cursor insert(Cursor hint, const Key& key, const Value& value) {
+        Leaf* leaf = hint.leaf;
+        const int pos = hint.index + 1;
+        if (leaf && leaf->count < ORDER && leaf->keys[hint.index] < key &&
+            (pos < leaf->count ? key < leaf->keys[pos] : leaf == last)) {
+            insertAt(leaf, pos, key, Value(value));
+            return Cursor(leaf, pos);
+        }
+
+        bool inserted = false;
+        Cursor cursor = emplaceCursor(key, inserted, value);
+        if (!inserted) {
+            cursor.leaf->values[cursor.index] = value;
+        }
+        return cursor;
+    }
+
+    void remove(const Key& key) {
+        if (!root || !removeHelper(root, key)) {
+            return;
+        }
+        if (root->count > 0) {
+            return;
+        }
+        // The root shrinks once it holds no separator or no entry
+        Node* oldRoot = root;
+        if (root->leaf) {
+            root = nullptr;
+            last = nullptr;
+            deleteLeaf(asLeaf(oldRoot));
+        } else {
+            root = asInner(oldRoot)->children[0];
+            deleteInner(asInner(oldRoot));
+        }
+    }
+
+    // Points into a leaf: valid until the next insert or remove.
+    Value* find(const Key& key) const {
+        Leaf* leaf = findLeaf(key);
+        if (!leaf) return nullptr;
+        const int pos = btreeCountLess(leaf->keys, leaf->count, key);
+        if (pos < leaf->count && leaf->keys[pos] == key) {
+            return &leaf->values[pos];
+        }
+        return nullptr;
+    }
+
+    // Looks up count keys at once, writing find(keys[i]) into out[i]. All
+    // leaves are at the same depth, so a group of lookups descends in
+    // lockstep, prefetching each next node while the others compare.
+    void find_batch(const Key* keys, size_t count, Value** out) const {
+        const size_t GROUP = 16;
+        Node* cursor[GROUP];
+
+        for (size_t base = 0; base < count; base += GROUP) {
+            const size_t size = std::min(GROUP, count - base);
+            for (size_t i = 0; i < size; i++) {
+                cursor[i] = root;
+            }
+
+            while (root && !cursor[0]->leaf) {
+                for (size_t i = 0; i < size; i++) {
+                    Inner* inner = asInner(cursor[i]);
+                    cursor[i] = inner->children[
+                        btreeCountLessEqual(inner->keys, inner->count, keys[base + i])];
+                    BTREE_PREFETCH(cursor[i]);
+                }
+            }
+
+            for (size_t i = 0; i < size; i++) {
+                out[base + i] = nullptr;
+                if (!root) continue;
+                Leaf* leaf = asLeaf(cursor[i]);
+                const int pos = btreeCountLess(leaf->keys, leaf->count, keys[base + i]);
+                if (pos < leaf->count && leaf->keys[pos] == keys[base + i]) {
+                    out[base + i] = &leaf->values[pos];
+                }
+            }
+        }
+    }
+
+    // Calls visit(key, value) for every entry in ascending key order,
+    // walking the leaf chain
+    template<typename Visitor>
+    void forEach(Visitor visit) const {
+        for (Leaf* leaf = firstLeaf(); leaf; leaf = leaf->next) {
+            for (int i = 0; i < leaf->count; i++) {
+                visit(leaf->keys[i], leaf->values[i]);
+            }
+        }
+    }
+
+    bool isEmpty() const {
+        return root == nullptr;
+    }
+
+    size_t size() const {
+        return entries;
+    }
+
+    // Keys and values in use are the payload and the unused leaf slots
+    // slack; separators, child and sibling links and the node headers are
+    // node overhead. O(1) from the entry and node counts.
+    MemoryUsage memoryUsage() const {
+        const size_t entryBytes = sizeof(Key) + sizeof(Value);
+        MemoryUsage usage;
+        usage.payload = entries * entryBytes;
+        usage.slack = (leaves * ORDER - entries) * entryBytes;
+        usage.node = leaves * SlabPool<Leaf>::blockSize() + inners * SlabPool<Inner>::blockSize()
+                     - usage.payload - usage.slack;
+        return usage;
+    }
+
+    Cursor getSmallest() const {
+        return Cursor(firstLeaf(), 0);
+    }
+
+    Cursor getBiggest() const {
+        Node* node = root;
+        while (node && !node->leaf) {
+            node = asInner(node)->children[node->count];
+        }
+        return Cursor(asLeaf(node), node ? node->count - 1 : 0);
+    }
+};
+
+#endif // DS_WET1_SPRING2024_BTREE_H
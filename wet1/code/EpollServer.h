@@ -0,0 +1,268 @@
+#ifndef DS_WET1_SPRING2024_EPOLLSERVER_H
+#define DS_WET1_SPRING2024_EPOLLSERVER_H
+
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Event loop serving an engine over a Unix domain socket (Linux only).
+//
+// Requests and responses are fixed-size frames, so a client may pipeline
+// any number of requests and reads the responses back in the same order.
+// Each round of epoll_wait reads what every ready client has sent, hands
+// all complete frames to the engine as one batch (in arrival order per
+// client, clients one after the other), and queues the responses.
+//
+// Engine must provide:
+//   static const size_t REQUEST_SIZE, RESPONSE_SIZE;
+//   void execute(const char* requests, size_t count, char* responses);
+//
+// A client whose unsent responses pile up past MAX_PENDING is not read
+// from until it catches up, so a client that never reads cannot make the
+// server buffer without bound.
+template<typename Engine>
+class EpollServer {
+private:
+    static const int MAX_EVENTS = 256;
+    static const size_t READ_CHUNK = 64 * 1024;
+    static const size_t MAX_PENDING = 1024 * 1024;
+
+    struct Connection {
+        int fd;
+        size_t index;             // Position in connections
+        std::vector<char> in;     // Bytes of a frame not yet complete
+        std::vector<char> out;    // Responses not yet sent
+        size_t sent;              // Prefix of out already sent
+        uint32_t events;
+        bool eof;                 // Peer sent everything; answer, then close
+        bool failed;              // Socket error; close at once
+
+        Connection(int fd, size_t index)
+            : fd(fd), index(index), sent(0), events(EPOLLIN), eof(false), failed(false) {}
+    };
+
+    // Frames of one client within the current batch
+    struct Slice {
+        Connection* connection;
+        size_t count;
+    };
+
+    Engine& engine;
+    int listenFd;
+    int epollFd;
+    volatile std::sig_atomic_t stopping;
+
+    std::vector<Connection*> connections;
+    std::vector<char> requests;
+    std::vector<char> responses;
+    std::vector<Slice> slices;
+
+    static bool setNonblocking(int fd) {
+        const int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    void acceptAll() {
+        while (true) {
+            const int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                return;  // EAGAIN once the backlog is drained
+            }
+            if (!setNonblocking(fd)) {
+                close(fd);
+                continue;
+            }
+            Connection* connection = new Connection(fd, connections.size());
+            epoll_event event;
+            event.events = connection->events;
+            event.data.ptr = connection;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                close(fd);
+                delete connection;
+                continue;
+            }
+            connections.push_back(connection);
+        }
+    }
+
+    // Reads up to READ_CHUNK bytes and moves the complete frames into the
+    // batch; a partial frame stays in the connection's buffer.
+    void readFrom(Connection* connection) {
+        const size_t oldSize = connection->in.size();
+        connection->in.resize(oldSize + READ_CHUNK);
+        const ssize_t got = recv(connection->fd, connection->in.data() + oldSize, READ_CHUNK, 0);
+        if (got <= 0) {
+            connection->in.resize(oldSize);
+            if (got == 0) {
+                connection->eof = true;
+            } else if (errno != EAGAIN && errno != EINTR) {
+                connection->failed = true;
+            }
+            return;
+        }
+        connection->in.resize(oldSize + got);
+
+        const size_t count = connection->in.size() / Engine::REQUEST_SIZE;
+        if (count == 0) return;
+        const size_t bytes = count * Engine::REQUEST_SIZE;
+        requests.insert(requests.end(), connection->in.begin(), connection->in.begin() + bytes);
+        connection->in.erase(connection->in.begin(), connection->in.begin() + bytes);
+        slices.push_back({connection, count});
+    }
+
+    // Sends what the socket takes, then picks the events to wait for:
+    // input unless the peer is done or the backlog is past MAX_PENDING,
+    // room to send while anything is left.
+    void flush(Connection* connection) {
+        while (connection->sent < connection->out.size()) {
+            const ssize_t put = send(connection->fd, connection->out.data() + connection->sent,
+                                     connection->out.size() - connection->sent, MSG_NOSIGNAL);
+            if (put < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) connection->failed = true;
+                break;
+            }
+            connection->sent += put;
+        }
+        if (connection->sent == connection->out.size()) {
+            connection->out.clear();
+            connection->sent = 0;
+        }
+
+        const size_t pending = connection->out.size() - connection->sent;
+        uint32_t events = 0;
+        if (!connection->eof && pending < MAX_PENDING) events |= EPOLLIN;
+        if (pending > 0) events |= EPOLLOUT;
+        if (events != connection->events) {
+            epoll_event event;
+            event.events = events;
+            event.data.ptr = connection;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+            connection->events = events;
+        }
+    }
+
+    bool finished(const Connection* connection) const {
+        return connection->failed || (connection->eof && connection->out.empty());
+    }
+
+    void drop(Connection* connection) {
+        close(connection->fd);  // Also removes it from the epoll set
+        connections[connection->index] = connections.back();
+        connections[connection->index]->index = connection->index;
+        connections.pop_back();
+        delete connection;
+    }
+
+    void runBatch() {
+        size_t total = 0;
+        for (const Slice& slice : slices) total += slice.count;
+        responses.resize(total * Engine::RESPONSE_SIZE);
+        engine.execute(requests.data(), total, responses.data());
+
+        const char* response = responses.data();
+        for (const Slice& slice : slices) {
+            const size_t bytes = slice.count * Engine::RESPONSE_SIZE;
+            std::vector<char>& out = slice.connection->out;
+            out.insert(out.end(), response, response + bytes);
+            response += bytes;
+        }
+    }
+
+public:
+    explicit EpollServer(Engine& engine)
+        : engine(engine), listenFd(-1), epollFd(-1), stopping(0) {}
+
+    ~EpollServer() {
+        while (!connections.empty()) {
+            drop(connections.back());
+        }
+        if (epollFd >= 0) close(epollFd);
+        if (listenFd >= 0) close(listenFd);
+    }
+
+    EpollServer(const EpollServer&) = delete;
+    EpollServer& operator=(const EpollServer&) = delete;
+
+    // Binds path, replacing a stale socket file. False on failure, with
+    // errno set.
+    bool listen(const char* path) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (std::strlen(path) >= sizeof(address.sun_path)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        std::strcpy(address.sun_path, path);
+        unlink(path);
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || !setNonblocking(listenFd) ||
+            bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd, SOMAXCONN) != 0) {
+            return false;
+        }
+
+        epollFd = epoll_create1(0);
+        if (epollFd < 0) return false;
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;  // The listening socket
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
+    }
+
+    // Serves until stop() is called (which is safe from a signal handler)
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        std::vector<Connection*> ready;
+
+        while (!stopping) {
+            const int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            requests.clear();
+            slices.clear();
+            ready.clear();
+            for (int i = 0; i < count; i++) {
+                Connection* connection = static_cast<Connection*>(events[i].data.ptr);
+                if (!connection) {
+                    acceptAll();
+                    continue;
+                }
+                ready.push_back(connection);
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readFrom(connection);
+                }
+            }
+
+            if (!slices.empty()) {
+                runBatch();
+            }
+            for (Connection* connection : ready) {
+                flush(connection);
+                if (finished(connection)) {
+                    drop(connection);
+                }
+            }
+        }
+    }
+
+    void stop() {
+        stopping = 1;
+    }
+};
+
+#endif // DS_WET1_SPRING2024_EPOLLSERVER_H
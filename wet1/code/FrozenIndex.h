@@ -0,0 +1,96 @@
+#ifndef DS_WET1_SPRING2024_FROZENINDEX_H
+#define DS_WET1_SPRING2024_FROZENINDEX_H
+
+#include "MemoryUsage.h"
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__GNUC__)
+#define FROZEN_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define FROZEN_PREFETCH(addr) ((void)0)
+#endif
+
+// Immutable sorted index in Eytzinger (BFS) order: the children of slot k
+// are 2k and 2k + 1, so the first levels of every search share a few cache
+// lines and the rest of the path can be prefetched, as there are no
+// pointers to follow. The descent has no data-dependent branch either: the
+// comparison result is added to the next slot.
+//
+// Built once from entries in ascending key order; slot 0 is unused.
+template<typename Key, typename Value>
+class FrozenIndex {
+private:
+    std::vector<Key> keys;
+    std::vector<Value> values;
+
+    // Places sorted[next..] into the subtree rooted at slot, in order
+    size_t fill(const std::vector<Key>& sortedKeys, std::vector<Value>& sortedValues,
+                size_t next, size_t slot) {
+        if (slot < keys.size()) {
+            next = fill(sortedKeys, sortedValues, next, 2 * slot);
+            keys[slot] = sortedKeys[next];
+            values[slot] = std::move(sortedValues[next]);
+            next++;
+            next = fill(sortedKeys, sortedValues, next, 2 * slot + 1);
+        }
+        return next;
+    }
+
+public:
+    // Replaces the contents with the given entries, which must be sorted
+    // by key without duplicates. sortedValues is left moved-from.
+    void build(const std::vector<Key>& sortedKeys, std::vector<Value>& sortedValues) {
+        keys.assign(sortedKeys.size() + 1, Key());
+        values.assign(sortedKeys.size() + 1, Value());
+        fill(sortedKeys, sortedValues, 0, 1);
+    }
+
+    void clear() {
+        std::vector<Key>().swap(keys);
+        std::vector<Value>().swap(values);
+    }
+
+    size_t size() const {
+        return keys.empty() ? 0 : keys.size() - 1;
+    }
+
+    // The unused slot 0 counts as slack
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(keys, usage.payload);
+        usage.addVector(values, usage.payload);
+        if (!keys.empty()) {
+            usage.payload -= sizeof(Key) + sizeof(Value);
+            usage.slack += sizeof(Key) + sizeof(Value);
+        }
+        return usage;
+    }
+
+    const Value* find(const Key& key) const {
+        const size_t n = size();
+        size_t slot = 1;
+        while (slot <= n) {
+            // Four levels down: sixteen slots, the next cache line to need.
+            // Clamped to the last slot, since forming a pointer past the
+            // end of the array is undefined even if it is never read; the
+            // clamp compiles to a conditional move.
+            FROZEN_PREFETCH(keys.data() + std::min(16 * slot, n));
+            slot = 2 * slot + (keys[slot] < key ? 1 : 0);
+        }
+        // Undo the right turns taken after the last left turn; what is left
+        // is the first slot whose key is not below key, or 0 if none.
+        while (slot & 1) {
+            slot >>= 1;
+        }
+        slot >>= 1;
+
+        if (slot == 0 || !(keys[slot] == key)) {
+            return nullptr;
+        }
+        return &values[slot];
+    }
+};
+
+#endif // DS_WET1_SPRING2024_FROZENINDEX_H
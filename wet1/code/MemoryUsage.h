@@ -0,0 +1,50 @@
+#ifndef DS_WET1_SPRING2024_MEMORYUSAGE_H
+#define DS_WET1_SPRING2024_MEMORYUSAGE_H
+
+#include <cstddef>
+#include <vector>
+
+// Bytes held by a container, split by what they are spent on. Every
+// memoryUsage() is computed from counters the container keeps anyway
+// (sizes, node counts, vector capacities), so asking costs O(1).
+//
+// Free blocks in the per-thread node pools belong to no container and are
+// not counted here; AllocationCounters reports what the pools hold in all.
+struct MemoryUsage {
+    size_t payload = 0;  // Keys, values and records as stored
+    size_t node = 0;     // Links, heights, summaries and padding per node
+    size_t control = 0;  // Reference counts of shared_ptr-owned objects
+    size_t buckets = 0;  // Arrays of pointers to nodes
+    size_t slack = 0;    // Capacity allocated but not in use
+
+    // make_shared keeps the reference counts in the same allocation as the
+    // object: a vtable pointer and two 32-bit counters in both libstdc++
+    // and libc++.
+    static const size_t SHARED_CONTROL_BLOCK = sizeof(void*) + 2 * sizeof(int);
+
+    size_t overhead() const {
+        return node + control + buckets + slack;
+    }
+
+    size_t total() const {
+        return payload + overhead();
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        payload += other.payload;
+        node += other.node;
+        control += other.control;
+        buckets += other.buckets;
+        slack += other.slack;
+        return *this;
+    }
+
+    // Counts the elements of array into used and its spare capacity as slack
+    template<typename T>
+    void addVector(const std::vector<T>& array, size_t& used) {
+        used += array.size() * sizeof(T);
+        slack += (array.capacity() - array.size()) * sizeof(T);
+    }
+};
+
+#endif // DS_WET1_SPRING2024_MEMORYUSAGE_H
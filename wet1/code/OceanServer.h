@@ -0,0 +1,97 @@
+#ifndef DS_WET1_SPRING2024_OCEANSERVER_H
+#define DS_WET1_SPRING2024_OCEANSERVER_H
+
+#include "pirates24b1.h"
+#include <cstdint>
+#include <cstring>
+
+// Wire format of the ocean server (server/ocean_server.cpp). Fields are
+// packed in the host's byte order, which is fine because the socket is
+// local.
+//
+//   request  (20 bytes): int32 op, int32 args[4]   (unused args ignored)
+//   response (12 bytes): int32 status, int64 ans   (0 without an answer)
+//
+// Requests are answered in the order they were sent; an unknown op gets
+// INVALID_INPUT.
+struct OceanWire {
+    enum Op {
+        ADD_SHIP, REMOVE_SHIP, ADD_PIRATE, REMOVE_PIRATE, TREASON, UPDATE_PIRATE_TREASURE,
+        GET_TREASURE, GET_CANNONS, GET_RICHEST_PIRATE, SHIPS_BATTLE,
+        ADD_TREASURE_RANGE, SUM_TREASURE_RANGE, MERGE_SHIPS, FREEZE, UNFREEZE,
+        TREASURE_PERCENTILE, FORM_ALLIANCE, ALLIANCE_BATTLE
+    };
+
+    static const size_t REQUEST_SIZE = 20;
+    static const size_t RESPONSE_SIZE = 12;
+
+    static void putRequest(char* frame, int32_t op, int32_t arg0 = 0, int32_t arg1 = 0,
+                           int32_t arg2 = 0, int32_t arg3 = 0) {
+        const int32_t fields[5] = {op, arg0, arg1, arg2, arg3};
+        std::memcpy(frame, fields, sizeof(fields));
+    }
+
+    static void getResponse(const char* frame, int32_t& status, int64_t& ans) {
+        std::memcpy(&status, frame, sizeof(status));
+        std::memcpy(&ans, frame + sizeof(status), sizeof(ans));
+    }
+};
+
+// Applies each batch the server collects to one Ocean, in order
+class OceanEngine {
+private:
+    Ocean& ocean;
+
+    static void putResponse(char* frame, StatusType status, int64_t ans) {
+        const int32_t code = static_cast<int32_t>(status);
+        std::memcpy(frame, &code, sizeof(code));
+        std::memcpy(frame + sizeof(code), &ans, sizeof(ans));
+    }
+
+    template<typename T>
+    static void putResponse(char* frame, output_t<T> output) {
+        const StatusType status = output.status();
+        putResponse(frame, status, status == StatusType::SUCCESS ? output.ans() : 0);
+    }
+
+    void executeOne(const int32_t* request, char* response) {
+        const int32_t* a = request + 1;
+        switch (request[0]) {
+            case OceanWire::ADD_SHIP:               putResponse(response, ocean.add_ship(a[0], a[1]), 0); break;
+            case OceanWire::REMOVE_SHIP:            putResponse(response, ocean.remove_ship(a[0]), 0); break;
+            case OceanWire::ADD_PIRATE:             putResponse(response, ocean.add_pirate(a[0], a[1], a[2]), 0); break;
+            case OceanWire::REMOVE_PIRATE:          putResponse(response, ocean.remove_pirate(a[0]), 0); break;
+            case OceanWire::TREASON:                putResponse(response, ocean.treason(a[0], a[1]), 0); break;
+            case OceanWire::UPDATE_PIRATE_TREASURE: putResponse(response, ocean.update_pirate_treasure(a[0], a[1]), 0); break;
+            case OceanWire::GET_TREASURE:           putResponse(response, ocean.get_treasure(a[0])); break;
+            case OceanWire::GET_CANNONS:            putResponse(response, ocean.get_cannons(a[0])); break;
+            case OceanWire::GET_RICHEST_PIRATE:     putResponse(response, ocean.get_richest_pirate(a[0])); break;
+            case OceanWire::SHIPS_BATTLE:           putResponse(response, ocean.ships_battle(a[0], a[1]), 0); break;
+            case OceanWire::ADD_TREASURE_RANGE:     putResponse(response, ocean.add_treasure_range(a[0], a[1], a[2], a[3]), 0); break;
+            case OceanWire::SUM_TREASURE_RANGE:     putResponse(response, ocean.sum_treasure_range(a[0], a[1], a[2])); break;
+            case OceanWire::MERGE_SHIPS:            putResponse(response, ocean.merge_ships(a[0], a[1]), 0); break;
+            case OceanWire::FREEZE:                 putResponse(response, ocean.freeze(), 0); break;
+            case OceanWire::UNFREEZE:               putResponse(response, ocean.unfreeze(), 0); break;
+            case OceanWire::TREASURE_PERCENTILE:    putResponse(response, ocean.treasure_percentile(a[0])); break;
+            case OceanWire::FORM_ALLIANCE:          putResponse(response, ocean.form_alliance(a[0], a[1]), 0); break;
+            case OceanWire::ALLIANCE_BATTLE:        putResponse(response, ocean.alliance_battle(a[0], a[1]), 0); break;
+            default:                                putResponse(response, StatusType::INVALID_INPUT, 0); break;
+        }
+    }
+
+public:
+    static const size_t REQUEST_SIZE = OceanWire::REQUEST_SIZE;
+    static const size_t RESPONSE_SIZE = OceanWire::RESPONSE_SIZE;
+
+    explicit OceanEngine(Ocean& ocean) : ocean(ocean) {}
+
+    void execute(const char* requests, size_t count, char* responses) {
+        for (size_t i = 0; i < count; i++) {
+            int32_t request[5];
+            std::memcpy(request, requests + i * REQUEST_SIZE, sizeof(request));
+            executeOne(request, responses + i * RESPONSE_SIZE);
+        }
+    }
+};
+
+#endif // DS_WET1_SPRING2024_OCEANSERVER_H
@@ -0,0 +1,344 @@
+#ifndef DS_WET1_SPRING2024_PERFCOUNTERS_H
+#define DS_WET1_SPRING2024_PERFCOUNTERS_H
+
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware counters of the calling thread through perf_event_open (Linux
+// only). User-space events only, so the system calls that read them
+// hardly show up in what they count.
+//
+// The events are opened as one group, so they are read together and are
+// always scheduled together. An event the CPU or kernel does not offer is
+// left out, and so is one the PMU has no room for next to the others
+// (the group would never run). Left-out events read as 0 and report why.
+// When other users of the PMU crowd the group out, the kernel multiplexes
+// it and it counts only part of the time; counted() scales its counts up
+// to make up for that.
+class PerfCounters {
+public:
+    enum Event {
+        CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, DTLB_MISSES, EVENTS
+    };
+
+    // Raw counts, and how long the group had been enabled and how long
+    // counting when they were read, in nanoseconds
+    struct Sample {
+        uint64_t values[EVENTS];
+        uint64_t timeEnabled;
+        uint64_t timeRunning;
+    };
+
+private:
+    struct Slot {
+        int fd;
+        int index;  // Position in the group read, -1 if not open
+        std::string reason;
+    };
+
+    Slot slots[EVENTS];
+    int leader;
+    int members;
+    uint64_t enabled;  // Group times as of the last read
+    uint64_t running;
+
+    static perf_event_attr attributes(Event event) {
+        static const uint64_t CACHE_READ_MISS =
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch (event) {
+            case CYCLES:        attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+            case INSTRUCTIONS:  attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+            case BRANCH_MISSES: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+            case L1D_MISSES:    attr.type = PERF_TYPE_HW_CACHE; attr.config = PERF_COUNT_HW_CACHE_L1D | CACHE_READ_MISS; break;
+            case LLC_MISSES:    attr.type = PERF_TYPE_HW_CACHE; attr.config = PERF_COUNT_HW_CACHE_LL | CACHE_READ_MISS; break;
+            default:            attr.type = PERF_TYPE_HW_CACHE; attr.config = PERF_COUNT_HW_CACHE_DTLB | CACHE_READ_MISS; break;
+        }
+        return attr;
+    }
+
+    void closeAll() {
+        for (int i = 0; i < EVENTS; i++) {
+            if (slots[i].fd >= 0) {
+                close(slots[i].fd);
+            }
+            slots[i].fd = -1;
+            slots[i].index = -1;
+        }
+        leader = -1;
+        members = 0;
+    }
+
+    // Opens every event not yet given up on, the first one that opens as
+    // the group leader
+    void openGroup() {
+        for (int i = 0; i < EVENTS; i++) {
+            if (!slots[i].reason.empty()) {
+                continue;
+            }
+            perf_event_attr attr = attributes(static_cast<Event>(i));
+            attr.disabled = leader < 0;
+            const int groupFd = leader < 0 ? -1 : slots[leader].fd;
+            const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+            if (fd < 0) {
+                slots[i].reason = std::strerror(errno);
+                continue;
+            }
+            slots[i].fd = static_cast<int>(fd);
+            slots[i].index = members++;
+            if (leader < 0) {
+                leader = i;
+            }
+        }
+    }
+
+    // Whether the group got onto the PMU while it spun for a moment
+    bool scheduled() {
+        ioctl(slots[leader].fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(slots[leader].fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        volatile int spin = 0;
+        for (int i = 0; i < 100000; i++) {
+            spin = spin + i;
+        }
+        Sample sample;
+        read(sample);
+        return running > 0;
+    }
+
+public:
+    PerfCounters() : leader(-1), members(0), enabled(0), running(0) {
+        for (int i = 0; i < EVENTS; i++) {
+            slots[i].fd = -1;
+            slots[i].index = -1;
+        }
+        openGroup();
+        // Too many events for the PMU: drop the last one and try again
+        while (members > 1 && !scheduled()) {
+            int last = EVENTS - 1;
+            while (slots[last].index < 0) {
+                last--;
+            }
+            closeAll();
+            slots[last].reason = "no room on the PMU next to the other events";
+            openGroup();
+        }
+        if (members == 1 && !scheduled()) {
+            slots[leader].reason = "never scheduled on the PMU";
+            closeAll();
+        }
+    }
+
+    ~PerfCounters() {
+        closeAll();
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    static const char* name(int event) {
+        static const char* const NAMES[EVENTS] = {
+            "cycles", "instructions", "L1D-misses", "LLC-misses", "branch-misses", "dTLB-misses"
+        };
+        return NAMES[event];
+    }
+
+    bool available(int event) const {
+        return slots[event].index >= 0;
+    }
+
+    bool anyAvailable() const {
+        return members > 0;
+    }
+
+    // Empty if the event is available
+    const std::string& reason(int event) const {
+        return slots[event].reason;
+    }
+
+    // Share of the time since the last reset that the group was counting;
+    // below 1 when the kernel multiplexed it with other users of the PMU
+    double scheduledShare() const {
+        return enabled ? static_cast<double>(running) / enabled : 1.0;
+    }
+
+    void read(Sample& sample) {
+        uint64_t buffer[3 + EVENTS];
+        std::memset(&sample, 0, sizeof(sample));
+        if (members == 0 || ::read(slots[leader].fd, buffer, sizeof(buffer)) <= 0) {
+            return;
+        }
+        enabled = buffer[1];
+        running = buffer[2];
+        sample.timeEnabled = enabled;
+        sample.timeRunning = running;
+        for (int i = 0; i < EVENTS; i++) {
+            if (slots[i].index >= 0) {
+                sample.values[i] = buffer[3 + slots[i].index];
+            }
+        }
+    }
+
+    // Events counted from before to after, each scaled by the time the
+    // group was enabled over the time it ran in between, as perf stat
+    // does. False, with every count 0, if it did not run in between.
+    static bool counted(const Sample& before, const Sample& after, int64_t counts[EVENTS]) {
+        const uint64_t enabledBetween = after.timeEnabled - before.timeEnabled;
+        const uint64_t runningBetween = after.timeRunning - before.timeRunning;
+        for (int i = 0; i < EVENTS; i++) {
+            counts[i] = 0;
+        }
+        if (runningBetween == 0) {
+            return false;
+        }
+        const double scale = static_cast<double>(enabledBetween) / runningBetween;
+        for (int i = 0; i < EVENTS; i++) {
+            counts[i] = static_cast<int64_t>(static_cast<double>(after.values[i] - before.values[i]) * scale + 0.5);
+        }
+        return true;
+    }
+};
+
+// Per-operation profile for a benchmark: wall time and every available
+// counter, summed per kind of operation and reported per call. The cost
+// of taking the measurements is calibrated first and taken off each one.
+class PerfProfile {
+private:
+    struct Row {
+        uint64_t calls;
+        uint64_t counted;  // Calls measured while the counters ran
+        int64_t nanos;
+        int64_t counts[PerfCounters::EVENTS];  // Over the counted calls
+    };
+
+    PerfCounters& counters;
+    std::vector<std::string> names;
+    std::vector<Row> rows;
+    int64_t overheadNanos;
+    int64_t overheadCounts[PerfCounters::EVENTS];
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    template<typename Operation>
+    void take(Row& row, Operation operation, uint64_t calls, bool subtractOverhead) {
+        PerfCounters::Sample before, after;
+        counters.read(before);
+        const int64_t start = now();
+        operation();
+        const int64_t end = now();
+        counters.read(after);
+
+        row.calls += calls;
+        row.nanos += end - start - (subtractOverhead ? overheadNanos : 0);
+        int64_t counts[PerfCounters::EVENTS];
+        if (!PerfCounters::counted(before, after, counts)) {
+            return;
+        }
+        row.counted += calls;
+        for (int i = 0; i < PerfCounters::EVENTS; i++) {
+            row.counts[i] += counts[i] - (subtractOverhead ? overheadCounts[i] : 0);
+        }
+    }
+
+public:
+    // One row per name; measure() takes the row's index
+    PerfProfile(PerfCounters& counters, const std::vector<std::string>& names)
+        : counters(counters), names(names), rows(names.size(), Row()), overheadNanos(0) {
+        std::memset(overheadCounts, 0, sizeof(overheadCounts));
+    }
+
+    // Measures an empty operation many times; the mean is the overhead
+    void calibrate(int rounds = 100000) {
+        Row empty = Row();
+        for (int i = 0; i < rounds; i++) {
+            take(empty, [] {}, 1, false);
+        }
+        overheadNanos = empty.nanos / rounds;
+        if (empty.counted == 0) {
+            return;
+        }
+        for (int i = 0; i < PerfCounters::EVENTS; i++) {
+            overheadCounts[i] = empty.counts[i] / static_cast<int64_t>(empty.counted);
+        }
+    }
+
+    // An operation that makes calls calls of its kind at once, like a
+    // loop over many lookups, counts as that many, sharing one overhead
+    template<typename Operation>
+    void measure(int kind, Operation operation, uint64_t calls = 1) {
+        take(rows[kind], operation, calls, true);
+    }
+
+    // A table of every kind measured at least once, with a total
+    void print(FILE* out) const {
+        std::fprintf(out, "%-24s %10s %10s", "operation", "calls", "ns/op");
+        for (int i = 0; i < PerfCounters::EVENTS; i++) {
+            std::fprintf(out, " %14s", PerfCounters::name(i));
+        }
+        std::fprintf(out, "\n");
+
+        Row total = Row();
+        for (size_t kind = 0; kind <= rows.size(); kind++) {
+            const bool isTotal = kind == rows.size();
+            const Row& row = isTotal ? total : rows[kind];
+            if (row.calls == 0) {
+                continue;
+            }
+            const double calls = static_cast<double>(row.calls);
+            std::fprintf(out, "%-24s %10llu %10.1f", isTotal ? "total" : names[kind].c_str(),
+                         static_cast<unsigned long long>(row.calls), row.nanos > 0 ? row.nanos / calls : 0.0);
+            const double counted = static_cast<double>(row.counted);
+            for (int i = 0; i < PerfCounters::EVENTS; i++) {
+                if (counters.available(i) && row.counted > 0) {
+                    std::fprintf(out, " %14.2f", row.counts[i] > 0 ? row.counts[i] / counted : 0.0);
+                } else {
+                    std::fprintf(out, " %14s", "n/a");
+                }
+            }
+            std::fprintf(out, "\n");
+
+            if (!isTotal) {
+                total.calls += row.calls;
+                total.counted += row.counted;
+                total.nanos += row.nanos;
+                for (int i = 0; i < PerfCounters::EVENTS; i++) {
+                    total.counts[i] += row.counts[i];
+                }
+            }
+        }
+
+        for (int i = 0; i < PerfCounters::EVENTS; i++) {
+            if (!counters.available(i)) {
+                std::fprintf(out, "%s: not counted (%s)\n", PerfCounters::name(i), counters.reason(i).c_str());
+            }
+        }
+        if (counters.anyAvailable() && counters.scheduledShare() < 1.0) {
+            std::fprintf(out, "counters ran %.0f%% of the time, multiplexed with other users of the PMU; "
+                         "counts are scaled up to the whole time\n", 100 * counters.scheduledShare());
+        }
+        if (counters.anyAvailable() && total.counted < total.calls) {
+            std::fprintf(out, "%llu of %llu calls ran while the counters did not; counts per op are over the rest\n",
+                         static_cast<unsigned long long>(total.calls - total.counted),
+                         static_cast<unsigned long long>(total.calls));
+        }
+    }
+};
+
+#endif // DS_WET1_SPRING2024_PERFCOUNTERS_H
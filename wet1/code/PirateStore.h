@@ -0,0 +1,93 @@
+#ifndef DS_WET1_SPRING2024_PIRATESTORE_H
+#define DS_WET1_SPRING2024_PIRATESTORE_H
+
+#include "MemoryUsage.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Index of a pirate's row in the PirateStore
+typedef uint32_t PirateHandle;
+
+// Every pirate in the ocean, stored as parallel columns indexed by handle.
+// The trees keep handles instead of owning pirate objects, so a pirate costs
+// four ints here plus one int per index entry. Treasure is kept by the
+// ship's arrival-order index, where ship-wide bonuses can reach it lazily;
+// the store only records the value last entered in the ocean-wide
+// treasure distribution.
+// Removed rows go on a free list and are reused by the next add; a free row
+// holds zeros, so whole-column scans need no liveness check.
+class PirateStore {
+private:
+    std::vector<int> ids;
+    std::vector<int> shipIds;
+    std::vector<int> orders;
+    std::vector<int> recordedTreasures;
+    std::vector<PirateHandle> freeHandles;
+
+public:
+    PirateHandle add(int id, int shipId, int order, int recordedTreasure) {
+        if (!freeHandles.empty()) {
+            const PirateHandle handle = freeHandles.back();
+            freeHandles.pop_back();
+            ids[handle] = id;
+            shipIds[handle] = shipId;
+            orders[handle] = order;
+            recordedTreasures[handle] = recordedTreasure;
+            return handle;
+        }
+
+        // Grow all columns up front so a failed allocation leaves them equal
+        if (ids.size() == ids.capacity()) {
+            const size_t capacity = std::max<size_t>(16, ids.size() * 2);
+            ids.reserve(capacity);
+            shipIds.reserve(capacity);
+            orders.reserve(capacity);
+            recordedTreasures.reserve(capacity);
+            freeHandles.reserve(capacity);
+        }
+        ids.push_back(id);
+        shipIds.push_back(shipId);
+        orders.push_back(order);
+        recordedTreasures.push_back(recordedTreasure);
+        return static_cast<PirateHandle>(ids.size() - 1);
+    }
+
+    void reserve(size_t n) {
+        if (n > ids.capacity()) {
+            ids.reserve(n);
+            shipIds.reserve(n);
+            orders.reserve(n);
+            recordedTreasures.reserve(n);
+            freeHandles.reserve(n);
+        }
+    }
+
+    void remove(PirateHandle handle) {
+        ids[handle] = 0;
+        shipIds[handle] = 0;
+        orders[handle] = 0;
+        recordedTreasures[handle] = 0;
+        freeHandles.push_back(handle);
+    }
+
+    int& id(PirateHandle handle) { return ids[handle]; }
+    int& shipId(PirateHandle handle) { return shipIds[handle]; }
+    int& orderInShip(PirateHandle handle) { return orders[handle]; }
+    int& recordedTreasure(PirateHandle handle) { return recordedTreasures[handle]; }
+
+    size_t size() const { return ids.size() - freeHandles.size(); }
+
+    // Rows on the free list, and the free list itself, are slack
+    MemoryUsage memoryUsage() const {
+        const size_t rowBytes = 4 * sizeof(int);  // One int per column
+        MemoryUsage usage;
+        usage.payload = size() * rowBytes;
+        usage.slack = freeHandles.size() * rowBytes +
+                      (ids.capacity() - ids.size()) * rowBytes +
+                      freeHandles.capacity() * sizeof(PirateHandle);
+        return usage;
+    }
+};
+
+#endif // DS_WET1_SPRING2024_PIRATESTORE_H
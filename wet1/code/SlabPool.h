@@ -0,0 +1,310 @@
+#ifndef DS_WET1_SPRING2024_SLABPOOL_H
+#define DS_WET1_SPRING2024_SLABPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+
+// Counts the memory the pools take from the system allocator: slabs taken
+// so far, and the bytes they hold now. Once every pool has warmed up these
+// stay constant, which is how a steady-state workload can be checked for
+// hidden allocations; the bytes drop to 0 when the last pool user goes
+// away.
+class AllocationCounters {
+public:
+    static size_t systemAllocations() { return allocations().load(); }
+    static size_t systemBytes() { return bytes().load(); }
+
+    static void record(size_t size) {
+        allocations()++;
+        bytes() += size;
+    }
+
+    static void recordRelease(size_t size) {
+        bytes() -= size;
+    }
+
+private:
+    static std::atomic<size_t>& allocations() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+    static std::atomic<size_t>& bytes() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+};
+
+// What the pools of all types share between threads: the slabs, spare
+// blocks handed back by threads that exited, and a count of pool users.
+// A user is a container that may hold pooled blocks. It keeps a
+// SlabPools::User, declared before its nodes so that it goes away after
+// them. When the last user goes away every slab is given back to the
+// system and the generation moves on, so each thread drops its free list,
+// which pointed into those slabs, before it next touches the pool.
+class SlabPools {
+public:
+    static const size_t FIRST_SLAB = 64;
+    static const size_t MAX_SLAB = 64 * 1024;
+
+    class User {
+    public:
+        User() {
+            acquire();
+        }
+        User(const User&) {
+            acquire();
+        }
+        User& operator=(const User&) {
+            return *this;
+        }
+        ~User() {
+            retire();
+        }
+    };
+
+    // The slabs and spare blocks of one block type. Each slab's first
+    // block links the next slab.
+    struct Shelf {
+        Shelf* nextShelf;
+        void* slabs;
+        void* spares;
+        size_t spareBlocks;
+        size_t nextSlab;
+        size_t bytes;
+        bool listed;
+    };
+
+    class Lock {
+    public:
+        Lock() {
+            while (state().busy.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        ~Lock() {
+            state().busy.clear(std::memory_order_release);
+        }
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    };
+
+    static uint64_t generation() {
+        return state().generation.load(std::memory_order_acquire);
+    }
+
+    // Under Lock: makes the shelf's slabs part of the next release
+    static void list(Shelf& shelf) {
+        if (shelf.listed) return;
+        shelf.nextShelf = state().shelves;
+        state().shelves = &shelf;
+        shelf.listed = true;
+    }
+
+private:
+    // Constant-initialized and trivially destroyed, so pools still work
+    // while static objects are torn down
+    struct State {
+        std::atomic_flag busy;
+        std::atomic<size_t> users;
+        std::atomic<uint64_t> generation;
+        Shelf* shelves;
+    };
+
+    static State& state() {
+        static State shared = {ATOMIC_FLAG_INIT, {0}, {0}, nullptr};
+        return shared;
+    }
+
+    // Only a user that finds no other has to wait, in case the slabs of
+    // the previous last user are still being given back
+    static void acquire() {
+        State& shared = state();
+        size_t users = shared.users.load(std::memory_order_relaxed);
+        while (users > 0) {
+            if (shared.users.compare_exchange_weak(users, users + 1, std::memory_order_acq_rel)) {
+                return;
+            }
+        }
+        Lock lock;
+        shared.users.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    static void retire() {
+        State& shared = state();
+        if (shared.users.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        Lock lock;
+        if (shared.users.load(std::memory_order_acquire) != 0) return;
+        shared.generation.fetch_add(1, std::memory_order_release);
+        for (Shelf* shelf = shared.shelves; shelf; shelf = shelf->nextShelf) {
+            while (shelf->slabs) {
+                void* slab = shelf->slabs;
+                shelf->slabs = *static_cast<void**>(slab);
+                ::operator delete(slab);
+            }
+            AllocationCounters::recordRelease(shelf->bytes);
+            shelf->spares = nullptr;
+            shelf->spareBlocks = 0;
+            shelf->nextSlab = FIRST_SLAB;
+            shelf->bytes = 0;
+        }
+    }
+};
+
+// Fixed-size allocator for objects of type T. Memory comes in slabs of
+// many blocks; freed blocks go on a free list and are handed out again
+// before a new slab is taken, so a workload that adds and removes at a
+// steady size stops calling the system allocator.
+//
+// Each thread keeps its own free list per type, so allocating and freeing
+// take no lock. A block freed on another thread just joins that thread's
+// list. Only running dry locks the shared shelf: spare blocks come from
+// there first, then a new slab. A thread that exits puts its free list on
+// the shelf for the others.
+template<typename T>
+class SlabPool {
+private:
+    union Block {
+        Block* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    Block* freeList;
+    size_t freeBlocks;
+    uint64_t generation;
+
+    SlabPool() : freeList(nullptr), freeBlocks(0), generation(SlabPools::generation()) {}
+
+    ~SlabPool() {
+        if (!freeList) return;
+        SlabPools::Lock lock;
+        if (generation != SlabPools::generation()) return;
+        SlabPools::Shelf& spare = shelf();
+        Block* last = freeList;
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = static_cast<Block*>(spare.spares);
+        spare.spares = freeList;
+        spare.spareBlocks += freeBlocks;
+        freeList = nullptr;
+        freeBlocks = 0;
+    }
+
+    static SlabPools::Shelf& shelf() {
+        static SlabPools::Shelf shared = {nullptr, nullptr, nullptr, 0, SlabPools::FIRST_SLAB, 0, false};
+        return shared;
+    }
+
+    // Forgets a free list whose slabs were given back
+    void refresh() {
+        const uint64_t current = SlabPools::generation();
+        if (generation == current) return;
+        freeList = nullptr;
+        freeBlocks = 0;
+        generation = current;
+    }
+
+    void push(Block* block) {
+        block->next = freeList;
+        freeList = block;
+        freeBlocks++;
+    }
+
+    // Takes up to n spare blocks, then a slab for the rest of them; with
+    // grow, a slab of the shelf's next size if no spare was left at all
+    void refill(size_t n, bool grow) {
+        SlabPools::Lock lock;
+        SlabPools::Shelf& spare = shelf();
+        SlabPools::list(spare);
+        if (grow && spare.spares) {
+            n = spare.spareBlocks < SlabPools::MAX_SLAB ? spare.spareBlocks : SlabPools::MAX_SLAB;
+        }
+        for (; n > 0 && spare.spares; n--) {
+            Block* block = static_cast<Block*>(spare.spares);
+            spare.spares = block->next;
+            spare.spareBlocks--;
+            push(block);
+        }
+        if (grow && n > 0) {
+            n = spare.nextSlab;
+            spare.nextSlab = n < SlabPools::MAX_SLAB / 2 ? n * 2 : SlabPools::MAX_SLAB;
+        }
+        if (n == 0) return;
+
+        const size_t size = (n + 1) * sizeof(Block);
+        Block* slab = static_cast<Block*>(::operator new(size));
+        AllocationCounters::record(size);
+        spare.bytes += size;
+        slab[0].next = static_cast<Block*>(spare.slabs);
+        spare.slabs = slab;
+        for (size_t i = n; i > 0; i--) {
+            push(&slab[i]);
+        }
+    }
+
+public:
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    static SlabPool& instance() {
+        static thread_local SlabPool pool;
+        return pool;
+    }
+
+    void* allocate() {
+        refresh();
+        if (!freeList) {
+            refill(1, true);
+        }
+        Block* block = freeList;
+        freeList = block->next;
+        freeBlocks--;
+        return block;
+    }
+
+    void release(void* memory) {
+        refresh();
+        push(static_cast<Block*>(memory));
+    }
+
+    // Makes sure the next n allocations on this thread need no new slab
+    void reserve(size_t n) {
+        refresh();
+        if (freeBlocks < n) {
+            refill(n - freeBlocks, false);
+        }
+    }
+
+    size_t available() const {
+        return generation == SlabPools::generation() ? freeBlocks : 0;
+    }
+
+    // Bytes each object takes in a slab, padding included
+    static size_t blockSize() {
+        return sizeof(Block);
+    }
+
+    template<typename... Args>
+    T* create(Args&&... args) {
+        void* memory = allocate();
+        try {
+            return new (memory) T(std::forward<Args>(args)...);
+        } catch (...) {
+            release(memory);
+            throw;
+        }
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        release(object);
+    }
+};
+
+#endif // DS_WET1_SPRING2024_SLABPOOL_H
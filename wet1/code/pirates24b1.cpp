@@ -2,6 +2,24 @@
 
 Ocean::Ocean() = default;
 
+Ocean::Ocean(int expectedShips, int expectedPirates) {
+    const size_t ships = std::max(expectedShips, 0);
+    const size_t pirates = std::max(expectedPirates, 0);
+
+    // Every pirate has one entry in each pirate index. Reservations add up
+    // when indexes share a type.
+    Ocean_store.reserve(pirates);
+    OceanShipIndex::reserveNodes(ships);
+    OceanPirateIndex::reserveNodes(pirates);
+    ShipPirateIndex::reserveNodes(pirates);
+    OrderIndex::reserveNodes(pirates);
+    TreasureRankIndex::reserveNodes(2 * pirates + 2);  // Two rankings; a move inserts before it removes
+    Stale_ships.reserve(ships);
+    Floating_ships.reserve(ships);
+    Ocean_alliances.reserve(ships);
+    Stale_alliances.reserve(ships);
+}
+
 Ocean::~Ocean() = default;
 
 StatusType Ocean::add_ship(int shipId, int cannons) {
@@ -14,8 +32,11 @@ StatusType Ocean::add_ship(int shipId, int cannons) {
     }
 
     try {
+        thaw();
         auto newShip = std::make_shared<Ship>(shipId, cannons);
+        newShip->allianceSlot = Ocean_alliances.makeSet(shipId, cannons);
         Ocean_ships.insert(shipId, newShip);
+        publish(OceanChange::ADD_SHIP, shipId, cannons);
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
     }
@@ -37,7 +58,10 @@ StatusType Ocean::remove_ship(int shipId) {
         if ((*shipNode)->numPirates > 0) {
             return StatusType::FAILURE;
         }
+        thaw();
+        Ocean_alliances.removeShip((*shipNode)->allianceSlot, (*shipNode)->cannons);
         Ocean_ships.remove(shipId);
+        publish(OceanChange::REMOVE_SHIP, shipId);
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
     }
@@ -60,29 +84,24 @@ StatusType Ocean::add_pirate(int pirateId, int shipId, int treasure) {
     }
 
     try {
-        auto currentShip = *shipNode;
+        thaw();
+        const auto& currentShip = *shipNode;
         currentShip->orderCounter++;
         const int order = currentShip->orderCounter;
         
-        auto newPirate = std::make_shared<Pirate>(pirateId, shipId, treasure, order);
+        const int adjustedTreasure = treasure - shipBonus(*currentShip);
+        const int ranked = rankedTreasure(*currentShip, treasure);
+        const PirateHandle newPirate = Ocean_store.add(pirateId, shipId, order, ranked);
         Ocean_pirates.insert(pirateId, newPirate);
+        Ocean_treasures.insert(std::make_pair(ranked, pirateId), newPirate);
+        currentShip->Ship_treasures.insert(std::make_pair(ranked, pirateId), newPirate);
         currentShip->Ship_pirates.insert(pirateId, newPirate);
-        currentShip->pirates_Order.insert(order, newPirate);
-        
-        const int adjustedTreasure = treasure - currentShip->extraTreasure;
-        newPirate->treasure = adjustedTreasure;
-        
-        auto treasureNode = currentShip->pirates_Treasure.find(adjustedTreasure);
-        if (!treasureNode) {
-            auto newTreasureTree = std::make_shared<AVL<int, std::shared_ptr<Pirate>>>();
-            newTreasureTree->insert(pirateId, newPirate);
-            currentShip->pirates_Treasure.insert(adjustedTreasure, newTreasureTree);
-        } else {
-            (*treasureNode)->insert(pirateId, newPirate);
-        }
+        currentShip->pirates_Order.try_emplace(order, CrewEntry{newPirate, pirateId, adjustedTreasure});
 
         currentShip->numPirates++;
         currentShip->updateRichestPirate();
+        Ocean_alliances.addPirates(Ocean_alliances.find(currentShip->allianceSlot), 1);
+        publish(OceanChange::ADD_PIRATE, pirateId, shipId, treasure, order, adjustedTreasure);
         
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
@@ -101,31 +120,29 @@ StatusType Ocean::remove_pirate(int pirateId) {
         return StatusType::FAILURE;
     }
    
-    auto currentPirate = *pirateNode;
-    auto shipNode = Ocean_ships.find(currentPirate->shipId);
+    const PirateHandle currentPirate = *pirateNode;
+    auto shipNode = Ocean_ships.find(Ocean_store.shipId(currentPirate));
     if (!shipNode) {
         return StatusType::FAILURE;
     }
     
-    auto currentShip = *shipNode;
+    const auto& currentShip = *shipNode;
     
     try {
+        thaw();
+        const int order = Ocean_store.orderInShip(currentPirate);
         Ocean_pirates.remove(pirateId);
         currentShip->Ship_pirates.remove(pirateId);
-        currentShip->pirates_Order.remove(currentPirate->orderInShip);
-        
-        const int adjustedTreasure = currentPirate->treasure;
-        auto treasureNode = currentShip->pirates_Treasure.find(adjustedTreasure);
-        if (treasureNode) {
-            auto treasureTree = *treasureNode;
-            treasureTree->remove(pirateId);
-            if (treasureTree->isEmpty()) {
-                currentShip->pirates_Treasure.remove(adjustedTreasure);
-            }
-        }
+        currentShip->pirates_Order.remove(order);
+        const std::pair<int, int> ranking(Ocean_store.recordedTreasure(currentPirate), pirateId);
+        Ocean_treasures.remove(ranking);
+        currentShip->Ship_treasures.remove(ranking);
+        Ocean_store.remove(currentPirate);
 
         currentShip->numPirates--;
         currentShip->updateRichestPirate();
+        Ocean_alliances.addPirates(Ocean_alliances.find(currentShip->allianceSlot), -1);
+        publish(OceanChange::REMOVE_PIRATE, pirateId, currentShip->id, order);
 
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
@@ -146,61 +163,53 @@ StatusType Ocean::treason(int sourceShipId, int destShipId) {
         return StatusType::FAILURE;
     }
 
-    auto sourceShip = *sourceShipNode;
-    auto destShip = *destShipNode;
+    const auto& sourceShip = *sourceShipNode;
+    const auto& destShip = *destShipNode;
 
     if (sourceShip->numPirates == 0) {
         return StatusType::FAILURE;
     }
 
     try {
+        thaw();
         auto firstPirateNode = sourceShip->pirates_Order.getSmallest();
-        if (!firstPirateNode || !firstPirateNode->value) {
+        if (!firstPirateNode) {
             return StatusType::FAILURE;
         }
         
-        auto pirateToMove = *(firstPirateNode->value);
-        const int pirateId = pirateToMove->id;
-        const int oldOrder = pirateToMove->orderInShip;
-        const int originalTreasure = pirateToMove->getTreasure(sourceShip);
+        const int oldOrder = firstPirateNode->key;
+        CrewEntry movingEntry = CrewEntry();
+        sourceShip->pirates_Order.get(oldOrder, movingEntry);
+        const PirateHandle pirateToMove = movingEntry.pirate;
+        const int pirateId = movingEntry.id;
+        const int originalTreasure = movingEntry.treasure + shipBonus(*sourceShip);
 
         // Remove from source ship
         sourceShip->pirates_Order.remove(oldOrder);
         sourceShip->Ship_pirates.remove(pirateId);
-
-        auto treasureNode = sourceShip->pirates_Treasure.find(pirateToMove->treasure);
-        if (treasureNode) {
-            auto treasureTree = *treasureNode;
-            treasureTree->remove(pirateId);
-            if (treasureTree->isEmpty()) {
-                sourceShip->pirates_Treasure.remove(pirateToMove->treasure);
-            }
-        }
         sourceShip->numPirates--;
 
+        // Ranked under the destination's bonus from now on; the source's
+        // entry may have been stale or floating
+        recordTreasure(*sourceShip, *destShip, pirateToMove, pirateId,
+                       rankedTreasure(*destShip, originalTreasure));
+
         // Add to destination ship
-        pirateToMove->shipId = destShipId;
+        Ocean_store.shipId(pirateToMove) = destShipId;
         destShip->orderCounter++;
-        pirateToMove->orderInShip = destShip->orderCounter;
+        Ocean_store.orderInShip(pirateToMove) = destShip->orderCounter;
 
-        destShip->pirates_Order.insert(pirateToMove->orderInShip, pirateToMove);
+        movingEntry.treasure = originalTreasure - shipBonus(*destShip);
+        destShip->pirates_Order.try_emplace(destShip->orderCounter, movingEntry);
         destShip->Ship_pirates.insert(pirateId, pirateToMove);
-
-        const int adjustedTreasure = originalTreasure - destShip->extraTreasure;
-        pirateToMove->treasure = adjustedTreasure;
-        
-        treasureNode = destShip->pirates_Treasure.find(adjustedTreasure);
-        if (!treasureNode) {
-            auto newTreasureTree = std::make_shared<AVL<int, std::shared_ptr<Pirate>>>();
-            newTreasureTree->insert(pirateId, pirateToMove);
-            destShip->pirates_Treasure.insert(adjustedTreasure, newTreasureTree);
-        } else {
-            (*treasureNode)->insert(pirateId, pirateToMove);
-        }
         
         destShip->numPirates++;
         sourceShip->updateRichestPirate();
         destShip->updateRichestPirate();
+        Ocean_alliances.addPirates(Ocean_alliances.find(sourceShip->allianceSlot), -1);
+        Ocean_alliances.addPirates(Ocean_alliances.find(destShip->allianceSlot), 1);
+        publish(OceanChange::TREASON, sourceShipId, destShipId, pirateId,
+                destShip->orderCounter, movingEntry.treasure);
         
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
@@ -223,40 +232,27 @@ StatusType Ocean::update_pirate_treasure(int pirateId, int change) {
         return StatusType::FAILURE;
     }
 
-    auto currentPirate = *pirateNode;
-    auto shipNode = Ocean_ships.find(currentPirate->shipId);
+    const PirateHandle currentPirate = *pirateNode;
+    auto shipNode = Ocean_ships.find(Ocean_store.shipId(currentPirate));
     if (!shipNode) {
         return StatusType::FAILURE;
     }
     
-    auto currentShip = *shipNode;
+    const auto& currentShip = *shipNode;
 
     try {
-        // Remove from old treasure tree
-        const int oldTreasure = currentPirate->treasure;
-        auto treasureNode = currentShip->pirates_Treasure.find(oldTreasure);
-        if (treasureNode) {
-            auto treasureTree = *treasureNode;
-            treasureTree->remove(pirateId);
-            if (treasureTree->isEmpty()) {
-                currentShip->pirates_Treasure.remove(oldTreasure);
-            }
-        }
-        
-        // Update treasure and add to new tree
-        currentPirate->treasure += change;
-        const int newTreasure = currentPirate->treasure;
-        
-        auto newTreasureNode = currentShip->pirates_Treasure.find(newTreasure);
-        if (!newTreasureNode) {
-            auto newTreasureTree = std::make_shared<AVL<int, std::shared_ptr<Pirate>>>();
-            newTreasureTree->insert(pirateId, currentPirate);
-            currentShip->pirates_Treasure.insert(newTreasure, newTreasureTree);
-        } else {
-            (*newTreasureNode)->insert(pirateId, currentPirate);
-        }
-        
+        thaw();
+        // A one-pirate range, so the summaries above it are kept right
+        const int order = Ocean_store.orderInShip(currentPirate);
+        currentShip->pirates_Order.applyRange(order, order, change);
         currentShip->updateRichestPirate();
+
+        CrewEntry entry = CrewEntry();
+        currentShip->pirates_Order.get(order, entry);
+        const int newTreasure = entry.treasure + shipBonus(*currentShip);
+        recordTreasure(*currentShip, *currentShip, currentPirate, pirateId,
+                       entry.treasure + currentShip->rankedBonus);
+        publish(OceanChange::UPDATE_PIRATE_TREASURE, pirateId, change, newTreasure);
         
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
@@ -271,18 +267,29 @@ output_t<int> Ocean::get_treasure(int pirateId) {
     }
 
     try {
+        if (frozen) {
+            const int* treasure = Frozen_treasures.find(pirateId);
+            if (!treasure) {
+                return StatusType::FAILURE;
+            }
+            return *treasure;
+        }
+
         auto pirateNode = Ocean_pirates.find(pirateId);
         if (!pirateNode) {
             return StatusType::FAILURE;
         }
        
-        auto currentPirate = *pirateNode;
-        auto shipNode = Ocean_ships.find(currentPirate->shipId);
+        const PirateHandle currentPirate = *pirateNode;
+        auto shipNode = Ocean_ships.find(Ocean_store.shipId(currentPirate));
         if (!shipNode) {
             return StatusType::FAILURE;
         }
         
-        return currentPirate->getTreasure(*shipNode);
+        const auto& currentShip = *shipNode;
+        CrewEntry entry = CrewEntry();
+        currentShip->pirates_Order.get(Ocean_store.orderInShip(currentPirate), entry);
+        return entry.treasure + shipBonus(*currentShip);
         
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
@@ -295,6 +302,14 @@ output_t<int> Ocean::get_cannons(int shipId) {
     }
 
     try {
+        if (frozen) {
+            const FrozenShip* ship = Frozen_ships.find(shipId);
+            if (!ship) {
+                return StatusType::FAILURE;
+            }
+            return ship->cannons;
+        }
+
         auto shipNode = Ocean_ships.find(shipId);
         if (!shipNode) {
             return StatusType::FAILURE;
@@ -313,12 +328,20 @@ output_t<int> Ocean::get_richest_pirate(int shipId) {
     }
 
     try {
+        if (frozen) {
+            const FrozenShip* ship = Frozen_ships.find(shipId);
+            if (!ship || ship->numPirates <= 0) {
+                return StatusType::FAILURE;
+            }
+            return ship->richestPirateId;
+        }
+
         auto shipNode = Ocean_ships.find(shipId);
         if (!shipNode) {
             return StatusType::FAILURE;
         }
         
-        auto currentShip = *shipNode;
+        const auto& currentShip = *shipNode;
         if (currentShip->numPirates <= 0) {
             return StatusType::FAILURE;
         }
@@ -343,8 +366,8 @@ StatusType Ocean::ships_battle(int shipId1, int shipId2) {
             return StatusType::FAILURE;
         }
 
-        auto ship1 = *ship1Node;
-        auto ship2 = *ship2Node;
+        const auto& ship1 = *ship1Node;
+        const auto& ship2 = *ship2Node;
 
         const int power1 = std::min(ship1->cannons, ship1->numPirates);
         const int power2 = std::min(ship2->cannons, ship2->numPirates);
@@ -353,17 +376,708 @@ StatusType Ocean::ships_battle(int shipId1, int shipId2) {
             return StatusType::SUCCESS; // Draw
         }
 
-        if (power1 > power2) {
-            ship1->extraTreasure += ship2->numPirates;
-            ship2->extraTreasure -= ship1->numPirates;
-        } else {
-            ship2->extraTreasure += ship1->numPirates;
-            ship1->extraTreasure -= ship2->numPirates;
+        thaw();
+        markFloating(*ship1);
+        markFloating(*ship2);
+
+        const int change1 = power1 > power2 ? ship2->numPirates : -ship2->numPirates;
+        const int change2 = power1 > power2 ? -ship1->numPirates : ship1->numPirates;
+        ship1->extraTreasure += change1;
+        ship2->extraTreasure += change2;
+        publish(OceanChange::SHIPS_BATTLE, shipId1, shipId2, change1, change2);
+
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+
+    return StatusType::SUCCESS;
+}
+
+// Fewer battles than this per thread are not worth a thread
+static const size_t BATTLE_GRAIN = 4096;
+
+// Runs work(first, last) over [0, count) in up to threads slices, each
+// but the first on a thread of its own. A slice that cannot get a thread
+// runs in the caller instead.
+template<typename Work>
+static void parallelFor(size_t count, unsigned threads, Work work) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    const size_t slices = std::min<size_t>(std::max(threads, 1u), count / BATTLE_GRAIN);
+    if (slices <= 1) {
+        work(0, count);
+        return;
+    }
+
+    std::vector<std::future<void>> forked;
+    try {
+        forked.reserve(slices - 1);
+        for (size_t i = 1; i < slices; i++) {
+            const size_t first = count * i / slices;
+            const size_t last = count * (i + 1) / slices;
+            forked.push_back(std::async(std::launch::async, [=]() { work(first, last); }));
+        }
+    } catch (const std::exception&) {
+        for (size_t i = forked.size() + 1; i < slices; i++) {
+            work(count * i / slices, count * (i + 1) / slices);
+        }
+    }
+    work(0, count / slices);
+    for (auto& slice : forked) {
+        slice.get();
+    }
+}
+
+void Ocean::decideBattles(const std::vector<std::pair<int, int>>& pairs, size_t first, size_t last,
+                          std::vector<Battle>& battles, std::vector<StatusType>& results) const {
+    const int GROUP = 16;
+    int shipIds[2 * GROUP];
+    std::shared_ptr<Ship>* ships[2 * GROUP];
+
+    for (size_t base = first; base < last; base += GROUP) {
+        const int size = static_cast<int>(std::min<size_t>(GROUP, last - base));
+        for (int i = 0; i < size; i++) {
+            shipIds[2 * i] = pairs[base + i].first;
+            shipIds[2 * i + 1] = pairs[base + i].second;
+        }
+        Ocean_ships.find_batch(shipIds, 2 * size, ships);
+
+        for (int i = 0; i < size; i++) {
+            Battle& battle = battles[base + i];
+            battle = {nullptr, nullptr, 0, 0};
+            const int shipId1 = shipIds[2 * i];
+            const int shipId2 = shipIds[2 * i + 1];
+            if (shipId1 <= 0 || shipId2 <= 0 || shipId1 == shipId2) {
+                results[base + i] = StatusType::INVALID_INPUT;
+                continue;
+            }
+            if (!ships[2 * i] || !ships[2 * i + 1]) {
+                results[base + i] = StatusType::FAILURE;
+                continue;
+            }
+
+            Ship* ship1 = ships[2 * i]->get();
+            Ship* ship2 = ships[2 * i + 1]->get();
+            const int power1 = std::min(ship1->cannons, ship1->numPirates);
+            const int power2 = std::min(ship2->cannons, ship2->numPirates);
+            results[base + i] = StatusType::SUCCESS;
+            if (power1 != power2) {
+                battle = {ship1, ship2,
+                          power1 > power2 ? ship2->numPirates : -ship2->numPirates,
+                          power1 > power2 ? -ship1->numPirates : ship1->numPirates};
+            }
+        }
+    }
+}
+
+StatusType Ocean::battle_round(const std::vector<std::pair<int, int>>& pairs,
+                               std::vector<StatusType>& results, unsigned threads) {
+    const size_t count = pairs.size();
+    std::vector<Battle> battles;
+    std::vector<int> groups;
+    std::vector<size_t> groupStart;  // Then each group's end, once sorted
+    std::vector<size_t> byGroup;     // Decisive battles sorted by group
+
+    try {
+        results.assign(count, StatusType::SUCCESS);
+        battles.resize(count);
+        groups.assign(count, 0);
+        groupStart.assign(count + 2, 0);
+        parallelFor(count, threads, [&](size_t first, size_t last) {
+            decideBattles(pairs, first, last, battles, results);
+        });
+
+        size_t decisive = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (battles[i].ship1) {
+                decisive++;
+            }
+        }
+        byGroup.resize(decisive);
+        Floating_ships.reserve(Floating_ships.size() + 2 * decisive);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+
+    // Each battle goes in the group after the last one either ship is in,
+    // so a group has every ship at most once
+    int groupCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        Battle& battle = battles[i];
+        if (!battle.ship1) {
+            continue;
+        }
+        const int group = std::max(battle.ship1->battleGroup, battle.ship2->battleGroup) + 1;
+        battle.ship1->battleGroup = group;
+        battle.ship2->battleGroup = group;
+        groups[i] = group;
+        groupCount = std::max(groupCount, group);
+    }
+    if (groupCount == 0) {
+        return StatusType::SUCCESS;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (battles[i].ship1) {
+            battles[i].ship1->battleGroup = 0;
+            battles[i].ship2->battleGroup = 0;
+            groupStart[groups[i] + 1]++;
+        }
+    }
+    for (int group = 1; group <= groupCount; group++) {
+        groupStart[group + 1] += groupStart[group];
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (battles[i].ship1) {
+            byGroup[groupStart[groups[i]]++] = i;
+        }
+    }
+
+    thaw();
+    size_t begin = 0;
+    for (int group = 1; group <= groupCount; group++) {
+        const size_t end = groupStart[group];
+        parallelFor(end - begin, threads, [&](size_t first, size_t last) {
+            for (size_t k = begin + first; k < begin + last; k++) {
+                const Battle& battle = battles[byGroup[k]];
+                battle.ship1->extraTreasure += battle.change1;
+                battle.ship2->extraTreasure += battle.change2;
+            }
+        });
+        begin = end;
+    }
+
+    // Floating marks and the change feed stay in order, on this thread
+    for (size_t i = 0; i < count; i++) {
+        const Battle& battle = battles[i];
+        if (battle.ship1) {
+            markFloating(*battle.ship1);
+            markFloating(*battle.ship2);
+            publish(OceanChange::SHIPS_BATTLE, pairs[i].first, pairs[i].second, battle.change1, battle.change2);
+        }
+    }
+    return StatusType::SUCCESS;
+}
+
+StatusType Ocean::add_treasure_range(int shipId, int first, int last, int amount) {
+    if (shipId <= 0 || first < 1 || last < first) {
+        return StatusType::INVALID_INPUT;
+    }
+
+    auto shipNode = Ocean_ships.find(shipId);
+    if (!shipNode) {
+        return StatusType::FAILURE;
+    }
+
+    const auto& currentShip = *shipNode;
+    if (last > currentShip->numPirates) {
+        return StatusType::FAILURE;
+    }
+
+    try {
+        if (amount == 0) {
+            return StatusType::SUCCESS;
+        }
+        thaw();
+        const int firstOrder = currentShip->pirates_Order.select(first - 1)->key;
+        const int lastOrder = currentShip->pirates_Order.select(last - 1)->key;
+        markStale(*currentShip);
+        currentShip->pirates_Order.applyRange(firstOrder, lastOrder, amount);
+        currentShip->updateRichestPirate();
+        publish(OceanChange::ADD_TREASURE_RANGE, shipId, first, last, amount);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+
+    return StatusType::SUCCESS;
+}
+
+output_t<long long> Ocean::sum_treasure_range(int shipId, int first, int last) {
+    if (shipId <= 0 || first < 1 || last < first) {
+        return StatusType::INVALID_INPUT;
+    }
+
+    try {
+        auto shipNode = Ocean_ships.find(shipId);
+        if (!shipNode) {
+            return StatusType::FAILURE;
+        }
+
+        const auto& currentShip = *shipNode;
+        if (last > currentShip->numPirates) {
+            return StatusType::FAILURE;
+        }
+
+        const int firstOrder = currentShip->pirates_Order.select(first - 1)->key;
+        const int lastOrder = currentShip->pirates_Order.select(last - 1)->key;
+        const long long adjustedTotal = currentShip->pirates_Order.summarizeRange(firstOrder, lastOrder).total;
+        const long long count = last - first + 1;
+        return adjustedTotal + count * shipBonus(*currentShip);
+
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+}
+
+StatusType Ocean::merge_ships(int sourceShipId, int destShipId) {
+    if (sourceShipId <= 0 || destShipId <= 0 || sourceShipId == destShipId) {
+        return StatusType::INVALID_INPUT;
+    }
+
+    auto sourceShipNode = Ocean_ships.find(sourceShipId);
+    auto destShipNode = Ocean_ships.find(destShipId);
+    if (!sourceShipNode || !destShipNode) {
+        return StatusType::FAILURE;
+    }
+
+    const auto& sourceShip = *sourceShipNode;
+    const auto& destShip = *destShipNode;
+
+    try {
+        if (sourceShip->numPirates == 0) {
+            return StatusType::SUCCESS;
+        }
+        thaw();
+
+        // The crew is renumbered after the destination's, in arrival order,
+        // just as treason would, and treasure is rebased onto its bonus.
+        int nextOrder = destShip->orderCounter;
+        sourceShip->pirates_Order.remapKeys([&](int, CrewEntry& entry) {
+            nextOrder++;
+            Ocean_store.shipId(entry.pirate) = destShipId;
+            Ocean_store.orderInShip(entry.pirate) = nextOrder;
+            return nextOrder;
+        });
+        const int rebase = shipBonus(*sourceShip) - shipBonus(*destShip);
+        sourceShip->pirates_Order.applyAll(rebase);
+
+        // The crew keeps its entries in Ocean_treasures. They stay right
+        // if both bonuses moved as far from where each crew was ranked;
+        // an empty destination just takes over the source's ranking.
+        const int sourceDrift = shipBonus(*sourceShip) - sourceShip->rankedBonus;
+        const int destDrift = shipBonus(*destShip) - destShip->rankedBonus;
+        if (destShip->numPirates == 0) {
+            destShip->rankedBonus = shipBonus(*destShip) - sourceDrift;
+        }
+        const bool rankedApart = destShip->numPirates > 0 && sourceDrift != destDrift;
+
+        destShip->pirates_Order.concat(std::move(sourceShip->pirates_Order));
+        destShip->Ship_pirates.unionWith(std::move(sourceShip->Ship_pirates));
+        destShip->Ship_treasures.unionWith(std::move(sourceShip->Ship_treasures));
+
+        destShip->orderCounter = nextOrder;
+        const int moved = sourceShip->numPirates;
+        Ocean_alliances.addPirates(Ocean_alliances.find(sourceShip->allianceSlot), -moved);
+        Ocean_alliances.addPirates(Ocean_alliances.find(destShip->allianceSlot), moved);
+        destShip->numPirates += moved;
+        sourceShip->numPirates = 0;
+        // Recorded treasures the source still owes a range bonus or an
+        // alliance battle go stale with their pirates, as do crews ranked
+        // under bonuses that moved apart
+        if (sourceShip->treasuresStale || Ocean_alliances.isStale(Ocean_alliances.find(sourceShip->allianceSlot)) ||
+            rankedApart) {
+            markStale(*destShip);
+        }
+        if (sourceDrift != 0) {
+            markFloating(*destShip);
         }
+        sourceShip->updateRichestPirate();
+        destShip->updateRichestPirate();
+        publish(OceanChange::MERGE_SHIPS, sourceShipId, destShipId, moved, rebase);
 
     } catch (const std::bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
     }
 
     return StatusType::SUCCESS;
-}
\ No newline at end of file
+}
+
+output_t<int> Ocean::treasure_percentile(int percentile) {
+    if (percentile < 0 || percentile > 100) {
+        return StatusType::INVALID_INPUT;
+    }
+
+    try {
+        if (Ocean_treasures.isEmpty()) {
+            return StatusType::FAILURE;
+        }
+        refreshDistribution();
+
+        // Nearest rank: the smallest treasure with at least percentile% of
+        // the pirates at or below it
+        const long long pirates = Ocean_treasures.size();
+        const long long rank = (percentile * pirates + 99) / 100;
+        const int index = static_cast<int>(std::max(rank, 1LL) - 1);
+        if (Floating_ships.empty()) {
+            return Ocean_treasures.select(index)->key.first;
+        }
+
+        // Floating crews are ranked off their treasure, so search for the
+        // smallest treasure with more than index pirates at or below it
+        long long low = INT_MIN;
+        long long high = INT_MAX;
+        while (low < high) {
+            const long long middle = low + (high - low) / 2;
+            if (countBelow(middle + 1) > index) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        return static_cast<int>(low);
+
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+}
+
+StatusType Ocean::treasure_histogram(const std::vector<int>& bounds, std::vector<int>& counts) {
+    for (size_t i = 1; i < bounds.size(); i++) {
+        if (bounds[i] <= bounds[i - 1]) {
+            return StatusType::INVALID_INPUT;
+        }
+    }
+
+    try {
+        refreshDistribution();
+
+        counts.assign(bounds.size() + 1, 0);
+        int below = 0;
+        for (size_t i = 0; i < bounds.size(); i++) {
+            const int belowBound = static_cast<int>(countBelow(bounds[i]));
+            counts[i] = belowBound - below;
+            below = belowBound;
+        }
+        counts[bounds.size()] = Ocean_treasures.size() - below;
+
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+
+    return StatusType::SUCCESS;
+}
+
+// Floating ships with at most this many pirates are re-recorded by the
+// next query rather than counted again by every query: a percentile spends
+// 32 steps of O(log n) on each floating ship anyway
+static const int SETTLE_CREW = 32;
+
+// Entries of index holding less than bound treasure. IDs are positive, so
+// (bound, 0) sorts before every pirate holding exactly bound.
+static long long rankBelow(const TreasureRankIndex& index, long long bound) {
+    if (bound > INT_MAX) {
+        return index.size();
+    }
+    if (bound < INT_MIN) {
+        return 0;
+    }
+    return index.rank(std::make_pair(static_cast<int>(bound), 0));
+}
+
+int Ocean::rankedTreasure(Ship& ship, int treasure) {
+    // An empty ship starts ranking its crew under its current bonus
+    if (ship.numPirates == 0) {
+        ship.rankedBonus = shipBonus(ship);
+    }
+    return treasure - shipBonus(ship) + ship.rankedBonus;
+}
+
+void Ocean::recordTreasure(Ship& from, Ship& to, PirateHandle pirate, int pirateId, int treasure) {
+    int& recorded = Ocean_store.recordedTreasure(pirate);
+    if (&from == &to && recorded == treasure) {
+        return;
+    }
+    // Insert first: if it throws, the old entries are still in place
+    const std::pair<int, int> oldRanking(recorded, pirateId);
+    const std::pair<int, int> newRanking(treasure, pirateId);
+    to.Ship_treasures.insert(newRanking, pirate);
+    if (recorded != treasure) {
+        Ocean_treasures.insert(newRanking, pirate);
+        Ocean_treasures.remove(oldRanking);
+    }
+    from.Ship_treasures.remove(oldRanking);
+    recorded = treasure;
+}
+
+void Ocean::markStale(Ship& ship) {
+    if (ship.treasuresStale || ship.numPirates == 0) {
+        return;
+    }
+    Stale_ships.push_back(ship.id);
+    ship.treasuresStale = true;
+}
+
+void Ocean::markFloating(Ship& ship) {
+    if (ship.floating || ship.numPirates == 0) {
+        return;
+    }
+    Floating_ships.push_back(ship.id);
+    ship.floating = true;
+}
+
+long long Ocean::countBelow(long long bound) {
+    long long count = rankBelow(Ocean_treasures, bound);
+    for (const int shipId : Floating_ships) {
+        Ship& ship = **Ocean_ships.find(shipId);
+        const long long drift = shipBonus(ship) - ship.rankedBonus;
+        count += rankBelow(ship.Ship_treasures, bound - drift) - rankBelow(ship.Ship_treasures, bound);
+    }
+    return count;
+}
+
+void Ocean::refreshDistribution() {
+    // Alliances first become their ships; walking one again is harmless,
+    // so a failure halfway leaves it on the list
+    while (!Stale_alliances.empty()) {
+        const int first = Stale_alliances.back();
+        int slot = first;
+        do {
+            auto shipNode = Ocean_ships.find(Ocean_alliances.shipId(slot));
+            if (shipNode) {
+                markStale(**shipNode);
+            }
+            slot = Ocean_alliances.nextSlot(slot);
+        } while (slot != first);
+        Ocean_alliances.setStale(first, false);
+        Stale_alliances.pop_back();
+    }
+
+    // Floating ships drop off once re-recorded, emptied, removed or back
+    // at their ranked bonus, and small crews are re-recorded below. A
+    // removed ship's ID may be on the list twice once reused; clearing
+    // the flag on the first keeps the second from counting.
+    Stale_ships.reserve(Stale_ships.size() + Floating_ships.size());
+    size_t kept = 0;
+    for (const int shipId : Floating_ships) {
+        auto shipNode = Ocean_ships.find(shipId);
+        if (!shipNode || !(*shipNode)->floating) {
+            continue;
+        }
+        Ship& ship = **shipNode;
+        ship.floating = false;
+        if (ship.treasuresStale || ship.numPirates == 0 || shipBonus(ship) == ship.rankedBonus) {
+            continue;
+        }
+        if (ship.numPirates <= SETTLE_CREW) {
+            markStale(ship);
+            continue;
+        }
+        Floating_ships[kept++] = shipId;
+    }
+    Floating_ships.resize(kept);
+    for (const int shipId : Floating_ships) {
+        (*Ocean_ships.find(shipId))->floating = true;
+    }
+
+    // A ship leaves the list only once all its pirates are recorded, so a
+    // failed insert just leaves the rest for the next query
+    while (!Stale_ships.empty()) {
+        auto shipNode = Ocean_ships.find(Stale_ships.back());
+        if (shipNode) {
+            const auto& ship = *shipNode;
+            const int bonus = shipBonus(*ship);
+            ship->pirates_Order.forEach([&](int, const CrewEntry& entry) {
+                recordTreasure(*ship, *ship, entry.pirate, entry.id, entry.treasure + bonus);
+            });
+            ship->rankedBonus = bonus;
+            ship->treasuresStale = false;
+        }
+        Stale_ships.pop_back();
+    }
+}
+
+int Ocean::shipBonus(const Ship& ship) {
+    int allianceBonus;
+    Ocean_alliances.find(ship.allianceSlot, allianceBonus);
+    return ship.extraTreasure + allianceBonus;
+}
+
+void Ocean::markAllianceStale(int root) {
+    if (!Ocean_alliances.isStale(root)) {
+        Stale_alliances.push_back(root);
+        Ocean_alliances.setStale(root, true);
+    }
+}
+
+StatusType Ocean::form_alliance(int shipId1, int shipId2) {
+    if (shipId1 <= 0 || shipId2 <= 0 || shipId1 == shipId2) {
+        return StatusType::INVALID_INPUT;
+    }
+
+    auto ship1Node = Ocean_ships.find(shipId1);
+    auto ship2Node = Ocean_ships.find(shipId2);
+    if (!ship1Node || !ship2Node) {
+        return StatusType::FAILURE;
+    }
+
+    const int root1 = Ocean_alliances.find((*ship1Node)->allianceSlot);
+    const int root2 = Ocean_alliances.find((*ship2Node)->allianceSlot);
+    if (root1 == root2) {
+        return StatusType::FAILURE;
+    }
+
+    // Every bonus stays as it was, so nothing is frozen or ranked wrong.
+    // If either side is stale both are marked, so that whichever root the
+    // union keeps still says so; walking the union twice is harmless.
+    try {
+        if (Ocean_alliances.isStale(root1) || Ocean_alliances.isStale(root2)) {
+            markAllianceStale(root1);
+            markAllianceStale(root2);
+        }
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    Ocean_alliances.link(root1, root2);
+    publish(OceanChange::FORM_ALLIANCE, shipId1, shipId2);
+    return StatusType::SUCCESS;
+}
+
+StatusType Ocean::alliance_battle(int shipId1, int shipId2) {
+    if (shipId1 <= 0 || shipId2 <= 0 || shipId1 == shipId2) {
+        return StatusType::INVALID_INPUT;
+    }
+
+    auto ship1Node = Ocean_ships.find(shipId1);
+    auto ship2Node = Ocean_ships.find(shipId2);
+    if (!ship1Node || !ship2Node) {
+        return StatusType::FAILURE;
+    }
+
+    const int root1 = Ocean_alliances.find((*ship1Node)->allianceSlot);
+    const int root2 = Ocean_alliances.find((*ship2Node)->allianceSlot);
+    if (root1 == root2) {
+        return StatusType::FAILURE;
+    }
+
+    const int pirates1 = Ocean_alliances.pirates(root1);
+    const int pirates2 = Ocean_alliances.pirates(root2);
+    const int power1 = std::min(Ocean_alliances.cannons(root1), pirates1);
+    const int power2 = std::min(Ocean_alliances.cannons(root2), pirates2);
+    if (power1 == power2) {
+        return StatusType::SUCCESS; // Draw
+    }
+
+    try {
+        thaw();
+        markAllianceStale(root1);
+        markAllianceStale(root2);
+        const int change1 = power1 > power2 ? pirates2 : -pirates2;
+        const int change2 = power1 > power2 ? -pirates1 : pirates1;
+        Ocean_alliances.addBonus(root1, change1);
+        Ocean_alliances.addBonus(root2, change2);
+        publish(OceanChange::ALLIANCE_BATTLE, shipId1, shipId2, change1, change2);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+
+    return StatusType::SUCCESS;
+}
+
+void Ocean::publish(int kind, int field0, int field1, int field2, int field3, int field4) {
+    Last_change = {kind, {field0, field1, field2, field3, field4}};
+    if (Ocean_feed) {
+        Ocean_feed->publish(Last_change);
+    }
+}
+
+void Ocean::attachFeed(OceanFeed* feed) {
+    Ocean_feed = feed;
+}
+
+StatusType Ocean::applyChange(const OceanChange& change) {
+    const int32_t* f = change.fields;
+    Last_change.kind = OceanChange::NONE;
+
+    StatusType status;
+    switch (change.kind) {
+        case OceanChange::ADD_SHIP:               status = add_ship(f[0], f[1]); break;
+        case OceanChange::REMOVE_SHIP:            status = remove_ship(f[0]); break;
+        case OceanChange::ADD_PIRATE:             status = add_pirate(f[0], f[1], f[2]); break;
+        case OceanChange::REMOVE_PIRATE:          status = remove_pirate(f[0]); break;
+        case OceanChange::TREASON:                status = treason(f[0], f[1]); break;
+        case OceanChange::UPDATE_PIRATE_TREASURE: status = update_pirate_treasure(f[0], f[1]); break;
+        case OceanChange::SHIPS_BATTLE:           status = ships_battle(f[0], f[1]); break;
+        case OceanChange::ADD_TREASURE_RANGE:     status = add_treasure_range(f[0], f[1], f[2], f[3]); break;
+        case OceanChange::MERGE_SHIPS:            status = merge_ships(f[0], f[1]); break;
+        case OceanChange::FORM_ALLIANCE:          status = form_alliance(f[0], f[1]); break;
+        case OceanChange::ALLIANCE_BATTLE:        status = alliance_battle(f[0], f[1]); break;
+        default:                                  return StatusType::INVALID_INPUT;
+    }
+    if (status != StatusType::SUCCESS) {
+        return status;
+    }
+    // Also catches a change the replica made nothing of, like a draw
+    return Last_change == change ? StatusType::SUCCESS : StatusType::FAILURE;
+}
+
+StatusType Ocean::freeze() {
+    if (frozen) {
+        return StatusType::SUCCESS;
+    }
+
+    try {
+        std::vector<int> shipIds;
+        std::vector<FrozenShip> ships;
+        Ocean_ships.forEach([&](int shipId, const std::shared_ptr<Ship>& ship) {
+            shipIds.push_back(shipId);
+            ships.push_back({ship->cannons, ship->numPirates, ship->richestPirateId});
+        });
+
+        std::vector<int> pirateIds;
+        std::vector<int> treasures;
+        pirateIds.reserve(Ocean_store.size());
+        treasures.reserve(Ocean_store.size());
+        Ocean_pirates.forEach([&](int pirateId, PirateHandle pirate) {
+            const auto& ship = *Ocean_ships.find(Ocean_store.shipId(pirate));
+            pirateIds.push_back(pirateId);
+            CrewEntry entry = CrewEntry();
+            ship->pirates_Order.get(Ocean_store.orderInShip(pirate), entry);
+            treasures.push_back(entry.treasure + shipBonus(*ship));
+        });
+
+        Frozen_ships.build(shipIds, ships);
+        Frozen_treasures.build(pirateIds, treasures);
+    } catch (const std::bad_alloc&) {
+        Frozen_ships.clear();
+        Frozen_treasures.clear();
+        return StatusType::ALLOCATION_ERROR;
+    }
+
+    frozen = true;
+    return StatusType::SUCCESS;
+}
+
+StatusType Ocean::unfreeze() {
+    frozen = false;
+    Frozen_treasures.clear();
+    Frozen_ships.clear();
+    return StatusType::SUCCESS;
+}
+
+bool Ocean::isFrozen() const {
+    return frozen;
+}
+
+MemoryUsage Ocean::memoryUsage() const {
+    const size_t ships = Ocean_ships.size();
+    MemoryUsage usage = Ocean_store.memoryUsage();
+    usage += Ocean_pirates.memoryUsage();
+    usage += Ocean_ships.memoryUsage();
+    usage += Ocean_treasures.memoryUsage();
+    usage += Ocean_alliances.memoryUsage();
+    usage.addVector(Stale_alliances, usage.payload);
+    usage += Ship::crewUsage(ships, Ocean_store.size());
+    usage.control += ships * MemoryUsage::SHARED_CONTROL_BLOCK;
+    usage.addVector(Stale_ships, usage.payload);
+    usage.addVector(Floating_ships, usage.payload);
+    usage += Frozen_treasures.memoryUsage();
+    usage += Frozen_ships.memoryUsage();
+    return usage;
+}
+
+void Ocean::thaw() {
+    if (frozen) {
+        unfreeze();
+    }
+}
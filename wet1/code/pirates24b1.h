@@ -18,8 +18,66 @@
 
 class Ocean {
 private:
-    AVL<int, std::shared_ptr<Pirate>> Ocean_pirates;
-    AVL<int, std::shared_ptr<Ship>> Ocean_ships;
+    PirateStore Ocean_store;                // Fields of every pirate, by handle
+    OceanPirateIndex Ocean_pirates;         // Pirate ID -> handle
+    OceanShipIndex Ocean_ships;
+
+    // Every pirate as (treasure, ID), for percentiles and histograms. An
+    // entry holds the treasure recorded in Ocean_store, and the pirate's
+    // ship holds the same entry in Ship_treasures. A ship's crew is
+    // recorded under its rankedBonus: adjusted treasure plus that.
+    // Changes to a single pirate are recorded at once. A battle only moves
+    // the ship's bonus away from rankedBonus: the ship floats, and the
+    // queries count its crew again shifted by the difference. Range
+    // bonuses and alliance battles change pirates unevenly, so they mark
+    // the ship stale instead, and the queries re-record those ships first.
+    TreasureRankIndex Ocean_treasures;
+    std::vector<int> Stale_ships;
+    std::vector<int> Floating_ships;
+
+    int rankedTreasure(Ship& ship, int treasure);
+    void recordTreasure(Ship& from, Ship& to, PirateHandle pirate, int pirateId, int treasure);
+    void markStale(Ship& ship);
+    void markFloating(Ship& ship);
+    void refreshDistribution();
+    long long countBelow(long long bound);
+
+    // Every ship's alliance. A pirate's treasure is its stored value plus
+    // its ship's extraTreasure plus the alliance bonus, see shipBonus.
+    // Alliance battles mark the alliance stale as a whole; the
+    // distribution queries expand that into its ships.
+    Alliances Ocean_alliances;
+    std::vector<int> Stale_alliances;
+
+    int shipBonus(const Ship& ship);
+    void markAllianceStale(int root);
+
+    // Read-only copies of the query answers, present only while frozen
+    bool frozen = false;
+    FrozenIndex<int, int> Frozen_treasures;         // Pirate ID -> treasure
+    FrozenIndex<int, FrozenShip> Frozen_ships;      // Ship ID -> ship summary
+
+    // Called before any change: the frozen copies would go stale
+    void thaw();
+
+    // Every successful change is kept in Last_change, which applyChange
+    // checks, and published to Ocean_feed if one is attached
+    OceanFeed* Ocean_feed = nullptr;
+    OceanChange Last_change;
+
+    void publish(int kind, int field0, int field1 = 0, int field2 = 0, int field3 = 0, int field4 = 0);
+
+    // A battle of battle_round, decided before any of them is applied.
+    // Ships are null for a battle that changes nothing.
+    struct Battle {
+        Ship* ship1;
+        Ship* ship2;
+        int change1;
+        int change2;
+    };
+
+    void decideBattles(const std::vector<std::pair<int, int>>& pairs, size_t first, size_t last,
+                       std::vector<Battle>& battles, std::vector<StatusType>& results) const;
     
 public:
     // <DO-NOT-MODIFY> {
@@ -48,6 +106,89 @@ public:
     StatusType ships_battle(int shipId1,int shipId2);
 
     // } </DO-NOT-MODIFY>
+
+    // Preallocates every pool and column for the given sizes, so that
+    // reaching them (and any mix of adds, removes and moves below them)
+    // never calls the system allocator.
+    Ocean(int expectedShips, int expectedPirates);
+
+    // Query-only mode. freeze() copies what get_treasure, get_cannons and
+    // get_richest_pirate return into Eytzinger arrays and serves those
+    // queries from them. Any change to the ocean unfreezes it first, as
+    // does unfreeze(); the trees are kept throughout.
+    StatusType freeze();
+    StatusType unfreeze();
+    bool isFrozen() const;
+
+    // Range operations over a ship's crew by arrival position: 1 is the
+    // pirate aboard longest, numPirates the newest, so the N newest are
+    // numPirates - N + 1 .. numPirates. Both take O(log n).
+    StatusType add_treasure_range(int shipId, int first, int last, int amount);
+    output_t<long long> sum_treasure_range(int shipId, int first, int last);
+
+    // Moves the whole crew of sourceShipId to destShipId, as if by
+    // treason until the source is empty: they keep their order and
+    // treasure and arrive after the destination's crew. The indexes are
+    // joined rather than re-inserted, so this takes O(m log(n/m + 1)) for
+    // m pirates moving onto n, plus O(m) to update their store rows.
+    StatusType merge_ships(int sourceShipId, int destShipId);
+
+    // Ocean-wide treasure distribution. treasure_percentile(p) is the
+    // treasure of the ceil(p * n / 100)-th poorest of the n pirates (the
+    // poorest for p = 0), so 50 gives the median. treasure_histogram fills
+    // counts[i] with the pirates whose treasure is in [bounds[i - 1],
+    // bounds[i]), taking bounds[-1] and bounds[size] as unbounded; bounds
+    // must be strictly increasing. Each bound costs O(log n), and
+    // O(log n) more for every floating ship: one with more than 32
+    // pirates whose bonus a battle has moved since its crew was ranked.
+    // While a ship floats, treasure_percentile searches the treasure
+    // range instead of selecting, which costs 32 such counts. Ships changed by range bonuses or
+    // alliance battles since the last query are re-recorded first, in
+    // O(log n) per pirate aboard.
+    output_t<int> treasure_percentile(int percentile);
+    StatusType treasure_histogram(const std::vector<int>& bounds, std::vector<int>& counts);
+
+    // Alliances of ships. form_alliance joins the alliances of two ships
+    // for good; every ship starts in one of its own. alliance_battle
+    // pits the alliances of two ships against each other like
+    // ships_battle, with the cannons and pirates of all their ships: each
+    // pirate of the winners gains the number of pirates on the losing
+    // side, each of the losers loses the number on the winning side. Both
+    // take O(alpha(m)), however many ships are allied.
+    //
+    // That bound leaves out the treasure ranking. An alliance battle
+    // marks both alliances stale, and the next treasure_percentile or
+    // treasure_histogram pays for it in refreshDistribution: it walks
+    // every ship of the two alliances and re-records every pirate on
+    // them, O(k log n) for k pirates, once per battle it follows. Oceans
+    // that never ask for the distribution never pay it.
+    StatusType form_alliance(int shipId1, int shipId2);
+    StatusType alliance_battle(int shipId1, int shipId2);
+
+    // Replication. With a feed attached, every successful change is
+    // published to it as an OceanChange (see ChangeFeed.h), in the order
+    // the changes are made. applyChange makes the same change to this
+    // ocean, a replica of the publisher, and fails if it does not come out
+    // as the publisher's did: the replica missed a record or did not start
+    // from the same state. A replica may publish to a feed of its own.
+    void attachFeed(OceanFeed* feed);
+    StatusType applyChange(const OceanChange& change);
+
+    // Battle rounds. battle_round runs ships_battle on every pair, ending
+    // as calling it on each pair in order would, and writes each call's
+    // status to results. A battle is decided by cannons and crew sizes
+    // and changes only extraTreasure, so all of them are decided up front
+    // in parallel. The bonuses are then applied in conflict-free groups,
+    // formed greedily in order so that no ship is in a group twice, each
+    // group spread over up to threads threads (0: one per core). Changes
+    // nothing and fails only if the round's scratch space cannot be had.
+    StatusType battle_round(const std::vector<std::pair<int, int>>& pairs,
+                            std::vector<StatusType>& results, unsigned threads = 0);
+
+    // Bytes this ocean holds, split into payload and overhead (see
+    // MemoryUsage.h). O(1): every ship and pirate costs the same, so the
+    // crews are accounted for from the ship and pirate counts.
+    MemoryUsage memoryUsage() const;
 };
 
 #endif // PIRRATES24SPRING_WET1_H_
\ No newline at end of file
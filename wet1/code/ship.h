@@ -2,27 +2,129 @@
 #define DS_WET1_SPRING2024_SHIP_H
 
 #include "AVL.h"
+#include "BTree.h"
+#include "FrozenIndex.h"
+#include "PirateStore.h"
+#include "Alliances.h"
+#include "ChangeFeed.h"
 #include <memory>
 #include <algorithm>
+#include <climits>
+#include <utility>
 
-// Forward declarations
 class Ship;
-class Pirate;
 
-class Pirate {
-public:
+// One pirate in a ship's arrival-order index
+struct CrewEntry {
+    PirateHandle pirate;
     int id;
-    int shipId;
     int treasure;  // Adjusted treasure (actual - ship's extraTreasure)
-    int orderInShip;
+};
 
-    Pirate(int id, int shipId, int treasure, int order) 
-        : id(id), shipId(shipId), treasure(treasure), orderInShip(order) {}
-    
-    // Get actual treasure including ship's bonus/penalty
-    int getTreasure(const std::shared_ptr<Ship>& ship) const;
+// Augmentation of the arrival-order index: total, lowest and highest
+// treasure of every subtree, with treasure bonuses applied lazily. The
+// highest breaks ties by the larger pirate ID, so at the root it names the
+// ship's richest pirate.
+struct CrewTreasure {
+    struct Summary {
+        long long total;
+        int min;
+        int max;
+        int maxId;
+    };
+
+    struct Data {
+        Summary summary;
+        int pending;  // Bonus not yet handed to the children
+    };
+
+    typedef int Tag;
+
+    static Summary none() {
+        return {0, INT_MAX, INT_MIN, -1};
+    }
+
+    template<typename Node>
+    static Summary own(const Node& node) {
+        const int treasure = node.value.treasure;
+        return {treasure, treasure, treasure, node.value.id};
+    }
+
+    template<typename Node>
+    static Summary whole(const Node& node) {
+        return node.aug.summary;
+    }
+
+    static Summary combine(const Summary& a, const Summary& b) {
+        const bool secondIsRicher = b.max > a.max || (b.max == a.max && b.maxId > a.maxId);
+        return {a.total + b.total, std::min(a.min, b.min),
+                secondIsRicher ? b.max : a.max, secondIsRicher ? b.maxId : a.maxId};
+    }
+
+    template<typename Node>
+    static void pull(Node& node) {
+        Summary summary = own(node);
+        if (node.left) summary = combine(whole(*node.left), summary);
+        if (node.right) summary = combine(summary, whole(*node.right));
+        node.aug.summary = summary;
+    }
+
+    template<typename Node>
+    static void apply(Node& node, int bonus) {
+        node.value.treasure += bonus;
+        node.aug.summary.total += static_cast<long long>(bonus) * node.size;
+        node.aug.summary.min += bonus;
+        node.aug.summary.max += bonus;
+        node.aug.pending += bonus;
+    }
+
+    template<typename Node>
+    static void applyOwn(Node& node, int bonus) {
+        node.value.treasure += bonus;
+    }
+
+    template<typename Node>
+    static void push(Node& node) {
+        if (node.aug.pending == 0) return;
+        if (node.left) apply(*node.left, node.aug.pending);
+        if (node.right) apply(*node.right, node.aug.pending);
+        node.aug.pending = 0;
+    }
+
+    template<typename Node>
+    static int pending(const Node& node) {
+        return node.aug.pending;
+    }
+
+    static int compose(int above, int below) {
+        return above + below;
+    }
+
+    static CrewEntry seenValue(CrewEntry entry, int above) {
+        entry.treasure += above;
+        return entry;
+    }
+
+    // Only for summaries of at least one value: none() has no bounds to shift
+    static Summary seenSummary(Summary summary, int above, int count) {
+        summary.total += static_cast<long long>(above) * count;
+        summary.min += above;
+        summary.max += above;
+        return summary;
+    }
 };
 
+// Container behind each index. AVL and BTree share one interface, so each
+// index can switch backend on its own: BTree for the ocean-wide indexes,
+// where cache misses dominate, AVL for the many small per-ship ones.
+// The per-ship indexes need AVL: pirates_Order is augmented, and
+// merge_ships relies on AVL's join-based set operations.
+typedef BTree<int, PirateHandle> OceanPirateIndex;           // Ocean_pirates
+typedef BTree<int, std::shared_ptr<Ship>> OceanShipIndex;    // Ocean_ships
+typedef AVL<int, PirateHandle> ShipPirateIndex;              // Ship_pirates
+typedef AVL<int, CrewEntry, CrewTreasure> OrderIndex;        // pirates_Order
+typedef AVL<std::pair<int, int>, PirateHandle> TreasureRankIndex;  // Ocean_treasures, Ship_treasures
+
 class Ship {
 public:
     const int id;
@@ -30,40 +132,56 @@ public:
     int numPirates;
     int orderCounter;
     int extraTreasure;  // Bonus/penalty from battles
+    int allianceSlot;   // In Ocean_alliances; alliance battles add there
     int richestPirateId;
+    bool treasuresStale;  // Pirates may differ from Ocean_treasures
+    int rankedBonus;      // Bonus the crew is ranked under in Ocean_treasures
+    bool floating;        // On Ocean's Floating_ships
+    int battleGroup;      // Last group this ship fights in during battle_round, else 0
 
     // Primary index: pirate ID -> pirate
-    AVL<int, std::shared_ptr<Pirate>> Ship_pirates;
+    ShipPirateIndex Ship_pirates;
     
-    // Secondary index: order -> pirate (for treason operation)
-    AVL<int, std::shared_ptr<Pirate>> pirates_Order;
-    
-    // Tertiary index: treasure -> (pirateID -> pirate)
-    // For efficient richest pirate queries
-    AVL<int, std::shared_ptr<AVL<int, std::shared_ptr<Pirate>>>> pirates_Treasure;
+    // Secondary index: order -> pirate and treasure (for treason, range
+    // bonuses and the richest pirate)
+    OrderIndex pirates_Order;
+
+    // The crew's entries of Ocean_treasures, so that the ocean can count
+    // them again with the ship's bonus moved
+    TreasureRankIndex Ship_treasures;
 
     Ship(int id, int cannons)
         : id(id), cannons(cannons), numPirates(0), orderCounter(0), 
-          extraTreasure(0), richestPirateId(-1) {}
+          extraTreasure(0), allianceSlot(-1), richestPirateId(-1), treasuresStale(false),
+          rankedBonus(0), floating(false), battleGroup(0) {}
 
     // Update the richest pirate after modifications
     void updateRichestPirate() {
-        auto highestTreasureNode = pirates_Treasure.getBiggest();
-        if (highestTreasureNode && highestTreasureNode->value) {
-            auto& highestTreasureTree = *(highestTreasureNode->value);
-            auto richestPirateNode = highestTreasureTree->getBiggest();
-            if (richestPirateNode) {
-                richestPirateId = richestPirateNode->key;
-                return;
-            }
-        }
-        richestPirateId = -1;
+        richestPirateId = pirates_Order.isEmpty() ? -1 : pirates_Order.summarize().maxId;
+    }
+
+    // The ship record and the crew indexes. Every pirate aboard has one
+    // node in each index, so ships holding n pirates between them take
+    // crewUsage(ships, n) in all. The control block of the shared_ptr
+    // holding a ship is counted by its owner.
+    static MemoryUsage crewUsage(size_t ships, size_t pirates) {
+        MemoryUsage usage = ShipPirateIndex::nodeUsage(pirates);
+        usage += OrderIndex::nodeUsage(pirates);
+        usage += TreasureRankIndex::nodeUsage(pirates);
+        usage.payload += ships * sizeof(Ship);
+        return usage;
+    }
+
+    MemoryUsage memoryUsage() const {
+        return crewUsage(1, numPirates);
     }
 };
 
-// Implementation of Pirate's getTreasure method
-inline int Pirate::getTreasure(const std::shared_ptr<Ship>& ship) const {
-    return treasure + (ship ? ship->extraTreasure : 0);
-}
+// What the read-only queries need from a ship, copied out by Ocean::freeze
+struct FrozenShip {
+    int cannons;
+    int numPirates;
+    int richestPirateId;
+};
 
 #endif // DS_WET1_SPRING2024_SHIP_H
\ No newline at end of file
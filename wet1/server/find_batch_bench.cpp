@@ -0,0 +1,92 @@
+// Benchmark of find_batch against one-at-a-time find on AVL and BTree,
+// with the counters of PerfCounters.h per lookup.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -pthread -Icode server/find_batch_bench.cpp -o find_batch_bench
+//   ./find_batch_bench [keys] [lookups]
+//
+// The trees hold keys random distinct keys (default 10^6); lookups
+// random keys (default 10^6), half of them present, are looked up in
+// rounds of both kinds. Both must find the same values.
+#include "AVL.h"
+#include "BTree.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static const int ROUNDS = 3;
+
+enum Kind { AVL_FIND, AVL_FIND_BATCH, BTREE_FIND, BTREE_FIND_BATCH, KINDS };
+
+// Sums what a pass found, so neither pass can be optimized away and both
+// can be compared
+template<typename Tree>
+static long long findEach(const Tree& tree, const std::vector<int>& keys) {
+    long long sum = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        const int* value = tree.find(keys[i]);
+        sum += value ? *value : -1;
+    }
+    return sum;
+}
+
+template<typename Tree>
+static long long findBatch(const Tree& tree, const std::vector<int>& keys, std::vector<int*>& out) {
+    tree.find_batch(keys.data(), keys.size(), out.data());
+    long long sum = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        sum += out[i] ? *out[i] : -1;
+    }
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    const size_t keyCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const size_t lookupCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+    // Even keys are stored, odd ones miss
+    std::mt19937 rng(1);
+    std::vector<int> stored(keyCount);
+    for (size_t i = 0; i < keyCount; i++) {
+        stored[i] = static_cast<int>(2 * i);
+    }
+    std::shuffle(stored.begin(), stored.end(), rng);
+    std::vector<int> lookups(lookupCount);
+    for (size_t i = 0; i < lookupCount; i++) {
+        lookups[i] = static_cast<int>(rng() % (2 * keyCount + 1));
+    }
+
+    AVL<int, int> avl;
+    BTree<int, int> btree;
+    for (size_t i = 0; i < keyCount; i++) {
+        avl.try_emplace(stored[i], stored[i] / 2);
+        btree.try_emplace(stored[i], stored[i] / 2);
+    }
+
+    const std::vector<std::string> names = {"AVL find", "AVL find_batch", "BTree find", "BTree find_batch"};
+    PerfCounters counters;
+    PerfProfile profile(counters, names);
+    profile.calibrate();
+
+    std::vector<int*> out(lookupCount);
+    long long sums[KINDS] = {0, 0, 0, 0};
+    for (int round = 0; round < ROUNDS; round++) {
+        profile.measure(AVL_FIND, [&] { sums[AVL_FIND] += findEach(avl, lookups); }, lookupCount);
+        profile.measure(AVL_FIND_BATCH, [&] { sums[AVL_FIND_BATCH] += findBatch(avl, lookups, out); }, lookupCount);
+        profile.measure(BTREE_FIND, [&] { sums[BTREE_FIND] += findEach(btree, lookups); }, lookupCount);
+        profile.measure(BTREE_FIND_BATCH, [&] { sums[BTREE_FIND_BATCH] += findBatch(btree, lookups, out); }, lookupCount);
+    }
+
+    for (int kind = 1; kind < KINDS; kind++) {
+        if (sums[kind] != sums[0]) {
+            std::fprintf(stderr, "%s found different values\n", names[kind].c_str());
+            return 1;
+        }
+    }
+    std::printf("%zu keys, %zu lookups x %d rounds; figures per lookup\n", keyCount, lookupCount, ROUNDS);
+    profile.print(stdout);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Side-by-side benchmark of the two index containers, AVL and BTree, from
+// 10^3 keys up to max_keys, to find where the B+-tree starts to win.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -pthread -Icode server/index_bench.cpp -o index_bench
+//   ./index_bench [max_keys] [lookups]
+//
+// For each power of ten up to max_keys (default 10^8), a tree of that
+// many random distinct keys is built by inserts in random order, then
+// lookups random keys (default 10^6), half of them present, are looked up,
+// and then half the keys are removed. Only one tree exists at a time, so
+// the largest size needs memory for one tree, not both. Reports wall time
+// per operation and, for each operation, the first size at which BTree
+// beats AVL.
+#include "AVL.h"
+#include "BTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+enum Op { INSERT, FIND, REMOVE, OPS };
+static const char* const OP_NAMES[OPS] = {"insert", "find", "remove"};
+
+struct Timing {
+    double ns[OPS];
+    long long sum;  // What find found, so both trees can be compared
+};
+
+static double nanosSince(std::chrono::steady_clock::time_point start, size_t operations) {
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / operations;
+}
+
+template<typename Tree>
+static Timing run(const std::vector<int>& stored, const std::vector<int>& lookups) {
+    Timing timing;
+    Tree tree;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < stored.size(); i++) {
+        tree.try_emplace(stored[i], stored[i] / 2);
+    }
+    timing.ns[INSERT] = nanosSince(start, stored.size());
+
+    timing.sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups.size(); i++) {
+        const int* value = tree.find(lookups[i]);
+        timing.sum += value ? *value : -1;
+    }
+    timing.ns[FIND] = nanosSince(start, lookups.size());
+
+    const size_t removals = stored.size() / 2;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < removals; i++) {
+        tree.remove(stored[i]);
+    }
+    timing.ns[REMOVE] = nanosSince(start, removals);
+    return timing;
+}
+
+int main(int argc, char** argv) {
+    const size_t maxKeys = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000000;
+    const size_t lookupCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+    std::printf("%zu lookups per size; ns per operation\n", lookupCount);
+    std::printf("%-10s", "");
+    for (int op = 0; op < OPS; op++) {
+        std::printf(" %-19s", OP_NAMES[op]);
+    }
+    std::printf("\n%-10s", "keys");
+    for (int op = 0; op < OPS; op++) {
+        std::printf(" %9s %9s", "AVL", "BTree");
+    }
+    std::printf("\n");
+
+    size_t crossover[OPS] = {0, 0, 0};
+    std::mt19937 rng(1);
+    for (size_t keyCount = 1000; keyCount <= maxKeys; keyCount *= 10) {
+        // Even keys are stored, odd ones miss
+        std::vector<int> stored(keyCount);
+        for (size_t i = 0; i < keyCount; i++) {
+            stored[i] = static_cast<int>(2 * i);
+        }
+        std::shuffle(stored.begin(), stored.end(), rng);
+        std::vector<int> lookups(lookupCount);
+        for (size_t i = 0; i < lookupCount; i++) {
+            lookups[i] = static_cast<int>(rng() % (2 * keyCount + 1));
+        }
+
+        const Timing avl = run<AVL<int, int>>(stored, lookups);
+        const Timing btree = run<BTree<int, int>>(stored, lookups);
+        if (avl.sum != btree.sum) {
+            std::fprintf(stderr, "the trees found different values at %zu keys\n", keyCount);
+            return 1;
+        }
+        std::printf("%-10zu", keyCount);
+        for (int op = 0; op < OPS; op++) {
+            std::printf(" %9.1f %9.1f", avl.ns[op], btree.ns[op]);
+            if (btree.ns[op] < avl.ns[op]) {
+                if (!crossover[op]) crossover[op] = keyCount;
+            } else {
+                crossover[op] = 0;  // Only a lead BTree keeps from there on counts
+            }
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    for (int op = 0; op < OPS; op++) {
+        if (crossover[op]) {
+            std::printf("%s: BTree faster from %zu keys on\n", OP_NAMES[op], crossover[op]);
+        } else {
+            std::printf("%s: AVL faster or even at the largest size\n", OP_NAMES[op]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+// In-process benchmark for Ocean: runs a command script one command at a
+// time, calling the Ocean method itself, and reports, per kind of command,
+// the wall time and the hardware counters of PerfCounters.h per call.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -Icode server/ocean_bench.cpp code/pirates24b1.cpp -o ocean_bench
+//   ./ocean_bench < tests/test1.in
+//
+// The script is in the format main24b1.cpp reads ("add_ship 6 6"), and
+// also takes every other op of OceanServer.h by its lowercase name. It is
+// parsed up front, so only the ocean is measured. Counters the machine
+// does not offer, e.g. in a VM without a virtual PMU or with
+// kernel.perf_event_paranoid above 2, are reported as n/a.
+#include "OceanServer.h"  // OceanWire::Op
+#include "PerfCounters.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Command {
+    const char* name;
+    int args;
+};
+
+// Indexed by OceanWire::Op
+static const Command COMMANDS[] = {
+    {"add_ship", 2}, {"remove_ship", 1}, {"add_pirate", 3}, {"remove_pirate", 1}, {"treason", 2},
+    {"update_pirate_treasure", 2}, {"get_treasure", 1}, {"get_cannons", 1}, {"get_richest_pirate", 1},
+    {"ships_battle", 2}, {"add_treasure_range", 4}, {"sum_treasure_range", 3}, {"merge_ships", 2},
+    {"freeze", 0}, {"unfreeze", 0}, {"treasure_percentile", 1}, {"form_alliance", 2},
+    {"alliance_battle", 2}
+};
+static const int OPS = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+struct Call {
+    int kind;
+    int args[4];
+};
+
+static void execute(Ocean& ocean, const Call& call) {
+    const int* a = call.args;
+    switch (call.kind) {
+        case OceanWire::ADD_SHIP:               ocean.add_ship(a[0], a[1]); break;
+        case OceanWire::REMOVE_SHIP:            ocean.remove_ship(a[0]); break;
+        case OceanWire::ADD_PIRATE:             ocean.add_pirate(a[0], a[1], a[2]); break;
+        case OceanWire::REMOVE_PIRATE:          ocean.remove_pirate(a[0]); break;
+        case OceanWire::TREASON:                ocean.treason(a[0], a[1]); break;
+        case OceanWire::UPDATE_PIRATE_TREASURE: ocean.update_pirate_treasure(a[0], a[1]); break;
+        case OceanWire::GET_TREASURE:           ocean.get_treasure(a[0]); break;
+        case OceanWire::GET_CANNONS:            ocean.get_cannons(a[0]); break;
+        case OceanWire::GET_RICHEST_PIRATE:     ocean.get_richest_pirate(a[0]); break;
+        case OceanWire::SHIPS_BATTLE:           ocean.ships_battle(a[0], a[1]); break;
+        case OceanWire::ADD_TREASURE_RANGE:     ocean.add_treasure_range(a[0], a[1], a[2], a[3]); break;
+        case OceanWire::SUM_TREASURE_RANGE:     ocean.sum_treasure_range(a[0], a[1], a[2]); break;
+        case OceanWire::MERGE_SHIPS:            ocean.merge_ships(a[0], a[1]); break;
+        case OceanWire::FREEZE:                 ocean.freeze(); break;
+        case OceanWire::UNFREEZE:               ocean.unfreeze(); break;
+        case OceanWire::TREASURE_PERCENTILE:    ocean.treasure_percentile(a[0]); break;
+        case OceanWire::FORM_ALLIANCE:          ocean.form_alliance(a[0], a[1]); break;
+        default:                                ocean.alliance_battle(a[0], a[1]); break;
+    }
+}
+
+int main() {
+    std::vector<Call> script;
+    std::string op;
+    while (std::cin >> op) {
+        int kind = 0;
+        while (kind < OPS && op != COMMANDS[kind].name) {
+            kind++;
+        }
+        if (kind == OPS) {
+            std::fprintf(stderr, "unknown command: %s\n", op.c_str());
+            return 1;
+        }
+        Call call = {kind, {0, 0, 0, 0}};
+        for (int i = 0; i < COMMANDS[kind].args; i++) {
+            std::cin >> call.args[i];
+        }
+        if (std::cin.fail()) {
+            std::fprintf(stderr, "invalid arguments to %s\n", op.c_str());
+            return 1;
+        }
+        script.push_back(call);
+    }
+
+    std::vector<std::string> names;
+    for (int kind = 0; kind < OPS; kind++) {
+        names.push_back(COMMANDS[kind].name);
+    }
+    PerfCounters counters;
+    PerfProfile profile(counters, names);
+    profile.calibrate();
+
+    Ocean ocean;
+    for (size_t i = 0; i < script.size(); i++) {
+        profile.measure(script[i].kind, [&] { execute(ocean, script[i]); });
+    }
+
+    if (!counters.anyAvailable()) {
+        std::fprintf(stderr, "hardware counters unavailable; reporting wall time only\n");
+    }
+    profile.print(stdout);
+    return 0;
+}
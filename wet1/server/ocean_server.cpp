@@ -0,0 +1,45 @@
+// Long-lived server mode for Ocean: serves the binary protocol of
+// OceanServer.h on a Unix domain socket until SIGINT or SIGTERM.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -pthread -Icode server/ocean_server.cpp code/pirates24b1.cpp -o ocean_server
+//   ./ocean_server /tmp/ocean.sock
+#include "EpollServer.h"
+#include "OceanServer.h"
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+static EpollServer<OceanEngine>* runningServer = nullptr;
+
+static void onSignal(int) {
+    if (runningServer) {
+        runningServer->stop();
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s <socket path>\n", argv[0]);
+        return 2;
+    }
+
+    Ocean ocean;
+    OceanEngine engine(ocean);
+    EpollServer<OceanEngine> server(engine);
+    if (!server.listen(argv[1])) {
+        std::perror(argv[1]);
+        return 1;
+    }
+
+    // No SA_RESTART, so epoll_wait returns and sees the stop flag
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    runningServer = &server;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    server.run();
+    unlink(argv[1]);
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Where alliance_battle's cost lands. The battle itself is O(alpha(m));
+// re-ranking the pirates it moved is deferred to the next distribution
+// query, which pays O(k log n) for them in refreshDistribution, once.
+//
+//   g++ -std=c++11 -O2 -Wall -Icode tests/alliance_refresh_test.cpp code/pirates24b1.cpp -o alliance_refresh_test
+//   ./alliance_refresh_test [ships] [pirates per ship] [battles]
+//
+// Two alliances of ships/2 ships each fight battles. After each one,
+// get_treasure must be right at once, and the first percentile and
+// histogram after it must match the sorted treasures. With at least
+// TIMED_PIRATES pirates, the first query must also take far longer than
+// the battle, and a second query far less than the first. Prints "ok" or
+// what went wrong.
+#include "pirates24b1.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Fewer pirates than this re-rank too fast to time against a battle
+static const long long TIMED_PIRATES = 100000;
+
+static double since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool fail(const char* what) {
+    printf("FAILED: %s\n", what);
+    return false;
+}
+
+static bool checkQueries(Ocean& ocean, std::vector<int> treasures) {
+    std::sort(treasures.begin(), treasures.end());
+    const long long n = treasures.size();
+    for (int percentile = 0; percentile <= 100; percentile += 10) {
+        output_t<int> answer = ocean.treasure_percentile(percentile);
+        const long long rank = std::max((percentile * n + 99) / 100, 1LL);
+        if (answer.status() != StatusType::SUCCESS || answer.ans() != treasures[rank - 1]) {
+            return fail("wrong percentile after an alliance battle");
+        }
+    }
+    const std::vector<int> bounds = {treasures[n / 4], treasures[n / 2], treasures[n / 2] + 1};
+    std::vector<int> counts;
+    ocean.treasure_histogram(bounds, counts);
+    int below = 0;
+    for (size_t i = 0; i < bounds.size(); i++) {
+        const int belowBound = static_cast<int>(
+            std::lower_bound(treasures.begin(), treasures.end(), bounds[i]) - treasures.begin());
+        if (counts[i] != belowBound - below) {
+            return fail("wrong histogram after an alliance battle");
+        }
+        below = belowBound;
+    }
+    return true;
+}
+
+static bool run(int ships, int crew, int battles) {
+    Ocean ocean;
+    std::vector<int> treasures;  // By pirate ID - 1
+    std::vector<int> side;       // 0 or 1, by pirate ID - 1
+    for (int shipId = 1; shipId <= ships; shipId++) {
+        // The first alliance has the cannons to win every battle
+        const int team = shipId <= ships / 2 ? 0 : 1;
+        ocean.add_ship(shipId, team == 0 ? 2 * crew : 0);
+        for (int i = 0; i < crew; i++) {
+            const int treasure = static_cast<int>((treasures.size() * 7919) % 1000);
+            ocean.add_pirate(static_cast<int>(treasures.size()) + 1, shipId, treasure);
+            treasures.push_back(treasure);
+            side.push_back(team);
+        }
+        if (shipId != 1 && shipId != ships / 2 + 1) {
+            ocean.form_alliance(team == 0 ? 1 : ships / 2 + 1, shipId);
+        }
+    }
+    const int pirates0 = (ships / 2) * crew;
+    const int pirates1 = (ships - ships / 2) * crew;
+    ocean.treasure_percentile(50);
+
+    for (int battle = 0; battle < battles; battle++) {
+        Clock::time_point start = Clock::now();
+        if (ocean.alliance_battle(1, ships) != StatusType::SUCCESS) {
+            return fail("alliance_battle failed");
+        }
+        const double battleTime = since(start);
+        for (size_t i = 0; i < treasures.size(); i++) {
+            treasures[i] += side[i] == 0 ? pirates1 : -pirates0;
+        }
+        for (size_t i = 0; i < treasures.size(); i += treasures.size() / 100 + 1) {
+            if (ocean.get_treasure(static_cast<int>(i) + 1).ans() != treasures[i]) {
+                return fail("get_treasure is off right after an alliance battle");
+            }
+        }
+
+        start = Clock::now();
+        ocean.treasure_percentile(50);
+        const double firstQuery = since(start);
+        start = Clock::now();
+        ocean.treasure_percentile(50);
+        const double secondQuery = since(start);
+
+        if (!checkQueries(ocean, treasures)) {
+            return false;
+        }
+        if (static_cast<long long>(treasures.size()) < TIMED_PIRATES) {
+            continue;
+        }
+        if (battleTime * 100 > firstQuery) {
+            return fail("the battle did the re-ranking itself");
+        }
+        if (secondQuery * 10 > firstQuery) {
+            return fail("the re-ranking was not done once, by the first query");
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int ships = std::max(argc > 1 ? atoi(argv[1]) : 64, 2);
+    const int crew = argc > 2 ? atoi(argv[2]) : 4000;
+    const int battles = argc > 3 ? atoi(argv[3]) : 5;
+    if (!run(ships, crew, battles)) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Const lookups on an augmented AVL against a plain array, from several
+// reader threads at once. Build with -fsanitize=thread as well: readers
+// must not write to the tree, so TSan must stay quiet.
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -Icode tests/avl_readers_test.cpp -o avl_readers_test
+//   ./avl_readers_test [entries] [readers] [rounds]
+//
+// Each round applies random range bonuses to pirates_Order's tree type,
+// leaving tags pending all over it. Then the readers compare get, forEach
+// and summarizeRange with the array, all at the same time. Prints "ok" or
+// what went wrong.
+#include "ship.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+static bool check(const OrderIndex& tree, const std::vector<int>& treasure, unsigned seed) {
+    const int n = static_cast<int>(treasure.size());
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 2000; i++) {
+        const int order = static_cast<int>(rng() % n);
+        CrewEntry entry = CrewEntry();
+        if (!tree.get(order, entry) || entry.treasure != treasure[order]) return false;
+
+        const int lo = static_cast<int>(rng() % n);
+        const int hi = lo + static_cast<int>(rng() % (n - lo));
+        long long total = 0;
+        int most = treasure[lo];
+        for (int k = lo; k <= hi; k++) {
+            total += treasure[k];
+            most = std::max(most, treasure[k]);
+        }
+        const CrewTreasure::Summary summary = tree.summarizeRange(lo, hi);
+        if (summary.total != total || summary.max != most) return false;
+    }
+    int next = 0;
+    bool inOrder = true;
+    tree.forEach([&](int order, const CrewEntry& entry) {
+        inOrder = inOrder && order == next && entry.treasure == treasure[order];
+        next++;
+    });
+    return inOrder && next == n;
+}
+
+int main(int argc, char** argv) {
+    const int n = argc > 1 ? atoi(argv[1]) : 20000;
+    const unsigned readers = argc > 2 ? strtoul(argv[2], nullptr, 10) : 4;
+    const int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+    OrderIndex tree;
+    std::vector<int> treasure(n);
+    for (int order = 0; order < n; order++) {
+        treasure[order] = order % 100;
+        tree.try_emplace(order, CrewEntry{0, order + 1, treasure[order]});
+    }
+
+    std::mt19937 rng(1);
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < 200; i++) {
+            const int lo = static_cast<int>(rng() % n);
+            const int hi = lo + static_cast<int>(rng() % (n - lo));
+            const int bonus = static_cast<int>(rng() % 21) - 10;
+            tree.applyRange(lo, hi, bonus);
+            for (int k = lo; k <= hi; k++) {
+                treasure[k] += bonus;
+            }
+        }
+
+        std::atomic<int> failures(0);
+        std::vector<std::thread> running;
+        for (unsigned t = 0; t < readers; t++) {
+            running.emplace_back([&, t] {
+                if (!check(tree, treasure, 100 * round + t)) failures++;
+            });
+        }
+        for (std::thread& thread : running) {
+            thread.join();
+        }
+        if (failures > 0) {
+            printf("FAILED: a reader saw other values than the array\n");
+            return 1;
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,123 @@
+// battle_round against ships_battle called on each pair in order.
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -Icode tests/battle_round_test.cpp code/pirates24b1.cpp -o battle_round_test
+//   ./battle_round_test [ships] [pirates] [battles]
+//
+// Two oceans start out alike; one runs a round of random pairs, among them
+// unknown ships and a ship against itself, and the other runs the same
+// pairs one ships_battle at a time. The statuses must match pair by pair,
+// and afterwards every pirate's treasure, every ship's richest pirate and
+// treasure sums, and the treasure percentiles must match too. A replica
+// fed by the round's ChangeFeed must apply every record and end up alike
+// as well. This is done on 1, 2 and 4 threads and one per core, with the
+// round's ocean frozen half of the time. Prints "ok" or what went wrong.
+#include "pirates24b1.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+
+static bool fail(unsigned threads, const char* what) {
+    printf("FAILED: %s on %u threads\n", what, threads);
+    return false;
+}
+
+static bool same(output_t<int> a, output_t<int> b) {
+    return a.status() == b.status() && (a.status() != StatusType::SUCCESS || a.ans() == b.ans());
+}
+
+static bool same(output_t<long long> a, output_t<long long> b) {
+    return a.status() == b.status() && (a.status() != StatusType::SUCCESS || a.ans() == b.ans());
+}
+
+static bool sameOceans(Ocean& a, Ocean& b, int ships, int pirates) {
+    for (int pirateId = 1; pirateId <= pirates; pirateId++) {
+        if (!same(a.get_treasure(pirateId), b.get_treasure(pirateId))) {
+            return false;
+        }
+    }
+    for (int shipId = 1; shipId <= ships; shipId++) {
+        if (!same(a.get_richest_pirate(shipId), b.get_richest_pirate(shipId)) ||
+            !same(a.sum_treasure_range(shipId, 1, 5), b.sum_treasure_range(shipId, 1, 5))) {
+            return false;
+        }
+    }
+    for (int percentile = 0; percentile <= 100; percentile += 5) {
+        if (!same(a.treasure_percentile(percentile), b.treasure_percentile(percentile))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check(int ships, int pirates, int battles, unsigned threads, bool frozen) {
+    std::mt19937 rng(threads * 2 + frozen);
+    Ocean round;
+    Ocean sequential;
+    Ocean replica;
+    OceanFeed feed(1 << 22);
+    for (int shipId = 1; shipId <= ships; shipId++) {
+        const int cannons = static_cast<int>(rng() % 20);
+        round.add_ship(shipId, cannons);
+        sequential.add_ship(shipId, cannons);
+        replica.add_ship(shipId, cannons);
+    }
+    for (int pirateId = 1; pirateId <= pirates; pirateId++) {
+        const int shipId = 1 + static_cast<int>(rng() % ships);
+        const int treasure = static_cast<int>(rng() % 100);
+        round.add_pirate(pirateId, shipId, treasure);
+        sequential.add_pirate(pirateId, shipId, treasure);
+        replica.add_pirate(pirateId, shipId, treasure);
+    }
+    round.attachFeed(&feed);
+    OceanFeed::Reader reader(feed);
+    if (frozen) {
+        round.freeze();
+    }
+
+    // IDs from -1 to ships + 1, so some are invalid or unknown
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < battles; i++) {
+        const int shipId1 = static_cast<int>(rng() % (ships + 3)) - 1;
+        const int shipId2 = rng() % 50 == 0 ? shipId1 : static_cast<int>(rng() % (ships + 3)) - 1;
+        pairs.push_back(std::make_pair(shipId1, shipId2));
+    }
+    std::vector<StatusType> results;
+    if (round.battle_round(pairs, results, threads) != StatusType::SUCCESS || results.size() != pairs.size()) {
+        return fail(threads, "battle_round failed");
+    }
+    for (size_t i = 0; i < pairs.size(); i++) {
+        if (results[i] != sequential.ships_battle(pairs[i].first, pairs[i].second)) {
+            return fail(threads, "a status differs from ships_battle");
+        }
+    }
+    if (!sameOceans(round, sequential, ships, pirates)) {
+        return fail(threads, "the round ended differently from ships_battle in order");
+    }
+
+    OceanChange change;
+    while (reader.poll(change) == OceanFeed::READ) {
+        if (replica.applyChange(change) != StatusType::SUCCESS) {
+            return fail(threads, "a replica could not apply the round");
+        }
+    }
+    if (!sameOceans(replica, sequential, ships, pirates)) {
+        return fail(threads, "a replica of the round differs");
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int ships = argc > 1 ? atoi(argv[1]) : 200;
+    const int pirates = argc > 2 ? atoi(argv[2]) : 3000;
+    const int battles = argc > 3 ? atoi(argv[3]) : 50000;
+    const unsigned threadCounts[] = {1, 2, 4, 0};
+    for (unsigned threads : threadCounts) {
+        if (!check(ships, pirates, battles, threads, false) || !check(ships, pirates, battles, threads, true)) {
+            return 1;
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
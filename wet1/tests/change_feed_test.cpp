@@ -0,0 +1,281 @@
+// ChangeFeed with several readers, and replicas of an Ocean fed by it.
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -Icode tests/change_feed_test.cpp code/pirates24b1.cpp -o change_feed_test
+//   ./change_feed_test [readers] [records] [operations]
+//
+// A new reader gets EMPTY, one a whole ring behind gets LOST, and one a
+// ring behind reads exactly a ring's worth. Then readers threads poll a
+// 64-record ring while records are published as fast as possible: every
+// record read must be whole, and a reader that gets LOST starts over from
+// the head. Last, as many replicas apply the feed of a primary running
+// random operations on their own threads; every change must apply, and
+// each replica must then answer every query as the primary does. A
+// replica that missed a record must fail to apply the next one. Prints
+// "ok" or what went wrong.
+#include "pirates24b1.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const int SHIPS = 40;
+static const int PIRATES = 3000;
+static const int STAMP_WORDS = 6;
+
+// A record whose words all follow from its number, so a torn one shows
+struct Stamp {
+    uint32_t words[STAMP_WORDS];
+};
+
+static Stamp stamp(uint64_t n) {
+    Stamp record;
+    for (int i = 0; i < STAMP_WORDS; i++) {
+        record.words[i] = static_cast<uint32_t>(n * 2654435761u + i);
+    }
+    return record;
+}
+
+static bool whole(const Stamp& record, uint64_t n) {
+    const Stamp expected = stamp(n);
+    for (int i = 0; i < STAMP_WORDS; i++) {
+        if (record.words[i] != expected.words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool fail(const char* what) {
+    printf("FAILED: %s\n", what);
+    return false;
+}
+
+static bool checkPositions() {
+    ChangeFeed<Stamp> feed(16);
+    ChangeFeed<Stamp>::Reader early(feed, 0);
+    ChangeFeed<Stamp>::Reader atHead(feed);
+    Stamp record;
+    if (atHead.poll(record) != ChangeFeed<Stamp>::EMPTY) {
+        return fail("a reader of an empty feed got a record");
+    }
+
+    const uint64_t published = 3 * feed.capacity() + 5;
+    for (uint64_t n = 0; n < published; n++) {
+        feed.publish(stamp(n));
+    }
+    if (early.poll(record) != ChangeFeed<Stamp>::LOST) {
+        return fail("a reader a ring behind did not get LOST");
+    }
+
+    const uint64_t first = published - feed.capacity();
+    ChangeFeed<Stamp>::Reader lastRing(feed, first);
+    uint64_t read = 0;
+    while (lastRing.poll(record) == ChangeFeed<Stamp>::READ) {
+        if (!whole(record, first + read)) {
+            return fail("wrong record in the last ring");
+        }
+        read++;
+    }
+    if (read != feed.capacity()) {
+        return fail("the last ring was not all readable");
+    }
+    if (lastRing.poll(record) != ChangeFeed<Stamp>::EMPTY) {
+        return fail("a reader at the head got no EMPTY");
+    }
+    return true;
+}
+
+static bool checkRacingReaders(int readers, uint64_t records) {
+    ChangeFeed<Stamp> feed(64);
+    std::atomic<bool> done(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&] {
+            uint64_t n = 0;
+            Stamp record;
+            while (!done.load() || n < feed.head()) {
+                const ChangeFeed<Stamp>::ReadStatus status = feed.read(n, record);
+                if (status == ChangeFeed<Stamp>::READ) {
+                    if (!whole(record, n)) {
+                        torn++;
+                    }
+                    n++;
+                } else if (status == ChangeFeed<Stamp>::LOST) {
+                    n = feed.head();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (uint64_t n = 0; n < records; n++) {
+        feed.publish(stamp(n));
+    }
+    done = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (torn != 0) {
+        return fail("a reader got a torn record");
+    }
+    return true;
+}
+
+static void randomOperation(Ocean& ocean, std::mt19937& rng) {
+    const int shipId1 = static_cast<int>(rng() % SHIPS) + 1;
+    const int shipId2 = static_cast<int>(rng() % SHIPS) + 1;
+    const int pirateId = static_cast<int>(rng() % PIRATES) + 1;
+    switch (rng() % 16) {
+        case 0:
+            ocean.add_ship(shipId1, static_cast<int>(rng() % 8));
+            break;
+        case 1:
+            ocean.remove_ship(shipId1);
+            break;
+        case 2:
+        case 3:
+        case 4:
+            ocean.add_pirate(pirateId, shipId1, static_cast<int>(rng() % 200) - 100);
+            break;
+        case 5:
+            ocean.remove_pirate(pirateId);
+            break;
+        case 6:
+            ocean.treason(shipId1, shipId2);
+            break;
+        case 7:
+            ocean.update_pirate_treasure(pirateId, static_cast<int>(rng() % 21) - 10);
+            break;
+        case 8:
+            ocean.ships_battle(shipId1, shipId2);
+            break;
+        case 9:
+            ocean.add_treasure_range(shipId1, 1 + static_cast<int>(rng() % 3), 1 + static_cast<int>(rng() % 6),
+                                     static_cast<int>(rng() % 11) - 5);
+            break;
+        case 10:
+            ocean.merge_ships(shipId1, shipId2);
+            break;
+        case 11:
+            if (rng() % 8 == 0) {
+                ocean.form_alliance(shipId1, shipId2);
+            }
+            break;
+        case 12:
+            ocean.alliance_battle(shipId1, shipId2);
+            break;
+        case 13:
+            ocean.get_treasure(pirateId);
+            break;
+        case 14:
+            if (rng() % 50 == 0) {
+                ocean.freeze();
+            }
+            break;
+        default:
+            ocean.treasure_percentile(static_cast<int>(rng() % 101));
+            break;
+    }
+}
+
+static bool same(output_t<int> a, output_t<int> b) {
+    return a.status() == b.status() && (a.status() != StatusType::SUCCESS || a.ans() == b.ans());
+}
+
+static bool sameOceans(Ocean& a, Ocean& b) {
+    for (int pirateId = 1; pirateId <= PIRATES; pirateId++) {
+        if (!same(a.get_treasure(pirateId), b.get_treasure(pirateId))) {
+            return false;
+        }
+    }
+    for (int shipId = 1; shipId <= SHIPS; shipId++) {
+        if (!same(a.get_cannons(shipId), b.get_cannons(shipId)) ||
+            !same(a.get_richest_pirate(shipId), b.get_richest_pirate(shipId))) {
+            return false;
+        }
+    }
+    for (int percentile = 0; percentile <= 100; percentile += 10) {
+        if (!same(a.treasure_percentile(percentile), b.treasure_percentile(percentile))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkReplicas(int readers, int operations) {
+    OceanFeed feed(1 << 20);
+    Ocean primary;
+    primary.attachFeed(&feed);
+    std::unique_ptr<Ocean[]> replicas(new Ocean[readers]);
+    std::atomic<bool> done(false);
+    std::atomic<int> failed(0);
+    std::atomic<int> lost(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&, i] {
+            OceanFeed::Reader reader(feed, 0);
+            OceanChange change;
+            while (!done.load() || reader.next() < feed.head()) {
+                const OceanFeed::ReadStatus status = reader.poll(change);
+                if (status == OceanFeed::READ) {
+                    if (replicas[i].applyChange(change) != StatusType::SUCCESS) {
+                        failed++;
+                    }
+                } else if (status == OceanFeed::LOST) {
+                    lost++;
+                    return;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::mt19937 rng(1);
+    for (int i = 0; i < operations; i++) {
+        randomOperation(primary, rng);
+    }
+    done = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (lost != 0) {
+        return fail("a replica fell a whole ring behind");
+    }
+    if (failed != 0) {
+        return fail("a replica could not apply a change");
+    }
+    for (int i = 0; i < readers; i++) {
+        if (!sameOceans(primary, replicas[i])) {
+            return fail("a replica answers differently from the primary");
+        }
+    }
+
+    // Skipping the first record leaves the replica without the ship
+    OceanFeed small(16);
+    Ocean publisher;
+    Ocean behind;
+    publisher.attachFeed(&small);
+    publisher.add_ship(1, 1);
+    publisher.add_pirate(5, 1, 10);
+    OceanFeed::Reader skipping(small, 1);
+    OceanChange change;
+    if (skipping.poll(change) != OceanFeed::READ || behind.applyChange(change) == StatusType::SUCCESS) {
+        return fail("a replica that missed a record applied the next one");
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int readers = argc > 1 ? atoi(argv[1]) : 3;
+    const uint64_t records = argc > 2 ? strtoull(argv[2], nullptr, 10) : 2000000;
+    const int operations = argc > 3 ? atoi(argv[3]) : 200000;
+    if (!checkPositions() || !checkRacingReaders(readers, records) || !checkReplicas(readers, operations)) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
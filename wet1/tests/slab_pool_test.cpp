@@ -0,0 +1,127 @@
+// Allocation test of the node pools, with malloc interposed to count every
+// call into the system allocator (glibc).
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -Icode tests/slab_pool_test.cpp code/pirates24b1.cpp -o slab_pool_test
+//   ./slab_pool_test [ships] [pirates] [rounds]
+//
+// An ocean sized by its capacity hints is filled, then goes through rounds
+// of removing and re-adding pirates, treason, treasure updates and
+// battles. After one warm-up round the rest must not call malloc at all.
+// Once the ocean is gone the pools must hold no memory, and nodes freed on
+// a thread that then exits must serve the next thread without a new slab.
+// Prints "ok" or what went wrong.
+#include "pirates24b1.h"
+#include "AVL.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* memory, size_t size);
+
+static bool counting = false;
+static size_t mallocCalls = 0;
+
+extern "C" void* malloc(size_t size) {
+    if (counting) mallocCalls++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    if (counting) mallocCalls++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* memory, size_t size) {
+    if (counting) mallocCalls++;
+    return __libc_realloc(memory, size);
+}
+
+static bool fail(const char* what) {
+    printf("FAILED: %s\n", what);
+    return false;
+}
+
+static void roundOfWork(Ocean& ocean, std::mt19937& rng, int ships, int pirates) {
+    for (int i = 0; i < pirates; i++) {
+        const int pirate = static_cast<int>(rng() % pirates) + 1;
+        const int ship = static_cast<int>(rng() % ships) + 1;
+        switch (rng() % 4) {
+            case 0:
+                ocean.remove_pirate(pirate);
+                ocean.add_pirate(pirate, ship, static_cast<int>(rng() % 1000));
+                break;
+            case 1:
+                ocean.treason(ship, static_cast<int>(rng() % ships) + 1);
+                break;
+            case 2:
+                ocean.update_pirate_treasure(pirate, static_cast<int>(rng() % 50) - 25);
+                break;
+            default:
+                ocean.ships_battle(ship, static_cast<int>(rng() % ships) + 1);
+                break;
+        }
+    }
+}
+
+static bool steadyState(int ships, int pirates, int rounds) {
+    {
+        Ocean ocean(ships, pirates);
+        for (int ship = 1; ship <= ships; ship++) {
+            ocean.add_ship(ship, 5);
+        }
+        for (int pirate = 1; pirate <= pirates; pirate++) {
+            ocean.add_pirate(pirate, pirate % ships + 1, pirate % 1000);
+        }
+
+        std::mt19937 rng(1);
+        roundOfWork(ocean, rng, ships, pirates);
+        counting = true;
+        for (int round = 1; round < rounds; round++) {
+            roundOfWork(ocean, rng, ships, pirates);
+        }
+        counting = false;
+        if (mallocCalls != 0) {
+            printf("%zu malloc calls after warm-up\n", mallocCalls);
+            return fail("warm rounds allocated");
+        }
+    }
+    if (AllocationCounters::systemBytes() != 0) return fail("slabs kept after the last user went away");
+    return true;
+}
+
+// Nodes freed on a thread that exits go to the next thread that needs them
+static bool handedOver(int entries) {
+    AVL<int, int> keeper;  // A user throughout, so nothing is released
+    keeper.insert(0, 0);
+    auto fill = [entries] {
+        AVL<int, int> tree;
+        for (int i = 1; i <= entries; i++) {
+            tree.insert(i, i);
+        }
+    };
+    std::thread(fill).join();
+    const size_t slabs = AllocationCounters::systemAllocations();
+    const size_t bytes = AllocationCounters::systemBytes();
+    std::thread(fill).join();
+    if (AllocationCounters::systemAllocations() != slabs || AllocationCounters::systemBytes() != bytes) {
+        return fail("the second thread took new slabs");
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int ships = argc > 1 ? atoi(argv[1]) : 100;
+    const int pirates = argc > 2 ? atoi(argv[2]) : 100000;
+    const int rounds = argc > 3 ? atoi(argv[3]) : 4;
+    if (!steadyState(ships, pirates, rounds)) return 1;
+    if (!handedOver(pirates)) return 1;
+    if (AllocationCounters::systemBytes() != 0) {
+        fail("slabs kept after the last user went away");
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,244 @@
+// treasure_percentile and treasure_histogram against a plain model of the
+// ocean, through every operation that changes a treasure.
+//
+//   g++ -std=c++11 -O2 -Wall -Icode tests/treasure_distribution_test.cpp code/pirates24b1.cpp -o treasure_distribution_test
+//   ./treasure_distribution_test [ships] [operations]
+//
+// The model keeps each crew as a list of (ID, treasure) in arrival order
+// and each alliance as a label. Crews grow well past the size at which a
+// battle leaves a ship floating, and ship IDs are reused after removal.
+// After every operation a random percentile and a random histogram are
+// checked against the sorted treasures. Prints "ok" or what went wrong.
+#include "pirates24b1.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+struct ModelShip {
+    int cannons;
+    int alliance;
+    std::vector<std::pair<int, int>> crew;  // (ID, treasure), oldest first
+};
+
+typedef std::map<int, ModelShip> Model;
+
+static bool fail(int step, const char* what) {
+    printf("FAILED: %s at step %d\n", what, step);
+    return false;
+}
+
+static void addToCrew(std::vector<std::pair<int, int>>& crew, int amount) {
+    for (std::pair<int, int>& pirate : crew) {
+        pirate.second += amount;
+    }
+}
+
+// Resolves a battle between two sides of the given sizes and powers: each
+// pirate of the winners gains the losers' pirates, each loser loses the
+// winners'. Returns the changes for side 1 and side 2.
+static std::pair<int, int> battle(int pirates1, int power1, int pirates2, int power2) {
+    if (power1 == power2) {
+        return std::make_pair(0, 0);
+    }
+    return power1 > power2 ? std::make_pair(pirates2, -pirates1) : std::make_pair(-pirates2, pirates1);
+}
+
+static void allianceTotals(const Model& model, int alliance, int& cannons, int& pirates) {
+    cannons = 0;
+    pirates = 0;
+    for (const auto& ship : model) {
+        if (ship.second.alliance == alliance) {
+            cannons += ship.second.cannons;
+            pirates += static_cast<int>(ship.second.crew.size());
+        }
+    }
+}
+
+static bool checkQueries(Ocean& ocean, const Model& model, std::mt19937& rng, int step) {
+    std::vector<int> treasures;
+    for (const auto& ship : model) {
+        for (const std::pair<int, int>& pirate : ship.second.crew) {
+            treasures.push_back(pirate.second);
+        }
+    }
+    std::sort(treasures.begin(), treasures.end());
+
+    const int percentile = static_cast<int>(rng() % 101);
+    output_t<int> answer = ocean.treasure_percentile(percentile);
+    if (treasures.empty()) {
+        if (answer.status() != StatusType::FAILURE) {
+            return fail(step, "percentile of an empty ocean");
+        }
+    } else {
+        const long long n = treasures.size();
+        const long long rank = std::max((percentile * n + 99) / 100, 1LL);
+        if (answer.status() != StatusType::SUCCESS || answer.ans() != treasures[rank - 1]) {
+            return fail(step, "wrong percentile");
+        }
+    }
+
+    std::vector<int> bounds;
+    const int boundCount = static_cast<int>(rng() % 5);
+    for (int i = 0; i < boundCount; i++) {
+        bounds.push_back(static_cast<int>(rng() % 4001) - 2000);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    std::vector<int> counts;
+    if (ocean.treasure_histogram(bounds, counts) != StatusType::SUCCESS || counts.size() != bounds.size() + 1) {
+        return fail(step, "histogram failed");
+    }
+    int below = 0;
+    for (size_t i = 0; i <= bounds.size(); i++) {
+        const int belowBound = i < bounds.size()
+            ? static_cast<int>(std::lower_bound(treasures.begin(), treasures.end(), bounds[i]) - treasures.begin())
+            : static_cast<int>(treasures.size());
+        if (counts[i] != belowBound - below) {
+            return fail(step, "wrong histogram");
+        }
+        below = belowBound;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int ships = argc > 1 ? atoi(argv[1]) : 8;
+    const int operations = argc > 2 ? atoi(argv[2]) : 20000;
+
+    Ocean ocean;
+    Model model;
+    std::mt19937 rng(5);
+    int nextPirate = 1;
+    int nextAlliance = 1;
+    for (int shipId = 1; shipId <= ships; shipId++) {
+        const int cannons = static_cast<int>(rng() % 200);
+        ocean.add_ship(shipId, cannons);
+        model[shipId] = ModelShip{cannons, nextAlliance++, {}};
+    }
+
+    for (int step = 0; step < operations; step++) {
+        const int shipId1 = static_cast<int>(rng() % ships) + 1;
+        const int shipId2 = static_cast<int>(rng() % ships) + 1;
+        auto ship1 = model.find(shipId1);
+        auto ship2 = model.find(shipId2);
+        const bool both = ship1 != model.end() && ship2 != model.end() && shipId1 != shipId2;
+
+        switch (rng() % 12) {
+            case 0:
+            case 1:
+            case 2:
+                if (ship1 != model.end()) {
+                    const int treasure = static_cast<int>(rng() % 1001) - 500;
+                    ocean.add_pirate(nextPirate, shipId1, treasure);
+                    ship1->second.crew.push_back(std::make_pair(nextPirate++, treasure));
+                }
+                break;
+            case 3:
+                if (ship1 != model.end() && !ship1->second.crew.empty()) {
+                    std::vector<std::pair<int, int>>& crew = ship1->second.crew;
+                    const size_t k = rng() % crew.size();
+                    ocean.remove_pirate(crew[k].first);
+                    crew.erase(crew.begin() + k);
+                }
+                break;
+            case 4:
+                if (both && !ship1->second.crew.empty()) {
+                    ocean.treason(shipId1, shipId2);
+                    ship2->second.crew.push_back(ship1->second.crew.front());
+                    ship1->second.crew.erase(ship1->second.crew.begin());
+                }
+                break;
+            case 5:
+                if (ship1 != model.end() && !ship1->second.crew.empty()) {
+                    std::pair<int, int>& pirate = ship1->second.crew[rng() % ship1->second.crew.size()];
+                    const int change = static_cast<int>(rng() % 101) - 50;
+                    ocean.update_pirate_treasure(pirate.first, change);
+                    pirate.second += change;
+                }
+                break;
+            case 6:
+            case 7:
+                if (both) {
+                    ocean.ships_battle(shipId1, shipId2);
+                    const int pirates1 = static_cast<int>(ship1->second.crew.size());
+                    const int pirates2 = static_cast<int>(ship2->second.crew.size());
+                    const std::pair<int, int> change = battle(pirates1, std::min(ship1->second.cannons, pirates1),
+                                                              pirates2, std::min(ship2->second.cannons, pirates2));
+                    addToCrew(ship1->second.crew, change.first);
+                    addToCrew(ship2->second.crew, change.second);
+                }
+                break;
+            case 8:
+                if (ship1 != model.end() && !ship1->second.crew.empty()) {
+                    std::vector<std::pair<int, int>>& crew = ship1->second.crew;
+                    const int first = static_cast<int>(rng() % crew.size()) + 1;
+                    const int last = first + static_cast<int>(rng() % (crew.size() - first + 1));
+                    const int amount = static_cast<int>(rng() % 41) - 20;
+                    ocean.add_treasure_range(shipId1, first, last, amount);
+                    if (amount != 0) {
+                        for (int i = first; i <= last; i++) {
+                            crew[i - 1].second += amount;
+                        }
+                    }
+                }
+                break;
+            case 9:
+                if (both && rng() % 4 == 0) {
+                    ocean.merge_ships(shipId1, shipId2);
+                    std::vector<std::pair<int, int>>& source = ship1->second.crew;
+                    ship2->second.crew.insert(ship2->second.crew.end(), source.begin(), source.end());
+                    source.clear();
+                }
+                break;
+            case 10:
+                if (both && ship1->second.alliance != ship2->second.alliance) {
+                    if (rng() % 3 == 0) {
+                        ocean.form_alliance(shipId1, shipId2);
+                        const int from = ship2->second.alliance;
+                        for (auto& ship : model) {
+                            if (ship.second.alliance == from) {
+                                ship.second.alliance = ship1->second.alliance;
+                            }
+                        }
+                    } else {
+                        ocean.alliance_battle(shipId1, shipId2);
+                        int cannons1, pirates1, cannons2, pirates2;
+                        allianceTotals(model, ship1->second.alliance, cannons1, pirates1);
+                        allianceTotals(model, ship2->second.alliance, cannons2, pirates2);
+                        const std::pair<int, int> change = battle(pirates1, std::min(cannons1, pirates1),
+                                                                  pirates2, std::min(cannons2, pirates2));
+                        const int alliance1 = ship1->second.alliance;
+                        const int alliance2 = ship2->second.alliance;
+                        for (auto& ship : model) {
+                            if (ship.second.alliance == alliance1) {
+                                addToCrew(ship.second.crew, change.first);
+                            } else if (ship.second.alliance == alliance2) {
+                                addToCrew(ship.second.crew, change.second);
+                            }
+                        }
+                    }
+                }
+                break;
+            default:
+                // Empties a ship and puts a new one under its ID
+                if (ship1 != model.end() && rng() % 8 == 0) {
+                    for (const std::pair<int, int>& pirate : ship1->second.crew) {
+                        ocean.remove_pirate(pirate.first);
+                    }
+                    ocean.remove_ship(shipId1);
+                    const int cannons = static_cast<int>(rng() % 200);
+                    ocean.add_ship(shipId1, cannons);
+                    ship1->second = ModelShip{cannons, nextAlliance++, {}};
+                }
+                break;
+        }
+        if (!checkQueries(ocean, model, rng, step)) {
+            return 1;
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Bounded broadcast ring of change records: one writer, any number of
+// readers, no locks. Each reader keeps its own position, so readers never
+// contend with each other or hold the writer up.
+//
+// The writer never waits either: once the ring is full, publish()
+// overwrites the oldest record. Every slot carries the sequence number of
+// the record in it, odd while it is being written, and a reader checks it
+// before and after copying the record out; a reader that fell a whole ring
+// behind sees the sequence move on and gets LOST instead of a torn record.
+// Record words are relaxed atomics, so the copy is race-free.
+template <class Record>
+class ChangeFeed {
+private:
+    static_assert(std::is_trivially_copyable<Record>::value && sizeof(Record) % sizeof(uint32_t) == 0,
+                  "records are copied word by word");
+    static const size_t words_per_record = sizeof(Record) / sizeof(uint32_t);
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;  // 2n + 2 once record n is in, 2n + 1 while writing it
+        std::atomic<uint32_t> words[words_per_record];
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+    std::atomic<uint64_t> published{0};  // Records published so far
+
+    static size_t round_up(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size *= 2;
+        return size;
+    }
+
+public:
+    enum ReadStatus { READ, EMPTY, LOST };
+
+    // Keeps the last capacity records, rounded up to a power of two
+    explicit ChangeFeed(size_t capacity) : slots(round_up(capacity)), mask(slots.size() - 1) {
+        for (Slot& slot : slots) slot.sequence.store(0, std::memory_order_relaxed);
+    }
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    size_t capacity() const { return slots.size(); }
+
+    // Sequence number the next record will get
+    uint64_t head() const { return published.load(std::memory_order_acquire); }
+
+    // Only ever called from one thread at a time
+    void publish(const Record& record) {
+        const uint64_t n = published.load(std::memory_order_relaxed);
+        Slot& slot = slots[n & mask];
+        uint32_t words[words_per_record];
+        std::memcpy(words, &record, sizeof(Record));
+
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < words_per_record; ++i) {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.sequence.store(2 * n + 2, std::memory_order_release);
+        published.store(n + 1, std::memory_order_release);
+    }
+
+    // Copies record n into out: EMPTY if it is not published yet, LOST if
+    // it has already been overwritten. Safe from any number of threads.
+    ReadStatus read(uint64_t n, Record& out) const {
+        if (n >= head()) return EMPTY;
+        const Slot& slot = slots[n & mask];
+        const uint64_t expected = 2 * n + 2;
+        if (slot.sequence.load(std::memory_order_acquire) != expected) return LOST;
+
+        uint32_t words[words_per_record];
+        for (size_t i = 0; i < words_per_record; ++i) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != expected) return LOST;
+        std::memcpy(&out, words, sizeof(Record));
+        return READ;
+    }
+
+    // One reader's position in the feed. A reader that gets LOST has
+    // missed records for good and has to start over from a fresh copy.
+    class Reader {
+    private:
+        const ChangeFeed& feed;
+        uint64_t position;
+
+    public:
+        // Starts at the next record to be published
+        explicit Reader(const ChangeFeed& feed) : feed(feed), position(feed.head()) {}
+        Reader(const ChangeFeed& feed, uint64_t position) : feed(feed), position(position) {}
+
+        uint64_t next() const { return position; }
+
+        ReadStatus poll(Record& out) {
+            const ReadStatus status = feed.read(position, out);
+            if (status == READ) ++position;
+            return status;
+        }
+    };
+};
+
+// One successful change to an oceans_t, as the primary made it: the
+// arguments, plus what the primary worked out, so a replica applying it
+// can tell whether it came out the same. Fields by op:
+//
+//   ADD_FLEET        fleet ID
+//   ADD_PIRATE       pirate ID, fleet ID, rank given
+//   PAY_PIRATE       pirate ID, salary, stored balance after
+//   UNITE_FLEETS     fleet ID 1, fleet ID 2, ID of the fleet kept as root
+//   PIRATE_ARGUMENT  pirate ID 1, pirate ID 2, money pirate 1 gained
+//   PAY_FLEET        fleet ID, amount
+//   CHECKPOINT, ROLLBACK, COMMIT   no fields
+//
+// Queries are not published, so a replica sees what-if changes and their
+// rollback like any other change.
+struct FleetChange {
+    enum Op { ADD_FLEET, ADD_PIRATE, PAY_PIRATE, UNITE_FLEETS, PIRATE_ARGUMENT, PAY_FLEET,
+              CHECKPOINT, ROLLBACK, COMMIT, NONE = -1 };
+
+    int32_t op;
+    int32_t args[3];
+
+    bool operator==(const FleetChange& other) const {
+        return op == other.op && std::memcmp(args, other.args, sizeof(args)) == 0;
+    }
+};
+
+typedef ChangeFeed<FleetChange> FleetFeed;
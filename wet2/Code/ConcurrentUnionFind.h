@@ -0,0 +1,308 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Lock-free variant of UnionFind for merging fleets from several threads.
+//
+// Every slot is a single 64-bit word updated only by CAS. The top two bits
+// tell the layouts apart:
+//   CHILD:     parent and rank offset relative to the parent
+//   ROOT:      number of ships and number of pirates
+//   FROZEN:    a root being linked under another root, with its link
+//   ABSORBING: a root taking in a FROZEN one, with that link
+// A link is a descriptor: both slots and the ROOT words they were linked
+// from, plus a status that is decided once, by CAS, as DONE or ABORTED.
+// Nothing ever waits for the thread that started a link. Whoever meets a
+// FROZEN or ABSORBING word moves its link along: CAS the primary from its
+// recorded word to ABSORBING, decide, then CAS both words to the result
+// (CHILD under the primary with the primary's old pirate count as offset,
+// and ROOT with both counts) or back to where they were. The link takes
+// effect when its status is decided, and every reader of either word
+// decides it first, so counts and offsets are always seen in agreement.
+//
+// Two links may freeze each other's primary (a into b while b into a).
+// The one whose secondary has the lower slot aborts the other, so one of
+// them always completes.
+//
+// The offset between a slot and any of its ancestors never changes once
+// set, so find halves paths concurrently with unions: re-pointing x at its
+// grandparent with the two offsets summed is valid whenever it lands.
+//
+// Descriptors are never reused; each costs 32 bytes until destruction,
+// one per link plus one per aborted attempt.
+class ConcurrentUnionFind {
+public:
+    // How a successful link_roots came out. Links are numbered in an order
+    // in which applying them one by one to a sequential UnionFind gives
+    // this structure: a link into a root is numbered after every link that
+    // root took part in before.
+    struct Link {
+        int primary;
+        int secondary;
+        int offset;         // primary's pirates before the link
+        int64_t sequence;
+    };
+
+private:
+    enum : uint64_t { CHILD = 0, ROOT = 1, FROZEN = 2, ABSORBING = 3 };
+    static const uint64_t FIELD = (1ull << 31) - 1;
+    static const int64_t PENDING = -1;
+    static const int64_t ABORTED = -2;
+    static const int BLOCK_BITS = 10;
+    static const int BLOCKS = 48;
+
+    struct Descriptor {
+        int secondary;
+        int primary;
+        uint64_t secondary_word;  // ROOT words both were linked from
+        uint64_t primary_word;
+        std::atomic<int64_t> status;  // PENDING, ABORTED or the sequence
+    };
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    std::atomic<int> used{0};
+    const int capacity;
+
+    // Block b holds the descriptors from (2^b - 1) << BLOCK_BITS on, twice
+    // as many as block b - 1, and is allocated by whoever first needs it
+    std::atomic<Descriptor*> blocks[BLOCKS];
+    std::atomic<uint64_t> descriptors{0};
+    std::atomic<int64_t> sequence{0};
+
+    static uint64_t pack(uint64_t tag, uint64_t high, uint64_t low) { return tag << 62 | high << 31 | low; }
+    static uint64_t tag_of(uint64_t word) { return word >> 62; }
+    static int high_of(uint64_t word) { return static_cast<int>(word >> 31 & FIELD); }
+    static int low_of(uint64_t word) { return static_cast<int>(word & FIELD); }
+    static uint64_t index_of(uint64_t word) { return word & ~(3ull << 62); }
+
+    static int block_of(uint64_t index) {
+        return 63 - __builtin_clzll((index >> BLOCK_BITS) + 1);
+    }
+    static uint64_t block_start(int block) { return ((1ull << block) - 1) << BLOCK_BITS; }
+
+    Descriptor& descriptor(uint64_t index) {
+        const int block = block_of(index);
+        return blocks[block].load(std::memory_order_acquire)[index - block_start(block)];
+    }
+
+    uint64_t new_descriptor() {
+        const uint64_t index = descriptors.fetch_add(1);
+        const int block = block_of(index);
+        if (!blocks[block].load(std::memory_order_acquire)) {
+            Descriptor* fresh = new Descriptor[(1ull << block) << BLOCK_BITS];
+            Descriptor* expected = nullptr;
+            if (!blocks[block].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) {
+                delete[] fresh;
+            }
+        }
+        return index;
+    }
+
+    // Moves the words of a decided link to their final values. Each CAS
+    // only succeeds for the first thread to get there.
+    void finish(uint64_t index) {
+        Descriptor& link = descriptor(index);
+        const int64_t status = link.status.load(std::memory_order_acquire);
+        uint64_t frozen = pack(FROZEN, 0, 0) | index;
+        uint64_t absorbing = pack(ABSORBING, 0, 0) | index;
+        if (status == ABORTED) {
+            words[link.secondary].compare_exchange_strong(frozen, link.secondary_word, std::memory_order_acq_rel);
+            words[link.primary].compare_exchange_strong(absorbing, link.primary_word, std::memory_order_acq_rel);
+        } else {
+            const uint64_t s = link.secondary_word;
+            const uint64_t p = link.primary_word;
+            words[link.secondary].compare_exchange_strong(frozen, pack(CHILD, link.primary, low_of(p)),
+                                                          std::memory_order_acq_rel);
+            words[link.primary].compare_exchange_strong(
+                absorbing, pack(ROOT, high_of(p) + high_of(s), low_of(p) + low_of(s)),
+                std::memory_order_acq_rel);
+        }
+    }
+
+    // Decides a link whose primary is ABSORBING it as DONE, numbering it
+    // after every link decided before the primary was seen absorbing
+    void decide_done(Descriptor& link) {
+        int64_t status = PENDING;
+        link.status.compare_exchange_strong(status, sequence.fetch_add(1), std::memory_order_acq_rel);
+    }
+
+    // False if the link was decided as DONE first
+    bool decide_aborted(Descriptor& link) {
+        int64_t status = PENDING;
+        return link.status.compare_exchange_strong(status, ABORTED, std::memory_order_acq_rel) ||
+               status == ABORTED;
+    }
+
+    // Carries a published link through to its final words
+    void help(uint64_t index) {
+        Descriptor& link = descriptor(index);
+        const uint64_t absorbing = pack(ABSORBING, 0, 0) | index;
+        while (link.status.load(std::memory_order_acquire) == PENDING) {
+            uint64_t word = words[link.primary].load(std::memory_order_acquire);
+            if (word == absorbing) {
+                decide_done(link);
+            } else if (word == link.primary_word) {
+                words[link.primary].compare_exchange_strong(word, absorbing, std::memory_order_acq_rel);
+            } else if (tag_of(word) == FROZEN) {
+                // The primary is itself being linked: the lower secondary wins
+                const uint64_t other = index_of(word);
+                Descriptor& rival = descriptor(other);
+                if (link.secondary < rival.secondary && decide_aborted(rival)) {
+                    finish(other);
+                } else if (rival.status.load(std::memory_order_acquire) != PENDING) {
+                    finish(other);
+                } else {
+                    decide_aborted(link);
+                }
+            } else if (tag_of(word) == ABSORBING) {
+                // Another link into the primary got there first
+                const uint64_t other = index_of(word);
+                decide_done(descriptor(other));
+                finish(other);
+            } else {
+                decide_aborted(link);
+            }
+        }
+        finish(index);
+    }
+
+    // Loads a slot's word, first finishing any link it is part of
+    uint64_t settled(int slot) {
+        uint64_t word = words[slot].load(std::memory_order_acquire);
+        while (tag_of(word) >= FROZEN) {
+            help(index_of(word));
+            word = words[slot].load(std::memory_order_acquire);
+        }
+        return word;
+    }
+
+public:
+    explicit ConcurrentUnionFind(int capacity)
+        : words(new std::atomic<uint64_t>[capacity]), capacity(capacity) {
+        for (std::atomic<Descriptor*>& block : blocks) block.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~ConcurrentUnionFind() {
+        for (std::atomic<Descriptor*>& block : blocks) delete[] block.load(std::memory_order_relaxed);
+    }
+
+    ConcurrentUnionFind(const ConcurrentUnionFind&) = delete;
+    ConcurrentUnionFind& operator=(const ConcurrentUnionFind&) = delete;
+
+    // Claims a fresh singleton slot with the given counts; -1 when full
+    int make_set(int ships = 1, int pirates = 0) {
+        const int slot = used.fetch_add(1);
+        if (slot >= capacity) {
+            used.fetch_sub(1);
+            return -1;
+        }
+        words[slot].store(pack(ROOT, ships, pirates), std::memory_order_release);
+        return slot;
+    }
+
+    bool is_root(int slot) { return tag_of(settled(slot)) == ROOT; }
+
+    // Returns the root of slot and the slot's rank offset relative to it.
+    int find(int slot, int& offset) {
+        offset = 0;
+        uint64_t word = settled(slot);
+        while (tag_of(word) == CHILD) {
+            const int p = high_of(word);
+            const uint64_t parent_word = settled(p);
+            if (tag_of(parent_word) == CHILD) {
+                const int skipped = low_of(word) + low_of(parent_word);
+                // A failed CAS only means someone else already shortened it
+                words[slot].compare_exchange_weak(word, pack(CHILD, high_of(parent_word), skipped),
+                                                  std::memory_order_acq_rel);
+                offset += skipped;
+                slot = high_of(parent_word);
+                word = settled(slot);
+            } else {
+                offset += low_of(word);
+                slot = p;
+                word = parent_word;
+            }
+        }
+        return slot;
+    }
+
+    int find(int slot) {
+        int offset;
+        return find(slot, offset);
+    }
+
+    // True when both slots are in one set, together with their offsets
+    // relative to a common root. A "no" is linearized at the moment the
+    // first root is seen to still be a root with no link in progress.
+    bool same_set(int slot1, int slot2, int& offset1, int& offset2) {
+        while (true) {
+            const int root1 = find(slot1, offset1);
+            const int root2 = find(slot2, offset2);
+            if (root1 == root2) return true;
+            if (is_root(root1)) return false;
+        }
+    }
+
+    // Counts of a root; 0 once the slot is no longer one
+    int num_pirates(int root) {
+        const uint64_t word = settled(root);
+        return tag_of(word) == ROOT ? low_of(word) : 0;
+    }
+
+    int num_ships(int root) {
+        const uint64_t word = settled(root);
+        return tag_of(word) == ROOT ? high_of(word) : 0;
+    }
+
+    // Adds a pirate to a root set and returns its rank, or 0 if the slot
+    // is no longer a root.
+    int add_pirate(int root) {
+        while (true) {
+            uint64_t word = settled(root);
+            if (tag_of(word) != ROOT) return 0;
+            if (words[root].compare_exchange_weak(word, pack(ROOT, high_of(word), low_of(word) + 1),
+                                                  std::memory_order_acq_rel)) {
+                return low_of(word) + 1;
+            }
+        }
+    }
+
+    // Links two roots with at least one pirate each, the one with more
+    // pirates becoming the primary and slot1 on a tie, as unite_fleets
+    // does. Fails if either slot is not a root, empty, or both are the
+    // same slot; on success fills in *result if given.
+    bool link_roots(int slot1, int slot2, Link* result = nullptr) {
+        if (slot1 == slot2) return false;
+        uint64_t index = 0;
+        bool unpublished = false;
+        while (true) {
+            const uint64_t word1 = settled(slot1);
+            const uint64_t word2 = settled(slot2);
+            if (tag_of(word1) != ROOT || tag_of(word2) != ROOT) return false;
+            if (low_of(word1) == 0 || low_of(word2) == 0) return false;
+
+            const bool first_is_primary = low_of(word1) >= low_of(word2);
+            if (!unpublished) index = new_descriptor();
+            unpublished = true;
+            Descriptor& link = descriptor(index);
+            link.primary = first_is_primary ? slot1 : slot2;
+            link.secondary = first_is_primary ? slot2 : slot1;
+            link.primary_word = first_is_primary ? word1 : word2;
+            link.secondary_word = first_is_primary ? word2 : word1;
+            link.status.store(PENDING, std::memory_order_relaxed);
+
+            uint64_t expected = link.secondary_word;
+            if (!words[link.secondary].compare_exchange_strong(expected, pack(FROZEN, 0, 0) | index,
+                                                               std::memory_order_acq_rel)) {
+                continue;
+            }
+            unpublished = false;
+            help(index);
+            const int64_t status = link.status.load(std::memory_order_acquire);
+            if (status == ABORTED) continue;
+            if (result) *result = {link.primary, link.secondary, low_of(link.primary_word), status};
+            return true;
+        }
+    }
+};
@@ -1,28 +1,37 @@
 #pragma once
-#include "HashTable.h"
-#include <memory>
+#include "MemoryUsage.h"
+#include <cstdint>
 
 class Pirate {
 public:
     const int pirate_id;
     const int rank;
-    int money;
-    const int fleet_id;
+    int money; // Balance excluding fleet-wide payments, see UnionFind
+    const int fleet_slot; // Union-Find slot of the fleet the pirate joined
+    // Circular list of the pirates of one root fleet, linked by handle in
+    // the pirate table (see MappedHashTable) so that it survives the table
+    // growing and a reopen. oceans_t points a new pirate at itself once it
+    // is stored.
+    uint32_t next_member;
 
-    Pirate(int id, int r, int f_id)
-        : pirate_id(id), rank(r), money(0), fleet_id(f_id) {}
+    Pirate(int id, int r, int slot)
+        : pirate_id(id), rank(r), money(0), fleet_slot(slot), next_member(0) {}
 };
 
-class Fleet : public std::enable_shared_from_this<Fleet> {
+class Fleet {
 public:
     const int fleet_id;
-    size_t num_ships;
-    size_t num_pirates;
-    HashTable<int, Pirate> fleet_pirates;
+    const int slot; // Index into oceans_t::fleet_sets
 
-    std::weak_ptr<Fleet> next; // Use weak_ptr to avoid cycles
-    int extra_rank;
+    Fleet(int id, int s)
+        : fleet_id(id), slot(s) {}
 
-    Fleet(int id)
-        : fleet_id(id), num_ships(1), num_pirates(0), extra_rank(0) {}
+    // Just the record: the pirates, heap and member list of a fleet belong
+    // to its root set and are counted by oceans_t::memory_usage, and the
+    // hash node holding the record by its table.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage;
+        usage.payload = sizeof(Fleet);
+        return usage;
+    }
 };
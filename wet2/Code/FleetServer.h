@@ -0,0 +1,66 @@
+#pragma once
+#include "pirates24b2.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Wire format of the fleet server (Server/fleet_server.cpp). Both frames
+// are packed int32 fields in the host's byte order, which is fine because
+// the socket is local.
+//
+//   request  (12 bytes): op, arg1, arg2   with op a FleetCommand::Op value
+//   response  (8 bytes): status, ans      with status a StatusType value
+//
+// Requests are answered in the order they were sent.
+struct FleetWire {
+    static const size_t request_size = 12;
+    static const size_t response_size = 8;
+
+    static void put_request(char* frame, int32_t op, int32_t arg1, int32_t arg2) {
+        const int32_t fields[3] = {op, arg1, arg2};
+        std::memcpy(frame, fields, sizeof(fields));
+    }
+
+    static void get_response(const char* frame, int32_t& status, int32_t& ans) {
+        int32_t fields[2];
+        std::memcpy(fields, frame, sizeof(fields));
+        status = fields[0];
+        ans = fields[1];
+    }
+};
+
+// Runs each batch the server collects through oceans_t::replay
+class FleetEngine {
+private:
+    oceans_t& ocean;
+    std::vector<FleetCommand> commands;
+    std::vector<FleetResult> results;
+
+public:
+    static const size_t request_size = FleetWire::request_size;
+    static const size_t response_size = FleetWire::response_size;
+
+    explicit FleetEngine(oceans_t& ocean) : ocean(ocean) {}
+
+    void execute(const char* requests, size_t count, char* responses) {
+        commands.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            int32_t fields[3];
+            std::memcpy(fields, requests + i * request_size, sizeof(fields));
+            FleetCommand& command = commands[i];
+            if (fields[0] >= FleetCommand::ADD_FLEET && fields[0] <= FleetCommand::GET_RICHEST_PIRATE) {
+                command = {static_cast<FleetCommand::Op>(fields[0]), fields[1], fields[2]};
+            } else {
+                // Unknown op: a fleet ID of 0 gets INVALID_INPUT and changes nothing
+                command = {FleetCommand::ADD_FLEET, 0, 0};
+            }
+        }
+
+        ocean.replay(commands, results);
+
+        for (size_t i = 0; i < count; ++i) {
+            const int32_t fields[2] = {static_cast<int32_t>(results[i].status), results[i].ans};
+            std::memcpy(responses + i * response_size, fields, sizeof(fields));
+        }
+    }
+};
@@ -1,66 +1,175 @@
 #pragma once
-#include <memory>
+#include "MemoryUsage.h"
+#include "SlabPool.h"
 #include <vector>
+#include <algorithm>
+#include <utility>
+
+#if defined(__GNUC__)
+#define HASH_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define HASH_PREFETCH(addr) ((void)0)
+#endif
 
 template <class K, class T>
 class HashTable {
 private:
     struct Node {
         K key;
-        std::shared_ptr<T> data;
-        std::shared_ptr<Node> next;
-        Node(K k, std::shared_ptr<T> d) : key(k), data(d), next(nullptr) {}
+        T data; // Stored inline; nodes are never copied, so it never moves
+        Node* next;
+
+        template <class... Args>
+        Node(K k, Args&&... args) : key(k), data(std::forward<Args>(args)...), next(nullptr) {}
     };
 
-    std::vector<std::shared_ptr<Node>> table;
+    Node* find_node(const K& key) const {
+        Node* node = table[hash(key)];
+        while (node && node->key != key) {
+            node = node->next;
+        }
+        return node;
+    }
+
+    // Nodes come from a pool shared by every table of this K and T
+    static SlabPool<Node>& pool() { return SlabPool<Node>::instance(); }
+
+    SlabPools::User pool_user;  // Outlives the nodes, see SlabPools
+    std::vector<Node*> table;
     size_t num_elements;
 
     size_t hash(const K& key) const { return key % table.size(); }
 
-    void resize() {
-        size_t new_size = table.size() * 2;
-        std::vector<std::shared_ptr<Node>> new_table(new_size);
+    // Moves every node into a table of new_size buckets. Nodes are relinked,
+    // not copied, so no allocation happens besides the bucket array.
+    void rehash(size_t new_size) {
+        std::vector<Node*> new_table(new_size);
 
-        for (auto& head : table) {
-            auto node = head;
+        for (Node* head : table) {
+            Node* node = head;
             while (node) {
+                Node* next = node->next;
                 size_t idx = node->key % new_size;
-                auto new_node = std::make_shared<Node>(node->key, node->data);
-                new_node->next = new_table[idx];
-                new_table[idx] = new_node;
-                node = node->next;
+                node->next = new_table[idx];
+                new_table[idx] = node;
+                node = next;
             }
         }
         table = std::move(new_table);
     }
 
+    void resize() { rehash(table.size() * 2); }
+
 public:
     HashTable(size_t initial_size = 4) : table(initial_size), num_elements(0) {}
 
-    std::shared_ptr<T> find(const K& key) const {
-        size_t idx = hash(key);
-        auto node = table[idx];
-        while (node) {
-            if (node->key == key) return node->data;
-            node = node->next;
+    ~HashTable() {
+        for (Node* node : table) {
+            while (node) {
+                Node* next = node->next;
+                pool().destroy(node);
+                node = next;
+            }
         }
-        return nullptr;
     }
 
-    void insert(const K& key, std::shared_ptr<T> data) {
-        if (num_elements + 1 > table.size()) resize();
-        size_t idx = hash(key);
-        auto node = table[idx];
-        while (node) {
-            if (node->key == key) {
-                node->data = data;
-                return;
+    HashTable(const HashTable&) = delete;
+    HashTable& operator=(const HashTable&) = delete;
+
+    size_t size() const { return num_elements; }
+
+    // Keys and values are the payload, the chain link and padding of each
+    // pool block node overhead; the bucket array counts on its own.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage;
+        usage.payload = num_elements * (sizeof(K) + sizeof(T));
+        usage.node = num_elements * SlabPool<Node>::block_size() - usage.payload;
+        usage.add_vector(table, usage.buckets);
+        return usage;
+    }
+
+    // Makes room for n elements up front, so inserting them never resizes
+    // and, once the node pool holds them too, never allocates.
+    // Grows at least geometrically, so calling it per batch stays amortized.
+    void reserve(size_t n) {
+        if (n > table.size()) rehash(std::max(n, table.size() * 2));
+        if (n > num_elements) pool().reserve(n - num_elements);
+    }
+
+    // Points into the table; stays valid until the key is removed.
+    T* find(const K& key) const {
+        Node* node = find_node(key);
+        return node ? &node->data : nullptr;
+    }
+
+    // Looks up count keys at once, writing find(keys[i]) into out[i].
+    // Each group first prefetches its buckets, then the chain heads, and
+    // only then walks the chains, so the misses overlap instead of queueing.
+    void find_batch(const K* keys, size_t count, T** out) const {
+        const size_t GROUP = 16;
+        Node* heads[GROUP];
+
+        for (size_t base = 0; base < count; base += GROUP) {
+            const size_t size = std::min(GROUP, count - base);
+
+            for (size_t i = 0; i < size; ++i) {
+                HASH_PREFETCH(&table[hash(keys[base + i])]);
+            }
+            for (size_t i = 0; i < size; ++i) {
+                heads[i] = table[hash(keys[base + i])];
+                if (heads[i]) HASH_PREFETCH(heads[i]);
+            }
+            for (size_t i = 0; i < size; ++i) {
+                Node* node = heads[i];
+                while (node && node->key != keys[base + i]) {
+                    node = node->next;
+                }
+                out[base + i] = node ? &node->data : nullptr;
             }
-            node = node->next;
         }
-        auto new_node = std::make_shared<Node>(key, data);
+    }
+
+    // Constructs the value in place from args unless key is present.
+    // Returns the stored value and whether it was inserted.
+    template <class... Args>
+    std::pair<T*, bool> try_emplace(const K& key, Args&&... args) {
+        Node* existing = find_node(key);
+        if (existing) return std::make_pair(&existing->data, false);
+
+        if (num_elements + 1 > table.size()) resize();
+        size_t idx = hash(key);
+        Node* new_node = pool().create(key, std::forward<Args>(args)...);
         new_node->next = table[idx];
         table[idx] = new_node;
         ++num_elements;
+        return std::make_pair(&new_node->data, true);
+    }
+
+    template <class... Args>
+    std::pair<T*, bool> emplace(const K& key, Args&&... args) {
+        return try_emplace(key, std::forward<Args>(args)...);
+    }
+
+    template <class V>
+    std::pair<T*, bool> insert_or_assign(const K& key, V&& data) {
+        auto result = try_emplace(key, std::forward<V>(data));
+        if (!result.second) *result.first = std::forward<V>(data);
+        return result;
+    }
+
+    void insert(const K& key, const T& data) { insert_or_assign(key, data); }
+
+    void remove(const K& key) {
+        Node** link = &table[hash(key)];
+        while (*link) {
+            if ((*link)->key == key) {
+                Node* doomed = *link;
+                *link = doomed->next;
+                pool().destroy(doomed);
+                --num_elements;
+                return;
+            }
+            link = &(*link)->next;
+        }
     }
 };
@@ -0,0 +1,131 @@
+#pragma once
+#include "MemoryUsage.h"
+#include "SlabPool.h"
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Persistent max leftist heap over (key, id) pairs, ties going to the
+// larger id. Nodes are never changed once built and are shared between
+// versions, so copying a heap is O(1) and an old copy stays valid after
+// the original changes.
+//
+// add_all shifts every key by the same amount in O(1): the root gets a
+// lazy tag that is pushed into fresh copies of the children whenever the
+// root is taken apart by meld or pop.
+template <class T>
+class LeftistHeap {
+private:
+    struct Node;
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    struct Node {
+        const int key;
+        const int id;
+        const T item;
+        const int tag;  // pending shift for both children
+        const int dist; // null-path length
+        NodePtr left;   // only moved from by the destructor
+        NodePtr right;
+
+        Node(int k, int i, const T& it, int t, int d, NodePtr l, NodePtr r)
+            : key(k), id(i), item(it), tag(t), dist(d), left(l), right(r) {}
+
+        // The left spine can be as long as the heap, so unshared children
+        // are handed to one draining loop per thread instead of being
+        // destroyed recursively. The stack keeps its capacity, so a warm
+        // heap frees nodes without allocating.
+        ~Node() {
+            static thread_local std::vector<NodePtr> doomed;
+            static thread_local bool draining = false;
+            detach(left, doomed);
+            detach(right, doomed);
+            if (draining) return;
+
+            draining = true;
+            while (!doomed.empty()) {
+                NodePtr node = std::move(doomed.back());
+                doomed.pop_back();
+            }
+            draining = false;
+        }
+
+        static void detach(NodePtr& child, std::vector<NodePtr>& doomed) {
+            if (child && child.use_count() == 1) doomed.push_back(std::move(child));
+        }
+    };
+
+    SlabPools::User pool_user;  // Outlives the nodes, see SlabPools
+    NodePtr root;
+    size_t entries = 0;
+
+    // Nodes and their reference counts share one pooled block
+    template <class... Args>
+    static NodePtr make_node(Args&&... args) {
+        return std::allocate_shared<Node>(PoolAllocator<Node>(), std::forward<Args>(args)...);
+    }
+
+    static int dist(const NodePtr& node) { return node ? node->dist : 0; }
+
+    static bool before(const NodePtr& a, const NodePtr& b) {
+        return a->key > b->key || (a->key == b->key && a->id > b->id);
+    }
+
+    static NodePtr shifted(const NodePtr& node, int amount) {
+        if (!node || amount == 0) return node;
+        return make_node(node->key + amount, node->id, node->item,
+                         node->tag + amount, node->dist,
+                         node->left, node->right);
+    }
+
+    static NodePtr meld(const NodePtr& a, const NodePtr& b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (before(b, a)) return meld(b, a);
+
+        NodePtr left = shifted(a->left, a->tag);
+        NodePtr right = meld(shifted(a->right, a->tag), b);
+        if (dist(left) < dist(right)) std::swap(left, right);
+        return make_node(a->key, a->id, a->item, 0, dist(right) + 1,
+                         left, right);
+    }
+
+public:
+    bool empty() const { return !root; }
+    size_t size() const { return entries; }
+
+    // What count entries take when no other version shares their nodes:
+    // key, id and item are the payload, the rest of the node overhead, and
+    // the reference counts share the node's pooled block.
+    static MemoryUsage entry_usage(size_t count) {
+        MemoryUsage usage;
+        usage.payload = count * (2 * sizeof(int) + sizeof(T));
+        usage.node = count * sizeof(Node) - usage.payload;
+        usage.control = count * MemoryUsage::shared_control_block;
+        return usage;
+    }
+
+    int top_key() const { return root->key; }
+    int top_id() const { return root->id; }
+    const T& top_item() const { return root->item; }
+
+    void push(int key, int id, const T& item) {
+        root = meld(root, make_node(key, id, item, 0, 1, nullptr, nullptr));
+        ++entries;
+    }
+
+    void pop() {
+        root = meld(shifted(root->left, root->tag), shifted(root->right, root->tag));
+        --entries;
+    }
+
+    void add_all(int amount) { root = shifted(root, amount); }
+
+    // Moves every entry of other into this heap, leaving other empty.
+    void meld(LeftistHeap& other) {
+        root = meld(root, other.root);
+        other.root = nullptr;
+        entries += other.entries;
+        other.entries = 0;
+    }
+};
@@ -0,0 +1,239 @@
+#pragma once
+#include "HashTable.h"  // HASH_PREFETCH
+#include "MappedVector.h"
+#include "MemoryUsage.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// HashTable laid out in two MappedVectors: an arena of nodes and an array
+// of bucket heads. Chains link nodes by their index in the arena instead
+// of by pointer, so the bytes mean the same at any address: the arena can
+// grow like a std::vector, and a table saved to files reopens as it was,
+// with nothing rebuilt.
+//
+// Values are constructed in place like in HashTable, but must be trivially
+// copyable, since a reopened table never runs their constructors. find
+// returns a raw pointer into the arena, valid until the next insert, which
+// may move it; anything kept longer holds a Handle (handle_of, at). A
+// removed node goes to a free list threaded through the same links and is
+// reused by the next insert.
+template <class K, class T>
+class MappedHashTable {
+public:
+    typedef uint32_t Handle;
+    static const Handle none = 0xffffffff;
+
+private:
+    struct Node {
+        K key;
+        Handle next;
+        T data;
+
+        template <class... Args>
+        Node(K k, Args&&... args) : key(k), next(none), data(std::forward<Args>(args)...) {}
+    };
+
+    // The node arena keeps the element count and the free list in its
+    // header, so they are saved with it
+    enum { ELEMENTS, FREE_LIST };
+
+    MappedVector<Node> nodes;
+    MappedVector<Handle> table;
+
+    size_t hash(const K& key) const { return key % table.size(); }
+
+    Handle find_handle(const K& key) const {
+        Handle handle = table[hash(key)];
+        while (handle != none && nodes[handle].key != key) {
+            handle = nodes[handle].next;
+        }
+        return handle;
+    }
+
+    // Relinks every node into new_size buckets. The new heads are built
+    // aside first, since the chains are walked through the old ones.
+    void rehash(size_t new_size) {
+        std::vector<Handle> new_table(new_size, none);
+        for (size_t bucket = 0; bucket < table.size(); ++bucket) {
+            Handle handle = table[bucket];
+            while (handle != none) {
+                Node& node = nodes[handle];
+                const Handle next = node.next;
+                const size_t idx = node.key % new_size;
+                node.next = new_table[idx];
+                new_table[idx] = handle;
+                handle = next;
+            }
+        }
+        table.assign(new_size, none);
+        for (size_t i = 0; i < new_size; ++i) table[i] = new_table[i];
+    }
+
+    void resize() { rehash(table.size() * 2); }
+
+public:
+    MappedHashTable(size_t initial_size = 4) {
+        table.assign(initial_size, none);
+        nodes.meta(FREE_LIST) = none;
+    }
+
+    MappedHashTable(const MappedHashTable&) = delete;
+    MappedHashTable& operator=(const MappedHashTable&) = delete;
+
+    // Moves an empty table into prefix.nodes and prefix.buckets, or loads
+    // the table those files hold. False if the table is not empty or the
+    // files cannot be opened or do not hold a table of this K and T.
+    bool open(const std::string& prefix) {
+        if (size() != 0) return false;
+        MappedVector<Node> opened_nodes;
+        MappedVector<Handle> opened_table;
+        if (!opened_nodes.open(prefix + ".nodes") || !opened_table.open(prefix + ".buckets")) {
+            return false;
+        }
+        if (opened_nodes.empty() && opened_table.empty()) {
+            opened_table.assign(table.size(), none);
+            opened_nodes.meta(FREE_LIST) = none;
+        } else if (opened_table.empty() || opened_nodes.meta(ELEMENTS) > opened_nodes.size()) {
+            return false;
+        }
+        nodes.swap(opened_nodes);
+        table.swap(opened_table);
+        return true;
+    }
+
+    // Back to an empty table on the heap
+    void close() {
+        const size_t initial_size = 4;
+        nodes.close();
+        table.close();
+        table.assign(initial_size, none);
+        nodes.meta(FREE_LIST) = none;
+    }
+
+    bool file_backed() const { return nodes.file_backed(); }
+
+    // The regions of both files, for MappedJournal
+    void regions(std::vector<MappedRegion*>& out) {
+        nodes.regions(out);
+        table.regions(out);
+    }
+
+    size_t size() const { return nodes.meta(ELEMENTS); }
+
+    // Keys and values are the payload, the index link and padding of each
+    // node overhead; free nodes and spare arena capacity are slack.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage;
+        usage.payload = size() * (sizeof(K) + sizeof(T));
+        usage.node = size() * sizeof(Node) - usage.payload;
+        usage.slack = (nodes.capacity() - size()) * sizeof(Node);
+        usage.add_vector(table, usage.buckets);
+        return usage;
+    }
+
+    // Makes room for n elements up front, so inserting them never resizes
+    // or grows the arena. Grows at least geometrically, like HashTable.
+    void reserve(size_t n) {
+        if (n > table.size()) rehash(std::max(n, table.size() * 2));
+        nodes.reserve(n);
+    }
+
+    // Points into the arena; valid until the next insert or remove.
+    T* find(const K& key) const {
+        const Handle handle = find_handle(key);
+        return handle != none ? &nodes.data()[handle].data : nullptr;
+    }
+
+    // Calls f(key, value) for every element, in bucket order
+    template <class F>
+    void for_each(F f) const {
+        for (size_t bucket = 0; bucket < table.size(); ++bucket) {
+            for (Handle handle = table[bucket]; handle != none; handle = nodes[handle].next) {
+                f(nodes[handle].key, nodes[handle].data);
+            }
+        }
+    }
+
+    // Looks up count keys at once, like HashTable::find_batch: buckets are
+    // prefetched for a whole group, then the chain heads, then the chains
+    // are walked.
+    void find_batch(const K* keys, size_t count, T** out) const {
+        const size_t GROUP = 16;
+        Handle heads[GROUP];
+        Node* arena = nodes.data();
+
+        for (size_t base = 0; base < count; base += GROUP) {
+            const size_t size = std::min(GROUP, count - base);
+
+            for (size_t i = 0; i < size; ++i) {
+                HASH_PREFETCH(&table[hash(keys[base + i])]);
+            }
+            for (size_t i = 0; i < size; ++i) {
+                heads[i] = table[hash(keys[base + i])];
+                if (heads[i] != none) HASH_PREFETCH(&arena[heads[i]]);
+            }
+            for (size_t i = 0; i < size; ++i) {
+                Handle handle = heads[i];
+                while (handle != none && arena[handle].key != keys[base + i]) {
+                    handle = arena[handle].next;
+                }
+                out[base + i] = handle != none ? &arena[handle].data : nullptr;
+            }
+        }
+    }
+
+    // A position-independent name for a stored value, for links that must
+    // survive the arena growing or a reopen
+    Handle handle_of(const T* data) const {
+        const char* node = reinterpret_cast<const char*>(data) - offsetof(Node, data);
+        return static_cast<Handle>(reinterpret_cast<const Node*>(node) - nodes.data());
+    }
+
+    T* at(Handle handle) const { return &nodes.data()[handle].data; }
+
+    // Constructs the value in place from args unless key is present.
+    // Returns the stored value and whether it was inserted.
+    template <class... Args>
+    std::pair<T*, bool> try_emplace(const K& key, Args&&... args) {
+        const Handle existing = find_handle(key);
+        if (existing != none) return std::make_pair(&nodes[existing].data, false);
+
+        if (size() + 1 > table.size()) resize();
+        Handle handle = static_cast<Handle>(nodes.meta(FREE_LIST));
+        if (handle != none) {
+            nodes.meta(FREE_LIST) = nodes[handle].next;
+            new (&nodes[handle]) Node(key, std::forward<Args>(args)...);
+        } else {
+            handle = static_cast<Handle>(nodes.size());
+            nodes.emplace_back(key, std::forward<Args>(args)...);
+        }
+        const size_t idx = hash(key);
+        nodes[handle].next = table[idx];
+        table[idx] = handle;
+        ++nodes.meta(ELEMENTS);
+        return std::make_pair(&nodes[handle].data, true);
+    }
+
+    void remove(const K& key) {
+        Handle* link = &table[hash(key)];
+        while (*link != none) {
+            Node& node = nodes[*link];
+            if (node.key == key) {
+                const Handle doomed = *link;
+                *link = node.next;
+                node.next = static_cast<Handle>(nodes.meta(FREE_LIST));
+                nodes.meta(FREE_LIST) = doomed;
+                --nodes.meta(ELEMENTS);
+                return;
+            }
+            link = &node.next;
+        }
+    }
+};
+
+template <class K, class T>
+const typename MappedHashTable<K, T>::Handle MappedHashTable<K, T>::none;
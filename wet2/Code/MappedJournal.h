@@ -0,0 +1,205 @@
+#pragma once
+#include "MappedVector.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Writes the changes to a set of file-backed MappedRegions in one
+// directory to disk all at once, through a redo log (Linux only).
+//
+// commit() first writes every page changed since the last commit to
+// directory/journal, followed by a trailer that marks the log complete,
+// and only then writes the pages into their own files; the log is emptied
+// once those are synced. If the process dies on the way, the next open()
+// or commit() finds either a log without its trailer, which is dropped
+// since no file was touched yet, or a complete one, which is written into
+// the files again. Either way the files hold what the last commit that
+// got its trailer on disk left them.
+//
+// open() also takes an exclusive lock on directory/state, held until
+// close(), so only one process at a time uses the directory.
+#ifdef __linux__
+class MappedJournal {
+private:
+    static const uint32_t RECORD = 0x4a524543;   // "JREC"
+    static const uint32_t TRAILER = 0x4a454e44;  // "JEND"
+
+    // A record is followed by the file name and then the bytes themselves
+    struct Record {
+        uint32_t magic;
+        uint32_t name_bytes;
+        uint64_t offset;
+        uint64_t bytes;
+    };
+    struct Trailer {
+        uint32_t magic;
+        uint32_t unused;
+        uint64_t length;  // Bytes of records before the trailer
+    };
+
+    std::string prefix;  // The directory, with a trailing '/'
+    int lock_fd = -1;
+    int log_fd = -1;
+
+    static bool write_all(int fd, const void* from, size_t bytes, uint64_t offset) {
+        const char* at = static_cast<const char*>(from);
+        while (bytes > 0) {
+            const ssize_t written = pwrite(fd, at, bytes, static_cast<off_t>(offset));
+            if (written <= 0) return false;
+            at += written;
+            offset += static_cast<uint64_t>(written);
+            bytes -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, void* to, size_t bytes, uint64_t offset) {
+        char* at = static_cast<char*>(to);
+        while (bytes > 0) {
+            const ssize_t got = pread(fd, at, bytes, static_cast<off_t>(offset));
+            if (got <= 0) return false;
+            at += got;
+            offset += static_cast<uint64_t>(got);
+            bytes -= static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    bool empty_log() { return ftruncate(log_fd, 0) == 0 && fsync(log_fd) == 0; }
+
+    // Writes a complete log into the files and empties it; drops an
+    // incomplete one
+    bool recover() {
+        struct stat info;
+        if (fstat(log_fd, &info) != 0) return false;
+        const uint64_t size = static_cast<uint64_t>(info.st_size);
+        if (size == 0) return true;
+        Trailer trailer;
+        if (size < sizeof(Trailer) || !read_all(log_fd, &trailer, sizeof(Trailer), size - sizeof(Trailer)) ||
+            trailer.magic != TRAILER || trailer.length != size - sizeof(Trailer)) {
+            return empty_log();
+        }
+        std::vector<char> bytes;
+        for (uint64_t at = 0; at < trailer.length;) {
+            Record record;
+            if (!read_all(log_fd, &record, sizeof(Record), at) || record.magic != RECORD) return false;
+            at += sizeof(Record);
+            std::string name(record.name_bytes, '\0');
+            bytes.resize(record.bytes);
+            if (!read_all(log_fd, &name[0], name.size(), at) ||
+                !read_all(log_fd, bytes.data(), bytes.size(), at + name.size())) {
+                return false;
+            }
+            at += name.size() + bytes.size();
+            const int fd = ::open((prefix + name).c_str(), O_WRONLY | O_CLOEXEC);
+            const bool written = fd >= 0 && write_all(fd, bytes.data(), bytes.size(), record.offset) &&
+                                 fsync(fd) == 0;
+            if (fd >= 0) ::close(fd);
+            if (!written) return false;
+        }
+        return empty_log();
+    }
+
+public:
+    MappedJournal() = default;
+    ~MappedJournal() { close(); }
+
+    MappedJournal(const MappedJournal&) = delete;
+    MappedJournal& operator=(const MappedJournal&) = delete;
+
+    // Creates directory if missing, locks directory/state and brings the
+    // files up to the last commit. False, with nothing held, if another
+    // process (or another journal) holds the lock or the log cannot be
+    // read or replayed.
+    bool open(const std::string& directory) {
+        if (lock_fd >= 0) return false;
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        prefix = directory + "/";
+        lock_fd = ::open((prefix + "state").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock_fd < 0 || flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+            close();
+            return false;
+        }
+        log_fd = ::open((prefix + "journal").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (log_fd < 0 || !recover()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Releases the lock
+    void close() {
+        if (log_fd >= 0) ::close(log_fd);
+        if (lock_fd >= 0) ::close(lock_fd);
+        log_fd = lock_fd = -1;
+    }
+
+    bool is_open() const { return lock_fd >= 0; }
+
+    // Writes every page of the regions changed since the last commit to
+    // their files, all or none of them. The regions must be files in the
+    // directory. On failure nothing in memory is lost, and the next commit
+    // writes the same pages again.
+    bool commit(const std::vector<MappedRegion*>& regions) {
+        if (log_fd < 0 || !recover()) return false;
+        struct Run {
+            MappedRegion* region;
+            size_t offset;
+            size_t bytes;
+        };
+        std::vector<Run> runs;
+        for (MappedRegion* region : regions) {
+            if (region->path().compare(0, prefix.size(), prefix) != 0) return false;
+            region->changed_runs([&](size_t offset, size_t bytes) { runs.push_back({region, offset, bytes}); });
+        }
+        if (runs.empty()) return true;
+
+        uint64_t length = 0;
+        for (const Run& run : runs) {
+            const std::string name = run.region->path().substr(prefix.size());
+            const Record record = {RECORD, static_cast<uint32_t>(name.size()), run.offset, run.bytes};
+            if (!write_all(log_fd, &record, sizeof(Record), length) ||
+                !write_all(log_fd, name.data(), name.size(), length + sizeof(Record)) ||
+                !write_all(log_fd, run.region->data() + run.offset, run.bytes,
+                           length + sizeof(Record) + name.size())) {
+                return false;
+            }
+            length += sizeof(Record) + name.size() + run.bytes;
+        }
+        // The trailer goes to disk strictly after the records it vouches for
+        const Trailer trailer = {TRAILER, 0, length};
+        if (fsync(log_fd) != 0 || !write_all(log_fd, &trailer, sizeof(Trailer), length) || fsync(log_fd) != 0) {
+            return false;
+        }
+
+        for (const Run& run : runs) {
+            if (!run.region->write_back(run.offset, run.bytes)) return false;
+        }
+        for (MappedRegion* region : regions) {
+            if (!region->sync()) return false;
+        }
+        if (!empty_log()) return false;
+        // A run still mapped privately after this is only written again
+        for (const Run& run : runs) run.region->forget_changes(run.offset, run.bytes);
+        return true;
+    }
+};
+#else
+// Without file-backed regions there is nothing to commit: open() fails
+class MappedJournal {
+public:
+    bool open(const std::string&) { return false; }
+    void close() {}
+    bool is_open() const { return false; }
+    bool commit(const std::vector<MappedRegion*>&) { return false; }
+};
+#endif
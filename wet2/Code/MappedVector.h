@@ -0,0 +1,347 @@
+#pragma once
+#include "MemoryUsage.h"
+#include "SlabPool.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A growable block of memory: an ordinary heap block, or a file mapped
+// into memory once open_file() succeeds. Like a std::vector it may move
+// when it grows, so nothing may point into it across a grow(); what is
+// stored in it links by index instead.
+//
+// The heap block is grown with realloc. A file is mapped at its own size
+// and grown with ftruncate and mremap, which is Linux only: elsewhere
+// open_file() fails and regions stay on the heap. The file is mapped
+// privately, so writes only change this process's copy of a page and the
+// file keeps what was last written back to it, whatever happens to the
+// process. changed_runs() finds the pages written since, and write_back()
+// puts them in the file (see MappedJournal.h, which does so for many
+// regions at once).
+class MappedRegion {
+private:
+    char* base = nullptr;
+    size_t mapped = 0;    // Bytes usable now
+    size_t counted = 0;   // Bytes of it grow() added to AllocationCounters
+    int fd = -1;
+    std::string file;
+
+    // Resizes the block, or the file and its mapping, to bytes, moving it
+    // if need be. New bytes of a file read as zero.
+    bool resize(size_t bytes) {
+        if (fd < 0) {
+            void* moved = std::realloc(base, bytes);
+            if (!moved) return false;
+            base = static_cast<char*>(moved);
+            return true;
+        }
+#ifdef __linux__
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) return false;
+        void* moved = base ? mremap(base, mapped, bytes, MREMAP_MAYMOVE)
+                           : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (moved == MAP_FAILED) return false;
+        base = static_cast<char*>(moved);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+#ifdef __linux__
+    static size_t page_size() {
+        static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    // Maps [offset, offset + bytes) of the file over the same range of the
+    // region, dropping any copies this process made of those pages
+    bool map_file(size_t offset, size_t bytes) {
+        return mmap(base + offset, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                    static_cast<off_t>(offset)) != MAP_FAILED;
+    }
+#endif
+
+public:
+    MappedRegion() = default;
+    ~MappedRegion() { close(); }
+
+    MappedRegion(const MappedRegion&) = delete;
+    MappedRegion& operator=(const MappedRegion&) = delete;
+
+    void swap(MappedRegion& other) {
+        std::swap(base, other.base);
+        std::swap(mapped, other.mapped);
+        std::swap(counted, other.counted);
+        std::swap(fd, other.fd);
+        std::swap(file, other.file);
+    }
+
+    // Back to an empty heap region
+    void close() {
+#ifdef __linux__
+        if (fd >= 0) {
+            if (base) munmap(base, mapped);
+            ::close(fd);
+            base = nullptr;
+        }
+#endif
+        std::free(base);
+        AllocationCounters::record_release(counted);
+        base = nullptr;
+        mapped = counted = 0;
+        fd = -1;
+        file.clear();
+    }
+
+    // Maps all of path, creating it empty if it does not exist. Only as
+    // much address space as the file holds is taken. False, leaving the
+    // region empty, if the file cannot be mapped or this is not Linux.
+    bool open_file(const char* path) {
+        close();
+#ifdef __linux__
+        fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            close();
+            return false;
+        }
+        const size_t size = static_cast<size_t>(info.st_size);
+        if (size % page_size() != 0) {
+            close();
+            return false;
+        }
+        if (size > 0) {
+            void* range = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (range == MAP_FAILED) {
+                close();
+                return false;
+            }
+            base = static_cast<char*>(range);
+        }
+        mapped = size;
+        file = path;
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // Makes at least bytes usable, rounded up to whole pages for a file;
+    // callers that grow one element at a time ask for twice as much, so
+    // growth is amortized. Throws std::bad_alloc once memory, the address
+    // space or the disk runs out, leaving the region as it was.
+    void grow(size_t bytes) {
+        if (bytes <= mapped) return;
+#ifdef __linux__
+        if (fd >= 0) bytes = (bytes + page_size() - 1) / page_size() * page_size();
+#endif
+        if (!resize(bytes)) throw std::bad_alloc();
+        AllocationCounters::record(bytes - mapped);
+        counted += bytes - mapped;
+        mapped = bytes;
+    }
+
+#ifdef __linux__
+    // Calls visit(offset, bytes) for every run of pages written since the
+    // file was mapped or last written back: the pages this process holds a
+    // copy of, as /proc/self/pagemap tells. Every page counts as written
+    // if that cannot be read. Nothing for a heap region.
+    template <class Visit>
+    void changed_runs(Visit visit) const {
+        if (fd < 0 || mapped == 0) return;
+        const int pagemap = ::open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+        if (pagemap < 0) {
+            visit(size_t(0), mapped);
+            return;
+        }
+        const size_t pages = mapped / page_size();
+        const size_t first_page = reinterpret_cast<uintptr_t>(base) / page_size();
+        std::vector<uint64_t> entries(std::min<size_t>(pages, 4096));
+        size_t run_start = 0;
+        size_t run_pages = 0;
+        for (size_t batch = 0; batch < pages; batch += entries.size()) {
+            const size_t count = std::min(entries.size(), pages - batch);
+            const ssize_t want = static_cast<ssize_t>(count * sizeof(uint64_t));
+            if (pread(pagemap, entries.data(), count * sizeof(uint64_t),
+                      static_cast<off_t>((first_page + batch) * sizeof(uint64_t))) != want) {
+                ::close(pagemap);
+                visit(size_t(0), mapped);
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                // Present or swapped out, and no longer the file's own page
+                const uint64_t entry = entries[i];
+                const bool copied = (entry >> 62 & 3) != 0 && (entry >> 61 & 1) == 0;
+                if (copied && run_pages > 0 && run_start + run_pages == batch + i) {
+                    ++run_pages;
+                } else if (copied) {
+                    if (run_pages > 0) visit(run_start * page_size(), run_pages * page_size());
+                    run_start = batch + i;
+                    run_pages = 1;
+                }
+            }
+        }
+        ::close(pagemap);
+        if (run_pages > 0) visit(run_start * page_size(), run_pages * page_size());
+    }
+
+    // Writes [offset, offset + bytes) to the file, without syncing it
+    bool write_back(size_t offset, size_t bytes) {
+        while (bytes > 0) {
+            const ssize_t written = pwrite(fd, base + offset, bytes, static_cast<off_t>(offset));
+            if (written <= 0) return false;
+            offset += static_cast<size_t>(written);
+            bytes -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool sync() { return fd < 0 || fsync(fd) == 0; }
+
+    // Once a written-back range is synced, maps it from the file again, so
+    // that its pages no longer count as changed
+    bool forget_changes(size_t offset, size_t bytes) { return map_file(offset, bytes); }
+#endif
+
+    char* data() const { return base; }
+    size_t size() const { return mapped; }
+    bool file_backed() const { return fd >= 0; }
+    const std::string& path() const { return file; }
+};
+
+// A vector of trivially copyable T in a MappedRegion, on the heap until
+// open() maps it from a file. As in std::vector, elements move when it
+// grows. The size and a few words of caller metadata live in a header at
+// the start of the region, so a file-backed vector reopens as it was last
+// written back.
+template <class T>
+class MappedVector {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "MappedVector stores raw bytes and never runs constructors on reopen");
+
+private:
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t element_size;
+        uint64_t size;
+        uint64_t meta[4];
+    };
+    static const uint64_t magic_value = 0x31504d56544c4650ull;  // "PFLTVMP1" on disk
+    static const uint32_t format_version = 1;
+    static const size_t header_bytes = 64;
+    static_assert(sizeof(Header) <= header_bytes, "header must fit its slot");
+
+    MappedRegion region;
+
+    Header& header() const { return *reinterpret_cast<Header*>(region.data()); }
+    T* elements() const { return reinterpret_cast<T*>(region.data() + header_bytes); }
+
+    // Lays out an empty header in a region with nothing in it yet
+    static void initialize(MappedRegion& fresh) {
+        fresh.grow(header_bytes);
+        Header& head = *reinterpret_cast<Header*>(fresh.data());
+        head = Header();
+        head.magic = magic_value;
+        head.version = format_version;
+        head.element_size = sizeof(T);
+    }
+
+public:
+    typedef T value_type;
+
+    MappedVector() { initialize(region); }
+
+    MappedVector(const MappedVector&) = delete;
+    MappedVector& operator=(const MappedVector&) = delete;
+
+    void swap(MappedVector& other) { region.swap(other.region); }
+
+    // Switches to the file at path: an empty or missing file starts an
+    // empty vector, and so does one grown but never written back to, whose
+    // header is still zero. Anything else must be a vector of this T. The
+    // contents so far are dropped; on failure nothing changes and false is
+    // returned.
+    bool open(const std::string& path) {
+        MappedRegion opened;
+        if (!opened.open_file(path.c_str())) return false;
+        if (opened.size() == 0 || reinterpret_cast<const Header*>(opened.data())->magic == 0) {
+            try {
+                initialize(opened);
+            } catch (const std::bad_alloc&) {
+                return false;
+            }
+        } else {
+            const Header& head = *reinterpret_cast<const Header*>(opened.data());
+            if (opened.size() < header_bytes || head.magic != magic_value ||
+                head.version != format_version || head.element_size != sizeof(T) ||
+                head.size > (opened.size() - header_bytes) / sizeof(T)) {
+                return false;
+            }
+        }
+        region.swap(opened);
+        return true;
+    }
+
+    // Back to an empty vector on the heap
+    void close() {
+        MappedVector fresh;
+        swap(fresh);
+    }
+
+    bool file_backed() const { return region.file_backed(); }
+
+    // The region the vector lives in, for MappedJournal
+    void regions(std::vector<MappedRegion*>& out) { out.push_back(&region); }
+
+    size_t size() const { return header().size; }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return (region.size() - header_bytes) / sizeof(T); }
+
+    // Words the owner may use for its own bookkeeping; saved with the vector
+    uint64_t& meta(size_t i) { return header().meta[i]; }
+    uint64_t meta(size_t i) const { return header().meta[i]; }
+
+    void reserve(size_t n) {
+        if (n > capacity()) region.grow(header_bytes + n * sizeof(T));
+    }
+
+    T* data() const { return elements(); }
+    T& operator[](size_t i) { return elements()[i]; }
+    const T& operator[](size_t i) const { return elements()[i]; }
+    T& back() { return elements()[size() - 1]; }
+
+    template <class... Args>
+    T& emplace_back(Args&&... args) {
+        const size_t n = size();
+        if (n == capacity()) reserve(n < 16 ? 16 : 2 * n);
+        T* slot = new (elements() + n) T(std::forward<Args>(args)...);
+        header().size = n + 1;
+        return *slot;
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void pop_back() { --header().size; }
+    void clear() { header().size = 0; }
+
+    // Replaces the contents with count copies of value
+    void assign(size_t count, const T& value) {
+        reserve(count);
+        for (size_t i = 0; i < count; ++i) elements()[i] = value;
+        header().size = count;
+    }
+};
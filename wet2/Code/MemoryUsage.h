@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+
+// Bytes held by a container, split by what they are spent on. Every
+// memory_usage() is computed from counters the container keeps anyway
+// (sizes, capacities, entry counts), so asking costs O(1).
+//
+// Free blocks in the per-thread node pools belong to no container and are
+// not counted here; AllocationCounters reports what the pools hold in all.
+struct MemoryUsage {
+    size_t payload = 0;  // Keys, values and records as stored
+    size_t node = 0;     // Links and padding per node
+    size_t control = 0;  // Reference counts of shared_ptr-owned nodes
+    size_t buckets = 0;  // Bucket arrays of the hash tables
+    size_t slack = 0;    // Capacity allocated but not in use
+
+    // allocate_shared keeps the reference counts in the same block as the
+    // object: a vtable pointer and two 32-bit counters in both libstdc++
+    // and libc++.
+    static const size_t shared_control_block = sizeof(void*) + 2 * sizeof(int);
+
+    size_t overhead() const { return node + control + buckets + slack; }
+    size_t total() const { return payload + overhead(); }
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        payload += other.payload;
+        node += other.node;
+        control += other.control;
+        buckets += other.buckets;
+        slack += other.slack;
+        return *this;
+    }
+
+    // Counts the elements of array into used and its spare capacity as
+    // slack; works for std::vector and MappedVector alike
+    template <class Array>
+    void add_vector(const Array& array, size_t& used) {
+        const size_t element = sizeof(typename Array::value_type);
+        used += array.size() * element;
+        slack += (array.capacity() - array.size()) * element;
+    }
+};
@@ -0,0 +1,280 @@
+#pragma once
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware counters of the calling thread through perf_event_open (Linux
+// only), counting user space only, so reading them costs little of what
+// they count.
+//
+// The events form one group: read with one system call, scheduled on the
+// PMU all at once or not at all. An event the CPU or kernel does not have
+// is left out, as is one the PMU cannot fit beside the rest (the group
+// would never run); it reads as 0 and reason() says why. When other users
+// of the PMU crowd it out, the kernel multiplexes the group and it counts
+// only part of the time; counted() scales its counts up to make up for it.
+class PerfCounters {
+public:
+    enum Event {
+        CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, DTLB_MISSES, EVENTS
+    };
+
+    // Raw counts, and how long the group had been enabled and how long
+    // counting when they were read, in nanoseconds
+    struct Sample {
+        uint64_t values[EVENTS];
+        uint64_t time_enabled;
+        uint64_t time_running;
+    };
+
+private:
+    struct Slot {
+        int fd = -1;
+        int index = -1;  // Position in the group read, -1 if not open
+        std::string reason;
+    };
+
+    Slot slots[EVENTS];
+    int leader = -1;
+    int members = 0;
+    uint64_t time_enabled = 0;  // As of the last read
+    uint64_t time_running = 0;
+
+    static perf_event_attr attributes(int event) {
+        const uint64_t read_miss =
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.type = PERF_TYPE_HARDWARE;
+        switch (event) {
+            case CYCLES:        attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+            case INSTRUCTIONS:  attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+            case BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+            case L1D_MISSES:    attr.type = PERF_TYPE_HW_CACHE; attr.config = PERF_COUNT_HW_CACHE_L1D | read_miss; break;
+            case LLC_MISSES:    attr.type = PERF_TYPE_HW_CACHE; attr.config = PERF_COUNT_HW_CACHE_LL | read_miss; break;
+            default:            attr.type = PERF_TYPE_HW_CACHE; attr.config = PERF_COUNT_HW_CACHE_DTLB | read_miss; break;
+        }
+        return attr;
+    }
+
+    void close_all() {
+        for (Slot& slot : slots) {
+            if (slot.fd >= 0) close(slot.fd);
+            slot.fd = slot.index = -1;
+        }
+        leader = -1;
+        members = 0;
+    }
+
+    // Opens every event not given up on yet; the first to open leads
+    void open_group() {
+        for (int i = 0; i < EVENTS; ++i) {
+            if (!slots[i].reason.empty()) continue;
+            perf_event_attr attr = attributes(i);
+            attr.disabled = leader < 0;
+            const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader < 0 ? -1 : slots[leader].fd, 0);
+            if (fd < 0) {
+                slots[i].reason = std::strerror(errno);
+                continue;
+            }
+            slots[i].fd = static_cast<int>(fd);
+            slots[i].index = members++;
+            if (leader < 0) leader = i;
+        }
+    }
+
+    // Whether the group got onto the PMU at all during a short spin
+    bool scheduled() {
+        ioctl(slots[leader].fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(slots[leader].fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        volatile int spin = 0;
+        for (int i = 0; i < 100000; ++i) spin = spin + i;
+        Sample sample;
+        read(sample);
+        return time_running > 0;
+    }
+
+public:
+    PerfCounters() {
+        open_group();
+        // More events than the PMU holds at once: drop the last and retry
+        while (members > 1 && !scheduled()) {
+            int last = EVENTS - 1;
+            while (slots[last].index < 0) --last;
+            close_all();
+            slots[last].reason = "no room on the PMU beside the other events";
+            open_group();
+        }
+        if (members == 1 && !scheduled()) {
+            slots[leader].reason = "never scheduled on the PMU";
+            close_all();
+        }
+    }
+
+    ~PerfCounters() { close_all(); }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    static const char* name(int event) {
+        static const char* const names[EVENTS] = {
+            "cycles", "instructions", "L1D-misses", "LLC-misses", "branch-misses", "dTLB-misses"
+        };
+        return names[event];
+    }
+
+    bool available(int event) const { return slots[event].index >= 0; }
+    bool any_available() const { return members > 0; }
+    const std::string& reason(int event) const { return slots[event].reason; }
+
+    // Share of the time the group was counting; below 1 when the kernel
+    // multiplexed it with other users of the PMU
+    double scheduled_share() const {
+        return time_enabled ? static_cast<double>(time_running) / time_enabled : 1.0;
+    }
+
+    void read(Sample& sample) {
+        uint64_t buffer[3 + EVENTS];
+        std::memset(&sample, 0, sizeof(sample));
+        if (members == 0 || ::read(slots[leader].fd, buffer, sizeof(buffer)) <= 0) return;
+        sample.time_enabled = time_enabled = buffer[1];
+        sample.time_running = time_running = buffer[2];
+        for (int i = 0; i < EVENTS; ++i) {
+            if (slots[i].index >= 0) sample.values[i] = buffer[3 + slots[i].index];
+        }
+    }
+
+    // Events counted from before to after, each scaled by the time the
+    // group was enabled over the time it ran in between, as perf stat
+    // does. False, with every count 0, if it did not run in between.
+    static bool counted(const Sample& before, const Sample& after, int64_t counts[EVENTS]) {
+        const uint64_t enabled = after.time_enabled - before.time_enabled;
+        const uint64_t running = after.time_running - before.time_running;
+        for (int i = 0; i < EVENTS; ++i) counts[i] = 0;
+        if (running == 0) return false;
+        const double scale = static_cast<double>(enabled) / running;
+        for (int i = 0; i < EVENTS; ++i) {
+            counts[i] = static_cast<int64_t>(static_cast<double>(after.values[i] - before.values[i]) * scale + 0.5);
+        }
+        return true;
+    }
+};
+
+// Wall time and counters per kind of operation, summed over a benchmark
+// and reported per call, less the calibrated cost of measuring
+class PerfProfile {
+private:
+    struct Row {
+        uint64_t calls = 0;
+        uint64_t counted = 0;  // Calls measured while the counters ran
+        int64_t nanos = 0;
+        int64_t counts[PerfCounters::EVENTS] = {};  // Over the counted calls
+    };
+
+    PerfCounters& counters;
+    std::vector<std::string> names;
+    std::vector<Row> rows;
+    Row overhead;  // Of one measurement, once calibrated
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    template <class Operation>
+    void take(Row& row, Operation operation, uint64_t calls, const Row& less) {
+        PerfCounters::Sample before, after;
+        counters.read(before);
+        const int64_t start = now();
+        operation();
+        const int64_t end = now();
+        counters.read(after);
+
+        row.calls += calls;
+        row.nanos += end - start - less.nanos;
+        int64_t counts[PerfCounters::EVENTS];
+        if (!PerfCounters::counted(before, after, counts)) return;
+        row.counted += calls;
+        for (int i = 0; i < PerfCounters::EVENTS; ++i) row.counts[i] += counts[i] - less.counts[i];
+    }
+
+public:
+    // One row per name; measure() takes the row's index
+    PerfProfile(PerfCounters& counters, const std::vector<std::string>& names)
+        : counters(counters), names(names), rows(names.size()) {}
+
+    // Times an empty operation many times; the mean is the overhead
+    void calibrate(int rounds = 100000) {
+        Row empty;
+        for (int i = 0; i < rounds; ++i) take(empty, [] {}, 1, Row());
+        overhead.nanos = empty.nanos / rounds;
+        if (empty.counted == 0) return;
+        const int64_t counted = static_cast<int64_t>(empty.counted);
+        for (int i = 0; i < PerfCounters::EVENTS; ++i) overhead.counts[i] = empty.counts[i] / counted;
+    }
+
+    // An operation making calls calls of its kind, such as a loop of
+    // lookups, counts as that many and pays the overhead once
+    template <class Operation>
+    void measure(int kind, Operation operation, uint64_t calls = 1) { take(rows[kind], operation, calls, overhead); }
+
+    // A table of every kind measured at least once, then a total
+    void print(FILE* out) const {
+        std::fprintf(out, "%-24s %10s %10s", "operation", "calls", "ns/op");
+        for (int i = 0; i < PerfCounters::EVENTS; ++i) std::fprintf(out, " %14s", PerfCounters::name(i));
+        std::fprintf(out, "\n");
+
+        Row total;
+        for (size_t kind = 0; kind <= rows.size(); ++kind) {
+            const bool is_total = kind == rows.size();
+            const Row& row = is_total ? total : rows[kind];
+            if (row.calls == 0) continue;
+            const double calls = static_cast<double>(row.calls);
+            std::fprintf(out, "%-24s %10llu %10.1f", is_total ? "total" : names[kind].c_str(),
+                         static_cast<unsigned long long>(row.calls), row.nanos > 0 ? row.nanos / calls : 0.0);
+            const double counted = static_cast<double>(row.counted);
+            for (int i = 0; i < PerfCounters::EVENTS; ++i) {
+                if (counters.available(i) && row.counted > 0) {
+                    std::fprintf(out, " %14.2f", row.counts[i] > 0 ? row.counts[i] / counted : 0.0);
+                } else {
+                    std::fprintf(out, " %14s", "n/a");
+                }
+            }
+            std::fprintf(out, "\n");
+
+            if (is_total) continue;
+            total.calls += row.calls;
+            total.counted += row.counted;
+            total.nanos += row.nanos;
+            for (int i = 0; i < PerfCounters::EVENTS; ++i) total.counts[i] += row.counts[i];
+        }
+
+        for (int i = 0; i < PerfCounters::EVENTS; ++i) {
+            if (!counters.available(i)) {
+                std::fprintf(out, "%s: not counted (%s)\n", PerfCounters::name(i), counters.reason(i).c_str());
+            }
+        }
+        if (counters.any_available() && counters.scheduled_share() < 1.0) {
+            std::fprintf(out, "counters ran %.0f%% of the time, multiplexed with other users of the PMU; "
+                         "counts are scaled up to the whole time\n", 100 * counters.scheduled_share());
+        }
+        if (counters.any_available() && total.counted < total.calls) {
+            std::fprintf(out, "%llu of %llu calls ran while the counters did not; counts per op are over the rest\n",
+                         static_cast<unsigned long long>(total.calls - total.counted),
+                         static_cast<unsigned long long>(total.calls));
+        }
+    }
+};
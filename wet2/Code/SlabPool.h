@@ -0,0 +1,301 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+
+// Memory the pools have taken from the system allocator: slabs taken so
+// far, and the bytes they hold now. Both stop moving once the pools are
+// warm, which is how a steady-state workload can be checked for hidden
+// allocations; the bytes drop to 0 when the last pool user goes away.
+class AllocationCounters {
+public:
+    static size_t system_allocations() { return allocations().load(); }
+    static size_t system_bytes() { return bytes().load(); }
+
+    static void record(size_t size) {
+        allocations()++;
+        bytes() += size;
+    }
+
+    static void record_release(size_t size) { bytes() -= size; }
+
+private:
+    static std::atomic<size_t>& allocations() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+    static std::atomic<size_t>& bytes() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+};
+
+// What the pools of all types share between threads: the slabs, spare
+// blocks handed back by threads that exited, and a count of pool users.
+// A user is a container that may hold pooled blocks. It keeps a
+// SlabPools::User, declared before its nodes so that it goes away after
+// them. When the last user goes away every slab is given back to the
+// system and the generation moves on, so each thread drops its free list,
+// which pointed into those slabs, before it next touches the pool.
+class SlabPools {
+public:
+    static const size_t FIRST_SLAB = 64;
+    static const size_t MAX_SLAB = 64 * 1024;
+
+    class User {
+    public:
+        User() { acquire(); }
+        User(const User&) { acquire(); }
+        User& operator=(const User&) { return *this; }
+        ~User() { retire(); }
+    };
+
+    // The slabs and spare blocks of one block type. Each slab's first
+    // block links the next slab.
+    struct Shelf {
+        Shelf* next_shelf;
+        void* slabs;
+        void* spares;
+        size_t spare_blocks;
+        size_t next_slab;
+        size_t bytes;
+        bool listed;
+    };
+
+    class Lock {
+    public:
+        Lock() {
+            while (state().busy.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+        }
+        ~Lock() { state().busy.clear(std::memory_order_release); }
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    };
+
+    static uint64_t generation() { return state().generation.load(std::memory_order_acquire); }
+
+    // Under Lock: makes the shelf's slabs part of the next release
+    static void list(Shelf& shelf) {
+        if (shelf.listed) return;
+        shelf.next_shelf = state().shelves;
+        state().shelves = &shelf;
+        shelf.listed = true;
+    }
+
+private:
+    // Constant-initialized and trivially destroyed, so pools still work
+    // while static objects are torn down
+    struct State {
+        std::atomic_flag busy;
+        std::atomic<size_t> users;
+        std::atomic<uint64_t> generation;
+        Shelf* shelves;
+    };
+
+    static State& state() {
+        static State shared = {ATOMIC_FLAG_INIT, {0}, {0}, nullptr};
+        return shared;
+    }
+
+    // Only a user that finds no other has to wait, in case the slabs of
+    // the previous last user are still being given back
+    static void acquire() {
+        State& shared = state();
+        size_t users = shared.users.load(std::memory_order_relaxed);
+        while (users > 0) {
+            if (shared.users.compare_exchange_weak(users, users + 1, std::memory_order_acq_rel)) return;
+        }
+        Lock lock;
+        shared.users.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    static void retire() {
+        State& shared = state();
+        if (shared.users.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        Lock lock;
+        if (shared.users.load(std::memory_order_acquire) != 0) return;
+        shared.generation.fetch_add(1, std::memory_order_release);
+        for (Shelf* shelf = shared.shelves; shelf; shelf = shelf->next_shelf) {
+            while (shelf->slabs) {
+                void* slab = shelf->slabs;
+                shelf->slabs = *static_cast<void**>(slab);
+                ::operator delete(slab);
+            }
+            AllocationCounters::record_release(shelf->bytes);
+            shelf->spares = nullptr;
+            shelf->spare_blocks = 0;
+            shelf->next_slab = FIRST_SLAB;
+            shelf->bytes = 0;
+        }
+    }
+};
+
+// Fixed-size blocks for objects of type T, carved out of slabs that grow
+// geometrically. Freed blocks are reused before a new slab is taken.
+//
+// Each thread keeps its own free list, so allocating and freeing take no
+// lock; a block freed on another thread just joins that thread's list.
+// Only running dry locks the shared shelf: spare blocks come from there
+// first, then a new slab. A thread that exits puts its free list on the
+// shelf for the others.
+template <class T>
+class SlabPool {
+private:
+    union Block {
+        Block* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    Block* free_list = nullptr;
+    size_t free_blocks = 0;
+    uint64_t generation;
+
+    SlabPool() : generation(SlabPools::generation()) {}
+
+    ~SlabPool() {
+        if (!free_list) return;
+        SlabPools::Lock lock;
+        if (generation != SlabPools::generation()) return;
+        SlabPools::Shelf& spare = shelf();
+        Block* last = free_list;
+        while (last->next) last = last->next;
+        last->next = static_cast<Block*>(spare.spares);
+        spare.spares = free_list;
+        spare.spare_blocks += free_blocks;
+        free_list = nullptr;
+        free_blocks = 0;
+    }
+
+    static SlabPools::Shelf& shelf() {
+        static SlabPools::Shelf shared = {nullptr, nullptr, nullptr, 0, SlabPools::FIRST_SLAB, 0, false};
+        return shared;
+    }
+
+    // Forgets a free list whose slabs were given back
+    void refresh() {
+        const uint64_t current = SlabPools::generation();
+        if (generation == current) return;
+        free_list = nullptr;
+        free_blocks = 0;
+        generation = current;
+    }
+
+    void push(Block* block) {
+        block->next = free_list;
+        free_list = block;
+        ++free_blocks;
+    }
+
+    // Takes up to n spare blocks, then a slab for the rest of them; with
+    // grow, a slab of the shelf's next size if no spare was left at all
+    void refill(size_t n, bool grow) {
+        SlabPools::Lock lock;
+        SlabPools::Shelf& spare = shelf();
+        SlabPools::list(spare);
+        if (grow && spare.spares) n = spare.spare_blocks < SlabPools::MAX_SLAB ? spare.spare_blocks : SlabPools::MAX_SLAB;
+        for (; n > 0 && spare.spares; --n) {
+            Block* block = static_cast<Block*>(spare.spares);
+            spare.spares = block->next;
+            --spare.spare_blocks;
+            push(block);
+        }
+        if (grow && n > 0) {
+            n = spare.next_slab;
+            spare.next_slab = n < SlabPools::MAX_SLAB / 2 ? n * 2 : SlabPools::MAX_SLAB;
+        }
+        if (n == 0) return;
+
+        const size_t size = (n + 1) * sizeof(Block);
+        Block* slab = static_cast<Block*>(::operator new(size));
+        AllocationCounters::record(size);
+        spare.bytes += size;
+        slab[0].next = static_cast<Block*>(spare.slabs);
+        spare.slabs = slab;
+        for (size_t i = n; i > 0; --i) push(&slab[i]);
+    }
+
+public:
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    static SlabPool& instance() {
+        static thread_local SlabPool pool;
+        return pool;
+    }
+
+    void* allocate() {
+        refresh();
+        if (!free_list) refill(1, true);
+        Block* block = free_list;
+        free_list = block->next;
+        --free_blocks;
+        return block;
+    }
+
+    void release(void* memory) {
+        refresh();
+        push(static_cast<Block*>(memory));
+    }
+
+    // The next n allocations on this thread will not need a new slab.
+    void reserve(size_t n) {
+        refresh();
+        if (free_blocks < n) refill(n - free_blocks, false);
+    }
+
+    size_t available() const { return generation == SlabPools::generation() ? free_blocks : 0; }
+
+    // Bytes each object takes in a slab, padding included
+    static size_t block_size() { return sizeof(Block); }
+
+    template <class... Args>
+    T* create(Args&&... args) {
+        void* memory = allocate();
+        try {
+            return new (memory) T(std::forward<Args>(args)...);
+        } catch (...) {
+            release(memory);
+            throw;
+        }
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        release(object);
+    }
+};
+
+// Standard allocator over SlabPool, for std::allocate_shared: the node and
+// its reference counts then share one pooled block.
+template <class T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() = default;
+    template <class U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (n != 1) return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(SlabPool<T>::instance().allocate());
+    }
+
+    void deallocate(T* memory, size_t n) {
+        if (n != 1) {
+            ::operator delete(memory);
+            return;
+        }
+        SlabPool<T>::instance().release(memory);
+    }
+
+    template <class U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+    template <class U>
+    bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
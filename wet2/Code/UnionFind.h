@@ -0,0 +1,238 @@
+#pragma once
+#include "MappedVector.h"
+#include "MemoryUsage.h"
+#include <string>
+#include <vector>
+
+// Union-Find over dense fleet slots. All per-set data lives in parallel
+// arrays indexed by slot, so a find is a walk over ints with no pointers.
+//
+// extra_rank[s] is the rank offset of slot s relative to its parent; the
+// offset of a slot relative to its root is the sum along the path. Roots
+// always have an offset of 0.
+//
+// extra_money[s] is a lazy payment delta composed the same way, except
+// that a root keeps its own delta: paying a whole set adds to the root
+// only, and the money owed to a slot is the sum along the path including
+// the root.
+//
+// While recording, every slot is saved to a history before it changes and
+// find stops compressing paths, so rollback can restore any earlier state
+// exactly. Union by pirate count keeps uncompressed paths O(log n) long.
+//
+// The slot arrays are MappedVectors, on the heap like std::vector until
+// open() keeps them in files next to the fleet table; the history is
+// in-memory only.
+class UnionFind {
+private:
+    struct Change {
+        int slot;
+        int parent; // -1 marks a slot created by make_set
+        int extra_rank;
+        int extra_money;
+        int pirates;
+        int ships;
+    };
+
+    MappedVector<int> parent;
+    MappedVector<int> extra_rank;
+    MappedVector<int> extra_money;
+    MappedVector<int> pirates;  // valid at roots only
+    MappedVector<int> ships;    // valid at roots only
+
+    std::vector<Change> history;
+    bool recording = false;
+
+    void save(int slot) {
+        if (recording) {
+            history.push_back({slot, parent[slot], extra_rank[slot], extra_money[slot],
+                               pirates[slot], ships[slot]});
+        }
+    }
+
+public:
+    int size() const { return static_cast<int>(parent.size()); }
+
+    // Moves an empty Union-Find into the files prefix + "parent" and so on,
+    // or loads the one they hold. False, with nothing changed, if this one
+    // is not empty or the files cannot be opened or disagree in length.
+    bool open(const std::string& prefix) {
+        if (size() != 0 || recording) return false;
+        MappedVector<int> opened[5];
+        const char* names[5] = {"parent", "extra_rank", "extra_money", "pirates", "ships"};
+        for (int i = 0; i < 5; ++i) {
+            if (!opened[i].open(prefix + names[i])) return false;
+            if (opened[i].size() != opened[0].size()) return false;
+        }
+        parent.swap(opened[0]);
+        extra_rank.swap(opened[1]);
+        extra_money.swap(opened[2]);
+        pirates.swap(opened[3]);
+        ships.swap(opened[4]);
+        return true;
+    }
+
+    // Back to an empty Union-Find on the heap
+    void close() {
+        parent.close();
+        extra_rank.close();
+        extra_money.close();
+        pirates.close();
+        ships.close();
+        history.clear();
+        recording = false;
+    }
+
+    // The regions of the slot arrays, for MappedJournal
+    void regions(std::vector<MappedRegion*>& out) {
+        parent.regions(out);
+        extra_rank.regions(out);
+        extra_money.regions(out);
+        pirates.regions(out);
+        ships.regions(out);
+    }
+
+    // The slot arrays are the payload; the rollback history is too while
+    // recording, and its capacity is kept as slack afterwards.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage;
+        usage.add_vector(parent, usage.payload);
+        usage.add_vector(extra_rank, usage.payload);
+        usage.add_vector(extra_money, usage.payload);
+        usage.add_vector(pirates, usage.payload);
+        usage.add_vector(ships, usage.payload);
+        usage.add_vector(history, usage.payload);
+        return usage;
+    }
+
+    void reserve(int n) {
+        parent.reserve(n);
+        extra_rank.reserve(n);
+        extra_money.reserve(n);
+        pirates.reserve(n);
+        ships.reserve(n);
+    }
+
+    // Creates a singleton set with one ship and no pirates, returns its slot.
+    int make_set() {
+        const int slot = size();
+        parent.push_back(slot);
+        extra_rank.push_back(0);
+        extra_money.push_back(0);
+        pirates.push_back(0);
+        ships.push_back(1);
+        if (recording) {
+            history.push_back({slot, -1, 0, 0, 0, 0});
+        }
+        return slot;
+    }
+
+    bool is_root(int slot) const { return parent[slot] == slot; }
+
+    // Returns the root of slot, storing the slot's rank offset and the
+    // money owed to it. Iterative path halving: every visited slot is
+    // re-pointed at its grandparent, folding the skipped parent's deltas
+    // into its own.
+    int find(int slot, int& rank_offset, int& money_offset) {
+        rank_offset = 0;
+        money_offset = 0;
+        while (parent[slot] != slot) {
+            const int p = parent[slot];
+            if (!recording && parent[p] != p) {
+                extra_rank[slot] += extra_rank[p];
+                extra_money[slot] += extra_money[p];
+                parent[slot] = parent[p];
+            }
+            rank_offset += extra_rank[slot];
+            money_offset += extra_money[slot];
+            slot = parent[slot];
+        }
+        money_offset += extra_money[slot];
+        return slot;
+    }
+
+    int find(int slot, int& rank_offset) {
+        int money_offset;
+        return find(slot, rank_offset, money_offset);
+    }
+
+    int find(int slot) {
+        int rank_offset, money_offset;
+        return find(slot, rank_offset, money_offset);
+    }
+
+    int num_pirates(int root) const { return pirates[root]; }
+    int num_ships(int root) const { return ships[root]; }
+    int money(int root) const { return extra_money[root]; }
+
+    // Pays every pirate in a root set, including sets linked under it.
+    void pay(int root, int amount) {
+        save(root);
+        extra_money[root] += amount;
+    }
+
+    // Adds a pirate to a root set and returns its rank within the set.
+    int add_pirate(int root) {
+        save(root);
+        return ++pirates[root];
+    }
+
+    // Hangs root secondary under root primary. The secondary's pirates are
+    // ranked after all of the primary's current pirates.
+    void link(int primary, int secondary) {
+        save(primary);
+        save(secondary);
+        parent[secondary] = primary;
+        extra_rank[secondary] = pirates[primary];
+        extra_money[secondary] -= extra_money[primary];
+        pirates[primary] += pirates[secondary];
+        ships[primary] += ships[secondary];
+    }
+
+    // Appends the slots of other after this one's, shifted by size(), so
+    // slot s of other becomes slot size() + s here. Not while recording.
+    void append(const UnionFind& other) {
+        const int base = size();
+        reserve(base + other.size());
+        for (int slot = 0; slot < other.size(); ++slot) {
+            parent.push_back(base + other.parent[slot]);
+            extra_rank.push_back(other.extra_rank[slot]);
+            extra_money.push_back(other.extra_money[slot]);
+            pirates.push_back(other.pirates[slot]);
+            ships.push_back(other.ships[slot]);
+        }
+    }
+
+    // Starts (or continues) recording and returns a mark for rollback.
+    int checkpoint() {
+        recording = true;
+        return static_cast<int>(history.size());
+    }
+
+    // Restores the state as it was when mark was returned by checkpoint.
+    void rollback(int mark) {
+        while (static_cast<int>(history.size()) > mark) {
+            const Change& change = history.back();
+            if (change.parent < 0) {
+                parent.pop_back();
+                extra_rank.pop_back();
+                extra_money.pop_back();
+                pirates.pop_back();
+                ships.pop_back();
+            } else {
+                parent[change.slot] = change.parent;
+                extra_rank[change.slot] = change.extra_rank;
+                extra_money[change.slot] = change.extra_money;
+                pirates[change.slot] = change.pirates;
+                ships[change.slot] = change.ships;
+            }
+            history.pop_back();
+        }
+    }
+
+    // Keeps the current state, drops the history and resumes compression.
+    void stop_recording() {
+        recording = false;
+        history.clear();
+    }
+};
@@ -1,31 +1,129 @@
 #include "pirates24b2.h"
+#include "ConcurrentUnionFind.h"
 #include <memory>
 #include <algorithm>
+#include <future>
+#include <string>
+#include <thread>
 
 oceans_t::oceans_t() = default;
+
+oceans_t::oceans_t(int expectedFleets, int expectedPirates) {
+    reserve(std::max(expectedFleets, 0), std::max(expectedPirates, 0));
+}
 oceans_t::~oceans_t() = default;
 
-// Union-Find with path compression
-std::shared_ptr<Fleet> oceans_t::find_set(std::shared_ptr<Fleet> fleet) {
-    if (!fleet) return nullptr;
-    if (fleet->next.expired()) return fleet;
+void oceans_t::reserve(size_t fleets, size_t pirates) {
+    ocean_t_fleets.reserve(fleets);
+    ocean_t_pirates.reserve(pirates);
+    fleet_sets.reserve(static_cast<int>(fleets));
+    fleet_heaps.reserve(fleets);
+    heap_ready.reserve(fleets);
+    fleet_members.reserve(fleets);
+}
+
+int oceans_t::money_of(const Pirate& pirate) {
+    int rankOffset, moneyOffset;
+    fleet_sets.find(pirate.fleet_slot, rankOffset, moneyOffset);
+    return pirate.money + moneyOffset;
+}
+
+void oceans_t::set_money(Pirate* pirate, int money) {
+    const uint32_t handle = ocean_t_pirates.handle_of(pirate);
+    if (!checkpoints.empty()) {
+        undo_log.push_back({Undo::MONEY, pirate->pirate_id, handle, pirate->money, {}, {}});
+    }
+    pirate->money = money;
+
+    // A heap not rebuilt since open() reads the balance when it is
+    const int root = fleet_sets.find(pirate->fleet_slot);
+    if (!heap_ready[root]) return;
+    LeftistHeap<uint32_t> heap = fleet_heaps[root];
+    heap.push(money_of(*pirate), pirate->pirate_id, handle);
+
+    // Every pirate has one up-to-date entry. Once the stale ones outnumber
+    // them the heap starts over from the member list, which the payments
+    // since the last rebuild pay for.
+    if (heap.size() > 2 * static_cast<size_t>(fleet_sets.num_pirates(root))) heap = build_heap(root);
+    set_heap(root, heap);
+}
+
+void oceans_t::set_members(int slot, Pirate* last) {
+    if (!checkpoints.empty()) {
+        undo_log.push_back({Undo::MEMBERS, slot, 0, 0, {}, {fleet_members[slot], ocean_t_pirates.none}});
+    }
+    fleet_members[slot] = last ? ocean_t_pirates.handle_of(last) : ocean_t_pirates.none;
+}
+
+Pirate* oceans_t::last_member(int slot) const {
+    const uint32_t last = fleet_members[slot];
+    return last != ocean_t_pirates.none ? ocean_t_pirates.at(last) : nullptr;
+}
 
-    auto parent = fleet->next.lock();
-    auto root = find_set(parent);
+// Joins two circular lists in O(1) by swapping the successors of one
+// member of each. Splicing the same two members again splits them apart,
+// which is how rollback undoes it.
+void oceans_t::splice_members(Pirate* first, Pirate* second) {
+    if (!checkpoints.empty()) {
+        undo_log.push_back({Undo::SPLICE, 0, 0, 0, {},
+                            {ocean_t_pirates.handle_of(first), ocean_t_pirates.handle_of(second)}});
+    }
+    std::swap(first->next_member, second->next_member);
+}
 
-    if (root) {
-        fleet->extra_rank += parent->extra_rank;
-        fleet->next = root;
+// One entry per member of a root fleet, at its current balance
+LeftistHeap<uint32_t> oceans_t::build_heap(int slot) {
+    LeftistHeap<uint32_t> heap;
+    const uint32_t last = fleet_members[slot];
+    if (last != ocean_t_pirates.none) {
+        uint32_t handle = last;
+        do {
+            handle = ocean_t_pirates.at(handle)->next_member;
+            const Pirate& pirate = *ocean_t_pirates.at(handle);
+            heap.push(money_of(pirate), pirate.pirate_id, handle);
+        } while (handle != last);
     }
-    return root;
+    return heap;
+}
+
+// Builds the heap of a root fleet from its member list, the first time it
+// is needed after open()
+void oceans_t::ensure_heap(int slot) {
+    if (heap_ready[slot]) return;
+
+    LeftistHeap<uint32_t> heap = build_heap(slot);
+    if (!checkpoints.empty()) {
+        undo_log.push_back({Undo::READY, slot, 0, 0, {}, {}});
+    }
+    heap_ready[slot] = 1;
+    set_heap(slot, heap);
+}
+
+void oceans_t::set_heap(int slot, const LeftistHeap<uint32_t>& heap) {
+    if (!checkpoints.empty()) {
+        undo_log.push_back({Undo::HEAP, slot, 0, 0, fleet_heaps[slot], {}});
+    }
+    heap_entries += heap.size();
+    heap_entries -= fleet_heaps[slot].size();
+    fleet_heaps[slot] = heap;
 }
 
 StatusType oceans_t::add_fleet(const int fleetId) {
     if (fleetId <= 0) return StatusType::INVALID_INPUT;
     if (ocean_t_fleets.find(fleetId)) return StatusType::FAILURE;
 
-    auto newFleet = std::make_shared<Fleet>(fleetId);
-    ocean_t_fleets.insert(fleetId, newFleet);
+    try {
+        ocean_t_fleets.try_emplace(fleetId, fleetId, fleet_sets.make_set());
+        fleet_heaps.push_back(LeftistHeap<uint32_t>());
+        heap_ready.push_back(1);
+        fleet_members.push_back(ocean_t_pirates.none);
+        if (!checkpoints.empty()) {
+            undo_log.push_back({Undo::ADD_FLEET, fleetId, 0, 0, {}, {}});
+        }
+        publish(FleetChange::ADD_FLEET, fleetId);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
     return StatusType::SUCCESS;
 }
 
@@ -33,98 +131,821 @@ StatusType oceans_t::add_pirate(const int pirateId, const int fleetId) {
     if (pirateId <= 0 || fleetId <= 0) return StatusType::INVALID_INPUT;
     if (ocean_t_pirates.find(pirateId)) return StatusType::FAILURE;
 
-    auto fleet = ocean_t_fleets.find(fleetId);
+    Fleet* fleet = ocean_t_fleets.find(fleetId);
     if (!fleet) return StatusType::FAILURE;
+    if (!fleet_sets.is_root(fleet->slot)) return StatusType::FAILURE;
 
-    auto rootFleet = find_set(fleet);
-    if (rootFleet != fleet) return StatusType::FAILURE;
+    try {
+        const int rank = fleet_sets.add_pirate(fleet->slot);
+        Pirate* newPirate = ocean_t_pirates.try_emplace(pirateId, pirateId, rank, fleet->slot).first;
+        const uint32_t handle = ocean_t_pirates.handle_of(newPirate);
+        newPirate->next_member = handle;
+        // Earlier fleet-wide payments must not reach the new pirate
+        newPirate->money = -fleet_sets.money(fleet->slot);
+        if (!checkpoints.empty()) {
+            undo_log.push_back({Undo::ADD_PIRATE, pirateId, 0, 0, {}, {}});
+        }
 
-    auto newPirate = std::make_shared<Pirate>(pirateId, fleet->num_pirates + 1, fleetId);
-    ocean_t_pirates.insert(pirateId, newPirate);
-    fleet->num_pirates++;
-    fleet->fleet_pirates.insert(pirateId, newPirate);
+        Pirate* last = last_member(fleet->slot);
+        if (last) splice_members(last, newPirate);
+        set_members(fleet->slot, newPirate);
 
+        if (heap_ready[fleet->slot]) {
+            LeftistHeap<uint32_t> heap = fleet_heaps[fleet->slot];
+            heap.push(0, pirateId, handle);
+            set_heap(fleet->slot, heap);
+        }
+
+        publish(FleetChange::ADD_PIRATE, pirateId, fleetId, rank);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
     return StatusType::SUCCESS;
 }
 
 StatusType oceans_t::pay_pirate(const int pirateId, const int salary) {
     if (pirateId <= 0 || salary <= 0) return StatusType::INVALID_INPUT;
-    auto pirate = ocean_t_pirates.find(pirateId);
+    Pirate* pirate = ocean_t_pirates.find(pirateId);
     if (!pirate) return StatusType::FAILURE;
 
-    pirate->money += salary;
+    try {
+        set_money(pirate, pirate->money + salary);
+        publish(FleetChange::PAY_PIRATE, pirateId, salary, pirate->money);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
     return StatusType::SUCCESS;
 }
 
 output_t<int> oceans_t::num_ships_for_fleet(const int fleetId) {
     if (fleetId <= 0) return StatusType::INVALID_INPUT;
-    auto fleet = ocean_t_fleets.find(fleetId);
+    Fleet* fleet = ocean_t_fleets.find(fleetId);
     if (!fleet) return StatusType::FAILURE;
+    if (!fleet_sets.is_root(fleet->slot)) return StatusType::FAILURE;
 
-    auto rootFleet = find_set(fleet);
-    if (!rootFleet || rootFleet != fleet) return StatusType::FAILURE;
-
-    return static_cast<int>(rootFleet->num_ships);
+    return fleet_sets.num_ships(fleet->slot);
 }
 
 output_t<int> oceans_t::get_pirate_money(const int pirateId) {
     if (pirateId <= 0) return StatusType::INVALID_INPUT;
-    auto pirate = ocean_t_pirates.find(pirateId);
+    Pirate* pirate = ocean_t_pirates.find(pirateId);
     if (!pirate) return StatusType::FAILURE;
-
-    return pirate->money;
+    return money_of(*pirate);
 }
 
 StatusType oceans_t::unite_fleets(const int fleetId1, const int fleetId2) {
     if (fleetId1 <= 0 || fleetId2 <= 0 || fleetId1 == fleetId2)
         return StatusType::INVALID_INPUT;
 
-    auto fleet1 = ocean_t_fleets.find(fleetId1);
-    auto fleet2 = ocean_t_fleets.find(fleetId2);
+    Fleet* fleet1 = ocean_t_fleets.find(fleetId1);
+    Fleet* fleet2 = ocean_t_fleets.find(fleetId2);
     if (!fleet1 || !fleet2) return StatusType::FAILURE;
 
-    auto root1 = find_set(fleet1);
-    auto root2 = find_set(fleet2);
-    if (!root1 || !root2) return StatusType::FAILURE;
-    if (root1 != fleet1 || root2 != fleet2) return StatusType::FAILURE;
-    if (fleet1->num_pirates == 0 || fleet2->num_pirates == 0) return StatusType::FAILURE;
+    const int slot1 = fleet1->slot;
+    const int slot2 = fleet2->slot;
+    if (!fleet_sets.is_root(slot1) || !fleet_sets.is_root(slot2)) return StatusType::FAILURE;
 
-    std::shared_ptr<Fleet> primary = (fleet1->num_pirates >= fleet2->num_pirates) ? fleet1 : fleet2;
-    std::shared_ptr<Fleet> secondary = (primary == fleet1) ? fleet2 : fleet1;
+    const int pirates1 = fleet_sets.num_pirates(slot1);
+    const int pirates2 = fleet_sets.num_pirates(slot2);
+    if (pirates1 == 0 || pirates2 == 0) return StatusType::FAILURE;
 
-    secondary->next = primary;
-    secondary->extra_rank += primary->num_pirates;
-    primary->num_pirates += secondary->num_pirates;
-    primary->num_ships += secondary->num_ships;
+    try {
+        const int primary = (pirates1 >= pirates2) ? slot1 : slot2;
+        const int secondary = (primary == slot1) ? slot2 : slot1;
+        link_fleets(primary, secondary);
 
+        publish(FleetChange::UNITE_FLEETS, fleetId1, fleetId2, primary == slot1 ? fleetId1 : fleetId2);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
     return StatusType::SUCCESS;
 }
 
+// Hangs root slot secondary under root slot primary, both with pirates
+void oceans_t::link_fleets(int primary, int secondary) {
+    ensure_heap(primary);
+    ensure_heap(secondary);
+    fleet_sets.link(primary, secondary);
+
+    // Balances do not change on a union, so the heaps meld as they are
+    LeftistHeap<uint32_t> merged = fleet_heaps[primary];
+    LeftistHeap<uint32_t> emptied = fleet_heaps[secondary];
+    merged.meld(emptied);
+    set_heap(primary, merged);
+    set_heap(secondary, emptied);
+
+    // Both fleets have pirates, so both lists exist; the secondary's
+    // pirates are ranked after the primary's and follow them in the list
+    Pirate* last_secondary = last_member(secondary);
+    splice_members(last_member(primary), last_secondary);
+    set_members(primary, last_secondary);
+    set_members(secondary, nullptr);
+}
+
 StatusType oceans_t::pirate_argument(const int pirateId1, const int pirateId2) {
     if (pirateId1 <= 0 || pirateId2 <= 0 || pirateId1 == pirateId2)
         return StatusType::INVALID_INPUT;
 
-    auto pirate1 = ocean_t_pirates.find(pirateId1);
-    auto pirate2 = ocean_t_pirates.find(pirateId2);
+    Pirate* pirate1 = ocean_t_pirates.find(pirateId1);
+    Pirate* pirate2 = ocean_t_pirates.find(pirateId2);
     if (!pirate1 || !pirate2) return StatusType::FAILURE;
 
-    auto fleet1 = ocean_t_fleets.find(pirate1->fleet_id);
-    auto fleet2 = ocean_t_fleets.find(pirate2->fleet_id);
-    auto root1 = find_set(fleet1);
-    auto root2 = find_set(fleet2);
-    if (!root1 || !root2 || root1 != root2) return StatusType::FAILURE;
+    int offset1, offset2;
+    const int root1 = fleet_sets.find(pirate1->fleet_slot, offset1);
+    const int root2 = fleet_sets.find(pirate2->fleet_slot, offset2);
+    if (root1 != root2) return StatusType::FAILURE;
 
-    int extra1 = pirate1->rank + fleet1->extra_rank;
-    int extra2 = pirate2->rank + fleet2->extra_rank;
+    int extra1 = pirate1->rank + offset1;
+    int extra2 = pirate2->rank + offset2;
     int d = abs(extra1 - extra2);
 
-    if (extra1 > extra2) {
-        pirate1->money -= d;
-        pirate2->money += d;
-    } else {
-        pirate1->money += d;
-        pirate2->money -= d;
+    try {
+        const int gain1 = extra1 > extra2 ? -d : d;
+        set_money(pirate1, pirate1->money + gain1);
+        set_money(pirate2, pirate2->money - gain1);
+
+        publish(FleetChange::PIRATE_ARGUMENT, pirateId1, pirateId2, gain1);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
     }
+    return StatusType::SUCCESS;
+}
 
+StatusType oceans_t::pay_fleet(const int fleetId, const int amount) {
+    if (fleetId <= 0 || amount <= 0) return StatusType::INVALID_INPUT;
+    Fleet* fleet = ocean_t_fleets.find(fleetId);
+    if (!fleet) return StatusType::FAILURE;
+    if (!fleet_sets.is_root(fleet->slot)) return StatusType::FAILURE;
+
+    try {
+        fleet_sets.pay(fleet->slot, amount);
+
+        if (heap_ready[fleet->slot]) {
+            LeftistHeap<uint32_t> heap = fleet_heaps[fleet->slot];
+            heap.add_all(amount);
+            set_heap(fleet->slot, heap);
+        }
+        publish(FleetChange::PAY_FLEET, fleetId, amount);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
     return StatusType::SUCCESS;
 }
+
+output_t<int> oceans_t::get_richest_pirate(const int fleetId) {
+    if (fleetId <= 0) return StatusType::INVALID_INPUT;
+    Fleet* fleet = ocean_t_fleets.find(fleetId);
+    if (!fleet) return StatusType::FAILURE;
+    if (!fleet_sets.is_root(fleet->slot)) return StatusType::FAILURE;
+    if (fleet_sets.num_pirates(fleet->slot) == 0) return StatusType::FAILURE;
+
+    try {
+        ensure_heap(fleet->slot);
+
+        // Every pirate has an up-to-date entry, so this stops at one of them
+        LeftistHeap<uint32_t> heap = fleet_heaps[fleet->slot];
+        bool dropped = false;
+        while (heap.top_key() != money_of(*ocean_t_pirates.at(heap.top_item()))) {
+            heap.pop();
+            dropped = true;
+        }
+        if (dropped) set_heap(fleet->slot, heap);
+        return heap.top_id();
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+}
+
+StatusType oceans_t::get_fleet_pirates(const int fleetId, std::vector<int>& pirateIds) {
+    if (fleetId <= 0) return StatusType::INVALID_INPUT;
+    Fleet* fleet = ocean_t_fleets.find(fleetId);
+    if (!fleet) return StatusType::FAILURE;
+    if (!fleet_sets.is_root(fleet->slot)) return StatusType::FAILURE;
+
+    pirateIds.clear();
+    Pirate* last = last_member(fleet->slot);
+    if (!last) return StatusType::SUCCESS;
+
+    try {
+        pirateIds.reserve(fleet_sets.num_pirates(fleet->slot));
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    Pirate* pirate = last;
+    do {
+        pirate = ocean_t_pirates.at(pirate->next_member);
+        pirateIds.push_back(pirate->pirate_id);
+    } while (pirate != last);
+
+    return StatusType::SUCCESS;
+}
+
+static FleetResult to_result(StatusType status) {
+    return {status, 0};
+}
+
+static FleetResult to_result(output_t<int> output) {
+    return {output.status(), output.ans()};
+}
+
+StatusType oceans_t::replay(const std::vector<FleetCommand>& commands,
+                            std::vector<FleetResult>& results) {
+    // Size every table for the whole log first, so the replay itself
+    // never rehashes or regrows an array
+    size_t newFleets = 0, newPirates = 0;
+    for (const FleetCommand& command : commands) {
+        if (command.op == FleetCommand::ADD_FLEET) ++newFleets;
+        if (command.op == FleetCommand::ADD_PIRATE) ++newPirates;
+    }
+    // Fleet arrays grow at least geometrically, so that replaying many
+    // small batches (as the server does) stays amortized O(1) per fleet
+    size_t fleets = ocean_t_fleets.size() + newFleets;
+    if (fleets > fleet_heaps.capacity()) {
+        fleets = std::max(fleets, 2 * fleet_heaps.capacity());
+    }
+    results.clear();
+    try {
+        reserve(fleets, ocean_t_pirates.size() + newPirates);
+        results.reserve(commands.size());
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    for (const FleetCommand& command : commands) results.push_back(run(command));
+    return StatusType::SUCCESS;
+}
+
+FleetResult oceans_t::run(const FleetCommand& command) {
+    const int a = command.arg1;
+    const int b = command.arg2;
+    switch (command.op) {
+        case FleetCommand::ADD_FLEET:           return to_result(add_fleet(a));
+        case FleetCommand::ADD_PIRATE:          return to_result(add_pirate(a, b));
+        case FleetCommand::PAY_PIRATE:          return to_result(pay_pirate(a, b));
+        case FleetCommand::NUM_SHIPS_FOR_FLEET: return to_result(num_ships_for_fleet(a));
+        case FleetCommand::GET_PIRATE_MONEY:    return to_result(get_pirate_money(a));
+        case FleetCommand::UNITE_FLEETS:        return to_result(unite_fleets(a, b));
+        case FleetCommand::PIRATE_ARGUMENT:     return to_result(pirate_argument(a, b));
+        case FleetCommand::PAY_FLEET:           return to_result(pay_fleet(a, b));
+        case FleetCommand::GET_RICHEST_PIRATE:  return to_result(get_richest_pirate(a));
+    }
+    return to_result(StatusType::INVALID_INPUT);
+}
+
+// Runs work over [0, count) in slices of at least grain, each slice but
+// the first on a thread of its own. A slice that cannot get a thread runs
+// in the caller instead.
+static const size_t parallel_grain = 4096;
+
+template <class Work>
+static void parallel_for(size_t count, unsigned threads, Work work, size_t grain = parallel_grain) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    const size_t slices = std::min<size_t>(std::max(threads, 1u), count / grain);
+    if (slices <= 1) {
+        work(0, count);
+        return;
+    }
+
+    std::vector<std::future<void>> forked;
+    try {
+        forked.reserve(slices - 1);
+        for (size_t i = 1; i < slices; ++i) {
+            const size_t first = count * i / slices;
+            const size_t last = count * (i + 1) / slices;
+            forked.push_back(std::async(std::launch::async, [=] { work(first, last); }));
+        }
+    } catch (const std::exception&) {
+        for (size_t i = forked.size() + 1; i < slices; ++i) work(count * i / slices, count * (i + 1) / slices);
+    }
+    work(0, count / slices);
+    for (auto& slice : forked) slice.get();
+}
+
+StatusType oceans_t::unite_fleets_parallel(const std::vector<std::pair<int, int>>& pairs,
+                                            std::vector<StatusType>& results, unsigned threads) {
+    const size_t count = pairs.size();
+    std::vector<int> roots;                   // Distinct root slots of the pairs, sorted
+    std::vector<std::pair<int, int>> united;  // Indices into roots, or -1
+    std::vector<ConcurrentUnionFind::Link> links;
+    std::unique_ptr<ConcurrentUnionFind> sets;
+    try {
+        results.assign(count, StatusType::FAILURE);
+        united.assign(count, {-1, -1});
+        links.resize(count);
+
+        // A slot that is not a root, or has no pirates, stays that way for
+        // the whole batch, so such pairs fail in any order
+        for (size_t i = 0; i < count; ++i) {
+            const int fleetId1 = pairs[i].first;
+            const int fleetId2 = pairs[i].second;
+            if (fleetId1 <= 0 || fleetId2 <= 0 || fleetId1 == fleetId2) {
+                results[i] = StatusType::INVALID_INPUT;
+                continue;
+            }
+            const Fleet* fleet1 = ocean_t_fleets.find(fleetId1);
+            const Fleet* fleet2 = ocean_t_fleets.find(fleetId2);
+            if (!fleet1 || !fleet2) continue;
+            if (!fleet_sets.is_root(fleet1->slot) || !fleet_sets.is_root(fleet2->slot)) continue;
+            if (fleet_sets.num_pirates(fleet1->slot) == 0 || fleet_sets.num_pirates(fleet2->slot) == 0) continue;
+            united[i] = {fleet1->slot, fleet2->slot};
+            roots.push_back(fleet1->slot);
+            roots.push_back(fleet2->slot);
+        }
+        std::sort(roots.begin(), roots.end());
+        roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+        sets.reset(new ConcurrentUnionFind(static_cast<int>(roots.size())));
+        for (int slot : roots) sets->make_set(fleet_sets.num_ships(slot), fleet_sets.num_pirates(slot));
+        auto index_of = [&](int slot) {
+            return static_cast<int>(std::lower_bound(roots.begin(), roots.end(), slot) - roots.begin());
+        };
+        for (std::pair<int, int>& pair : united) {
+            if (pair.first >= 0) pair = {index_of(pair.first), index_of(pair.second)};
+        }
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+
+    parallel_for(count, threads, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            if (united[i].first >= 0 && sets->link_roots(united[i].first, united[i].second, &links[i])) {
+                results[i] = StatusType::SUCCESS;
+            }
+        }
+    });
+
+    // Applied in the order the unions took effect, every primary has the
+    // pirate count its link was decided on, so fleet_sets.link gives the
+    // same rank offsets
+    std::vector<size_t> order;
+    try {
+        for (size_t i = 0; i < count; ++i) {
+            if (results[i] == StatusType::SUCCESS) order.push_back(i);
+        }
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return links[a].sequence < links[b].sequence; });
+
+    for (size_t i : order) {
+        const int primary = roots[links[i].primary];
+        const bool first_is_primary = links[i].primary == united[i].first;
+        try {
+            link_fleets(primary, roots[links[i].secondary]);
+        } catch (const std::bad_alloc&) {
+            return StatusType::ALLOCATION_ERROR;
+        }
+        publish(FleetChange::UNITE_FLEETS, pairs[i].first, pairs[i].second,
+                first_is_primary ? pairs[i].first : pairs[i].second);
+    }
+    return StatusType::SUCCESS;
+}
+
+// Sorts items with one run per thread, then merges the runs pairwise
+template <class T>
+static void parallel_sort(std::vector<T>& items, unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    const size_t runs = std::min<size_t>(std::max(threads, 1u), items.size() / parallel_grain);
+    if (runs <= 1) {
+        std::sort(items.begin(), items.end());
+        return;
+    }
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= runs; ++i) bounds.push_back(items.size() * i / runs);
+    parallel_for(runs, threads, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) std::sort(items.begin() + bounds[i], items.begin() + bounds[i + 1]);
+    }, 1);
+    while (bounds.size() > 2) {
+        parallel_for((bounds.size() - 1) / 2, threads, [&](size_t first, size_t last) {
+            for (size_t i = 2 * first; i < 2 * last; i += 2) {
+                std::inplace_merge(items.begin() + bounds[i], items.begin() + bounds[i + 1],
+                                   items.begin() + bounds[i + 2]);
+            }
+        }, 1);
+        std::vector<size_t> merged;
+        for (size_t i = 0; i < bounds.size(); i += 2) merged.push_back(bounds[i]);
+        if (bounds.size() % 2 == 0) merged.push_back(bounds.back());
+        bounds.swap(merged);
+    }
+}
+
+// Fleets and pirates share one key space in the offline pass
+static int64_t fleet_key(int id) { return 2 * static_cast<int64_t>(id); }
+static int64_t pirate_key(int id) { return 2 * static_cast<int64_t>(id) + 1; }
+
+// Fails whatever the state: the argument checks every command makes first
+static bool invalid_arguments(const FleetCommand& command) {
+    const int a = command.arg1;
+    const int b = command.arg2;
+    switch (command.op) {
+        case FleetCommand::ADD_PIRATE:
+        case FleetCommand::PAY_PIRATE:
+        case FleetCommand::PAY_FLEET:       return a <= 0 || b <= 0;
+        case FleetCommand::UNITE_FLEETS:
+        case FleetCommand::PIRATE_ARGUMENT: return a <= 0 || b <= 0 || a == b;
+        default:                            return a <= 0;
+    }
+}
+
+// The fleets and pirates a command reads or changes, as keys; the second
+// is 0 for commands of one argument
+static void keys_of(const FleetCommand& command, int64_t keys[2]) {
+    const int a = command.arg1;
+    const int b = command.arg2;
+    keys[1] = 0;
+    switch (command.op) {
+        case FleetCommand::ADD_PIRATE:      keys[0] = pirate_key(a); keys[1] = fleet_key(b); break;
+        case FleetCommand::PAY_PIRATE:
+        case FleetCommand::GET_PIRATE_MONEY: keys[0] = pirate_key(a); break;
+        case FleetCommand::UNITE_FLEETS:    keys[0] = fleet_key(a); keys[1] = fleet_key(b); break;
+        case FleetCommand::PIRATE_ARGUMENT: keys[0] = pirate_key(a); keys[1] = pirate_key(b); break;
+        default:                            keys[0] = fleet_key(a); break;
+    }
+}
+
+// Shiloach-Vishkin hooking as in Afforest: the higher of two roots is
+// hooked under the lower by CAS, so labels only ever go down and every
+// component ends up labelled by its lowest vertex
+static void link_components(std::atomic<int>* label, int u, int v) {
+    int p1 = label[u].load(std::memory_order_relaxed);
+    int p2 = label[v].load(std::memory_order_relaxed);
+    while (p1 != p2) {
+        const int high = std::max(p1, p2);
+        const int low = std::min(p1, p2);
+        int p_high = label[high].load(std::memory_order_relaxed);
+        if (p_high == low) return;
+        if (p_high == high && label[high].compare_exchange_strong(p_high, low, std::memory_order_relaxed)) return;
+        p1 = label[label[high].load(std::memory_order_relaxed)].load(std::memory_order_relaxed);
+        p2 = label[low].load(std::memory_order_relaxed);
+    }
+}
+
+static void compress_components(std::atomic<int>* label, size_t count, unsigned threads) {
+    parallel_for(count, threads, [&](size_t first, size_t last) {
+        for (size_t v = first; v < last; ++v) {
+            int up = label[v].load(std::memory_order_relaxed);
+            int top = label[up].load(std::memory_order_relaxed);
+            while (up != top) {
+                label[v].store(top, std::memory_order_relaxed);
+                up = top;
+                top = label[up].load(std::memory_order_relaxed);
+            }
+        }
+    });
+}
+
+StatusType oceans_t::replay_offline(const std::vector<FleetCommand>& commands,
+                                    std::vector<FleetResult>& results, unsigned threads) {
+    if (ocean_t_fleets.size() != 0 || ocean_t_pirates.size() != 0 || feed || !checkpoints.empty()) {
+        return replay(commands, results);
+    }
+    try {
+        replay_shards(commands, results, threads);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    return StatusType::SUCCESS;
+}
+
+// replay_offline on an empty ocean. Everything is allocated before the
+// shards are adopted, so memory running out leaves this ocean empty.
+void oceans_t::replay_shards(const std::vector<FleetCommand>& commands,
+                             std::vector<FleetResult>& results, unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t count = commands.size();
+    results.assign(count, to_result(StatusType::INVALID_INPUT));
+
+    // Every fleet and pirate the log names gets a vertex
+    std::vector<int64_t> keys(2 * count, 0);
+    parallel_for(count, threads, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            if (!invalid_arguments(commands[i])) keys_of(commands[i], &keys[2 * i]);
+        }
+    });
+    std::vector<int64_t> vertices(keys);
+    parallel_sort(vertices, threads);
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+    if (!vertices.empty() && vertices[0] == 0) vertices.erase(vertices.begin());
+    std::vector<int> ends(2 * count, -1);
+    parallel_for(count, threads, [&](size_t first, size_t last) {
+        for (size_t i = 2 * first; i < 2 * last; ++i) {
+            if (keys[i] != 0) {
+                ends[i] = static_cast<int>(std::lower_bound(vertices.begin(), vertices.end(), keys[i]) - vertices.begin());
+            }
+        }
+    });
+    std::vector<int64_t>().swap(keys);
+
+    // unite_fleets and add_pirate join their two vertices; every add_pirate
+    // does, failed or not, since a pirate ID taken in one fleet makes it
+    // fail in another. Afforest's sampling: link one edge in eight, guess
+    // the largest component from the labels, then skip the remaining edges
+    // inside it.
+    const size_t vertex_count = vertices.size();
+    std::unique_ptr<std::atomic<int>[]> label(new std::atomic<int>[vertex_count]);
+    parallel_for(vertex_count, threads, [&](size_t first, size_t last) {
+        for (size_t v = first; v < last; ++v) label[v].store(static_cast<int>(v), std::memory_order_relaxed);
+    });
+    auto joins = [&](size_t i) {
+        return (commands[i].op == FleetCommand::UNITE_FLEETS || commands[i].op == FleetCommand::ADD_PIRATE) &&
+               ends[2 * i] >= 0;
+    };
+    parallel_for(count, threads, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            if (i % 8 == 0 && joins(i)) link_components(label.get(), ends[2 * i], ends[2 * i + 1]);
+        }
+    });
+    compress_components(label.get(), vertex_count, threads);
+    int largest = -1;
+    if (vertex_count > 0) {
+        std::vector<int> sample;
+        for (size_t i = 0; i < 1024; ++i) {
+            sample.push_back(label[i * 2654435761u % vertex_count].load(std::memory_order_relaxed));
+        }
+        std::sort(sample.begin(), sample.end());
+        size_t best = 0;
+        for (size_t i = 0, j; i < sample.size(); i = j) {
+            for (j = i; j < sample.size() && sample[j] == sample[i]; ++j) {}
+            if (j - i > best) {
+                best = j - i;
+                largest = sample[i];
+            }
+        }
+    }
+    parallel_for(count, threads, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            if (i % 8 == 0 || !joins(i)) continue;
+            const int u = ends[2 * i];
+            const int v = ends[2 * i + 1];
+            if (label[u].load(std::memory_order_relaxed) == largest &&
+                label[v].load(std::memory_order_relaxed) == largest) continue;
+            link_components(label.get(), u, v);
+        }
+    });
+    compress_components(label.get(), vertex_count, threads);
+
+    // Components go to shards in runs of about equal command counts. An
+    // argument between pirates of two components fails whatever the order,
+    // like any command with invalid arguments, and goes to no shard.
+    std::vector<int> shard_of(count, -1);
+    std::vector<size_t> weight(vertex_count + 1, 0);
+    size_t assigned = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (ends[2 * i] < 0) continue;
+        const int component = label[ends[2 * i]].load(std::memory_order_relaxed);
+        if (commands[i].op == FleetCommand::PIRATE_ARGUMENT &&
+            label[ends[2 * i + 1]].load(std::memory_order_relaxed) != component) {
+            results[i] = to_result(StatusType::FAILURE);
+            continue;
+        }
+        shard_of[i] = component;
+        ++weight[component + 1];
+        ++assigned;
+    }
+    for (size_t v = 0; v < vertex_count; ++v) weight[v + 1] += weight[v];
+    for (size_t i = 0; i < count; ++i) {
+        if (shard_of[i] >= 0) shard_of[i] = static_cast<int>(weight[shard_of[i]] * threads / assigned);
+    }
+    std::unique_ptr<std::atomic<int>[]>().swap(label);
+    std::vector<int>().swap(ends);
+
+    // Each shard's commands in log order
+    std::vector<size_t> start(threads + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (shard_of[i] >= 0) ++start[shard_of[i] + 1];
+    }
+    for (unsigned shard = 0; shard < threads; ++shard) start[shard + 1] += start[shard];
+    std::vector<size_t> order(assigned);
+    std::vector<size_t> next(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < count; ++i) {
+        if (shard_of[i] >= 0) order[next[shard_of[i]]++] = i;
+    }
+
+    std::vector<std::unique_ptr<oceans_t>> shards(threads);
+    parallel_for(threads, threads, [&](size_t first, size_t last) {
+        for (size_t shard = first; shard < last; ++shard) {
+            shards[shard].reset(new oceans_t());
+            for (size_t j = start[shard]; j < start[shard + 1]; ++j) {
+                results[order[j]] = shards[shard]->run(commands[order[j]]);
+            }
+        }
+    }, 1);
+
+    size_t fleets = 0, pirates = 0;
+    for (const std::unique_ptr<oceans_t>& shard : shards) {
+        fleets += shard->ocean_t_fleets.size();
+        pirates += shard->ocean_t_pirates.size();
+    }
+    if (fleets == 0) return;
+    reserve(fleets, pirates);
+    for (const std::unique_ptr<oceans_t>& shard : shards) adopt(*shard);
+}
+
+// Moves a shard's fleets and pirates, which this ocean does not have, in
+// after its own. Slots shift by the current slot count; member lists are
+// relinked by pirate ID, and heaps are left to be built when first needed,
+// as after open().
+void oceans_t::adopt(const oceans_t& shard) {
+    const int base = fleet_sets.size();
+    fleet_sets.append(shard.fleet_sets);
+    for (int slot = 0; slot < shard.fleet_sets.size(); ++slot) {
+        fleet_heaps.push_back(LeftistHeap<uint32_t>());
+        heap_ready.push_back(0);
+    }
+    shard.ocean_t_fleets.for_each([&](int fleetId, const Fleet& fleet) {
+        ocean_t_fleets.try_emplace(fleetId, fleetId, base + fleet.slot);
+    });
+    shard.ocean_t_pirates.for_each([&](int pirateId, const Pirate& pirate) {
+        Pirate* moved = ocean_t_pirates.try_emplace(pirateId, pirateId, pirate.rank, base + pirate.fleet_slot).first;
+        moved->money = pirate.money;
+    });
+    auto moved_handle = [&](uint32_t handle) {
+        return ocean_t_pirates.handle_of(ocean_t_pirates.find(shard.ocean_t_pirates.at(handle)->pirate_id));
+    };
+    shard.ocean_t_pirates.for_each([&](int pirateId, const Pirate& pirate) {
+        ocean_t_pirates.find(pirateId)->next_member = moved_handle(pirate.next_member);
+    });
+    for (int slot = 0; slot < shard.fleet_sets.size(); ++slot) {
+        const uint32_t last = shard.fleet_members[slot];
+        fleet_members.push_back(last != shard.ocean_t_pirates.none ? moved_handle(last) : ocean_t_pirates.none);
+    }
+}
+
+StatusType oceans_t::checkpoint() {
+    try {
+        checkpoints.push_back({undo_log.size(), 0});
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    checkpoints.back().union_find_mark = fleet_sets.checkpoint();
+    publish(FleetChange::CHECKPOINT);
+    return StatusType::SUCCESS;
+}
+
+StatusType oceans_t::rollback() {
+    if (checkpoints.empty()) return StatusType::FAILURE;
+    const Checkpoint mark = checkpoints.back();
+    checkpoints.pop_back();
+
+    while (undo_log.size() > mark.undo_size) {
+        const Undo& undo = undo_log.back();
+        if (undo.kind == Undo::MONEY) {
+            ocean_t_pirates.at(undo.pirate)->money = undo.money;
+        } else if (undo.kind == Undo::HEAP) {
+            heap_entries += undo.heap.size();
+            heap_entries -= fleet_heaps[undo.id].size();
+            fleet_heaps[undo.id] = undo.heap;
+        } else if (undo.kind == Undo::ADD_PIRATE) {
+            ocean_t_pirates.remove(undo.id);
+        } else if (undo.kind == Undo::MEMBERS) {
+            fleet_members[undo.id] = undo.members[0];
+        } else if (undo.kind == Undo::SPLICE) {
+            std::swap(ocean_t_pirates.at(undo.members[0])->next_member,
+                      ocean_t_pirates.at(undo.members[1])->next_member);
+        } else if (undo.kind == Undo::READY) {
+            heap_ready[undo.id] = 0;
+        } else {
+            ocean_t_fleets.remove(undo.id);
+            heap_entries -= fleet_heaps.back().size();
+            fleet_heaps.pop_back();
+            heap_ready.pop_back();
+            fleet_members.pop_back();
+        }
+        undo_log.pop_back();
+    }
+    fleet_sets.rollback(mark.union_find_mark);
+
+    if (checkpoints.empty()) fleet_sets.stop_recording();
+    publish(FleetChange::ROLLBACK);
+    return StatusType::SUCCESS;
+}
+
+StatusType oceans_t::commit() {
+    if (checkpoints.empty()) return StatusType::FAILURE;
+    checkpoints.pop_back();
+
+    if (checkpoints.empty()) {
+        undo_log.clear();
+        fleet_sets.stop_recording();
+    }
+    publish(FleetChange::COMMIT);
+    return StatusType::SUCCESS;
+}
+
+void oceans_t::publish(FleetChange::Op op, int arg1, int arg2, int arg3) {
+    last_change = {op, {arg1, arg2, arg3}};
+    if (feed) feed->publish(last_change);
+}
+
+void oceans_t::attach_feed(FleetFeed* feed) {
+    this->feed = feed;
+}
+
+StatusType oceans_t::apply_change(const FleetChange& change) {
+    const int a = change.args[0];
+    const int b = change.args[1];
+    last_change.op = FleetChange::NONE;
+
+    StatusType status;
+    switch (change.op) {
+        case FleetChange::ADD_FLEET:       status = add_fleet(a); break;
+        case FleetChange::ADD_PIRATE:      status = add_pirate(a, b); break;
+        case FleetChange::PAY_PIRATE:      status = pay_pirate(a, b); break;
+        case FleetChange::UNITE_FLEETS:    status = unite_fleets(a, b); break;
+        case FleetChange::PIRATE_ARGUMENT: status = pirate_argument(a, b); break;
+        case FleetChange::PAY_FLEET:       status = pay_fleet(a, b); break;
+        case FleetChange::CHECKPOINT:      status = checkpoint(); break;
+        case FleetChange::ROLLBACK:        status = rollback(); break;
+        case FleetChange::COMMIT:          status = commit(); break;
+        default:                           return StatusType::INVALID_INPUT;
+    }
+    if (status != StatusType::SUCCESS) return status;
+    return last_change == change ? StatusType::SUCCESS : StatusType::FAILURE;
+}
+
+StatusType oceans_t::open(const char* directory) {
+    if (!directory || !*directory) return StatusType::INVALID_INPUT;
+    if (saved_state.file_backed() || !checkpoints.empty() ||
+        ocean_t_fleets.size() != 0 || ocean_t_pirates.size() != 0) {
+        return StatusType::FAILURE;
+    }
+    // The journal first: it makes and locks the directory, and finishes
+    // any flush that was cut short
+    const std::string prefix = std::string(directory) + "/";
+    if (!journal.open(directory)) return StatusType::FAILURE;
+    if (!saved_state.open(prefix + "state")) {
+        close_files();
+        return StatusType::FAILURE;
+    }
+    const bool fresh = saved_state.empty();
+    if (!fresh && saved_state[0] != SAVED) {
+        close_files();
+        return StatusType::FAILURE;
+    }
+
+    // Every fleet has one Union-Find slot and one member list, even after
+    // it was united into another
+    if (!ocean_t_fleets.open(prefix + "fleets") || !ocean_t_pirates.open(prefix + "pirates") ||
+        !fleet_sets.open(prefix + "sets.") || !fleet_members.open(prefix + "members") ||
+        static_cast<size_t>(fleet_sets.size()) != ocean_t_fleets.size() ||
+        fleet_members.size() != ocean_t_fleets.size() ||
+        (fresh && (ocean_t_fleets.size() != 0 || ocean_t_pirates.size() != 0))) {
+        close_files();
+        return StatusType::FAILURE;
+    }
+
+    try {
+        fleet_heaps.assign(ocean_t_fleets.size(), LeftistHeap<uint32_t>());
+        heap_ready.assign(ocean_t_fleets.size(), 0);
+        if (fresh) saved_state.push_back(SAVED);
+    } catch (const std::bad_alloc&) {
+        close_files();
+        return StatusType::ALLOCATION_ERROR;
+    }
+    heap_entries = 0;
+    if (fresh && flush() != StatusType::SUCCESS) {
+        close_files();
+        return StatusType::FAILURE;
+    }
+    return StatusType::SUCCESS;
+}
+
+// Drops any files open() got to, leaving the empty ocean in memory
+void oceans_t::close_files() {
+    ocean_t_fleets.close();
+    ocean_t_pirates.close();
+    fleet_sets.close();
+    fleet_members.close();
+    saved_state.close();
+    journal.close();
+}
+
+StatusType oceans_t::flush() {
+    if (!saved_state.file_backed() || !checkpoints.empty()) return StatusType::FAILURE;
+    std::vector<MappedRegion*> regions;
+    try {
+        ocean_t_fleets.regions(regions);
+        ocean_t_pirates.regions(regions);
+        fleet_sets.regions(regions);
+        fleet_members.regions(regions);
+        saved_state.regions(regions);
+    } catch (const std::bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    return journal.commit(regions) ? StatusType::SUCCESS : StatusType::FAILURE;
+}
+
+MemoryUsage oceans_t::memory_usage() const {
+    MemoryUsage usage = ocean_t_fleets.memory_usage();
+    usage += ocean_t_pirates.memory_usage();
+    usage += fleet_sets.memory_usage();
+    usage.add_vector(fleet_heaps, usage.payload);
+    usage.add_vector(heap_ready, usage.payload);
+    usage.add_vector(fleet_members, usage.payload);
+    usage.add_vector(undo_log, usage.payload);
+    usage.add_vector(checkpoints, usage.payload);
+
+    const size_t live = std::min(heap_entries, ocean_t_pirates.size());
+    usage += LeftistHeap<uint32_t>::entry_usage(live);
+    usage.slack += LeftistHeap<uint32_t>::entry_usage(heap_entries - live).total();
+    return usage;
+}
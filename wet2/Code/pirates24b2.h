@@ -1,19 +1,116 @@
 #pragma once
 #include "wet2util.h"
+#include "ChangeFeed.h"
+#include "MappedHashTable.h"
+#include "MappedJournal.h"
+#include "MappedVector.h"
 #include "Fleet.h"
+#include "UnionFind.h"
+#include "LeftistHeap.h"
 #include <memory>
+#include <utility>
+#include <vector>
+
+// One entry of a command log for oceans_t::replay.
+struct FleetCommand {
+    enum Op {
+        ADD_FLEET, ADD_PIRATE, PAY_PIRATE, NUM_SHIPS_FOR_FLEET, GET_PIRATE_MONEY,
+        UNITE_FLEETS, PIRATE_ARGUMENT, PAY_FLEET, GET_RICHEST_PIRATE
+    } op;
+    int arg1;
+    int arg2;
+};
+
+struct FleetResult {
+    StatusType status;
+    int ans; // 0 for commands without an answer
+};
 
 class oceans_t {
 private:
-    HashTable<int, Fleet> ocean_t_fleets;
-    HashTable<int, Pirate> ocean_t_pirates;
+    // The tables, the Union-Find and the member lists link by index, never
+    // by pointer. They are on the heap and grow like std::vector; open()
+    // moves them into files (see MappedVector.h). Since they may move,
+    // everything kept across calls names a pirate by its handle in
+    // ocean_t_pirates.
+    MappedHashTable<int, Fleet> ocean_t_fleets;
+    MappedHashTable<int, Pirate> ocean_t_pirates;
+    UnionFind fleet_sets;
+
+    // Pirates of each root fleet by money, as handles. An entry is pushed
+    // whenever a pirate's balance changes; entries that no longer match the
+    // pirate's balance are dropped lazily when they reach the top, and the
+    // whole heap is rebuilt once they outnumber the fleet's pirates, so a
+    // heap never holds more than twice as many entries as pirates.
+    std::vector<LeftistHeap<uint32_t>> fleet_heaps;
+    size_t heap_entries = 0;  // Sum of the sizes of fleet_heaps
+
+    // The heaps are in memory only. After open() none is ready, and each
+    // is rebuilt from its member list the first time it is needed.
+    std::vector<char> heap_ready;
+
+    // Handle of the last pirate of each root fleet's circular member list,
+    // in rank order, or none. unite_fleets splices the secondary's list
+    // after the primary's.
+    MappedVector<uint32_t> fleet_members;
+
+    // One word saved next to the files once they hold an ocean. The files
+    // are mapped privately and only change on flush(), through journal,
+    // which also holds the lock on the directory (see MappedJournal.h).
+    enum { SAVED = 1 };
+    MappedVector<uint32_t> saved_state;
+    MappedJournal journal;
+
+    // Undo log for what-if mode: everything oceans_t changes outside the
+    // Union-Find, undone in reverse order on rollback.
+    struct Undo {
+        enum Kind { MONEY, ADD_PIRATE, ADD_FLEET, HEAP, MEMBERS, SPLICE, READY } kind;
+        int id;                         // pirate or fleet ID, slot for HEAP, MEMBERS and READY
+        uint32_t pirate;                // MONEY only: handle
+        int money;                      // MONEY only: balance before the change
+        LeftistHeap<uint32_t> heap;     // HEAP only: heap before the change
+        uint32_t members[2];            // MEMBERS: previous last handle; SPLICE: both lists
+    };
+    struct Checkpoint {
+        size_t undo_size;
+        int union_find_mark;
+    };
+    std::vector<Undo> undo_log;
+    std::vector<Checkpoint> checkpoints;
 
-    std::shared_ptr<Fleet> find_set(std::shared_ptr<Fleet> fleet);
+    // Every successful change is kept in last_change, which apply_change
+    // checks, and published to feed if one is attached
+    FleetFeed* feed = nullptr;
+    FleetChange last_change = {FleetChange::NONE, {0, 0, 0}};
+
+    void publish(FleetChange::Op op, int arg1 = 0, int arg2 = 0, int arg3 = 0);
+    void reserve(size_t fleets, size_t pirates);
+    int money_of(const Pirate& pirate);
+    void set_money(Pirate* pirate, int money);
+    void set_heap(int slot, const LeftistHeap<uint32_t>& heap);
+    void set_members(int slot, Pirate* last);
+    Pirate* last_member(int slot) const;
+    void splice_members(Pirate* first, Pirate* second);
+    LeftistHeap<uint32_t> build_heap(int slot);
+    void ensure_heap(int slot);
+    void link_fleets(int primary, int secondary);
+    FleetResult run(const FleetCommand& command);
+    void replay_shards(const std::vector<FleetCommand>& commands, std::vector<FleetResult>& results,
+                       unsigned threads);
+    void adopt(const oceans_t& shard);
+    void close_files();
 
 public:
     oceans_t();
     virtual ~oceans_t();
 
+    // Sizes the tables, arrays and node pools for the expected totals.
+    // Heap entries are pooled too but not reserved: there are up to two
+    // per pirate, depending on the payments made since each rebuild.
+    oceans_t(int expectedFleets, int expectedPirates);
+
+    // Every operation that allocates returns ALLOCATION_ERROR when memory
+    // runs out, here and below.
     StatusType add_fleet(const int fleetId);
     StatusType add_pirate(const int pirateId, const int fleetId);
     StatusType pay_pirate(const int pirateId, const int salary);
@@ -21,5 +118,69 @@ public:
     output_t<int> get_pirate_money(const int pirateId);
     StatusType unite_fleets(const int fleetId1, const int fleetId2);
     StatusType pirate_argument(const int pirateId1, const int pirateId2);
+    StatusType pay_fleet(const int fleetId, const int amount);
+    output_t<int> get_richest_pirate(const int fleetId);
+    StatusType get_fleet_pirates(const int fleetId, std::vector<int>& pirateIds);
+
+    // Batch mode: replays a whole command log, writing one result per
+    // command. Results are identical to issuing the commands one by one.
+    // ALLOCATION_ERROR, with nothing replayed, if the tables cannot be
+    // sized for the log.
+    StatusType replay(const std::vector<FleetCommand>& commands, std::vector<FleetResult>& results);
+
+    // Offline batch mode, for rebuilding an ocean from its whole log: the
+    // same results and final state as replay, with the work spread over
+    // threads threads (0: one per core). A parallel connected-components
+    // pass over fleets and pirates, joined by every unite_fleets and
+    // add_pirate, splits the log into groups that never touch each other.
+    // The groups are replayed into one shard ocean per thread, each in log
+    // order, and the shards are then moved into this one. Falls back to
+    // replay unless this ocean is empty, has no feed and no checkpoint.
+    // ALLOCATION_ERROR, leaving this ocean empty, if memory runs out.
+    StatusType replay_offline(const std::vector<FleetCommand>& commands, std::vector<FleetResult>& results,
+                              unsigned threads = 0);
+
+    // Parallel merges: unites each pair of fleets as unite_fleets would,
+    // deciding the unions on threads threads (0: one per core) through a
+    // ConcurrentUnionFind. Results are those of issuing the pairs one by
+    // one in some order, the order the unions took effect in; the heaps
+    // and member lists are then merged, and the unions published, in that
+    // order on the calling thread.
+    StatusType unite_fleets_parallel(const std::vector<std::pair<int, int>>& pairs,
+                                     std::vector<StatusType>& results, unsigned threads = 0);
+
+    // What-if mode. checkpoint() may be nested; rollback() undoes every
+    // change since the matching checkpoint, commit() keeps them.
+    StatusType checkpoint();
+    StatusType rollback();
+    StatusType commit();
+
+    // Replication. With a feed attached, every successful change is
+    // published to it as a FleetChange (see ChangeFeed.h), in the order
+    // the changes are made. apply_change makes the same change to this
+    // ocean, a replica of the publisher, and fails if it does not come out
+    // as the publisher's did: the replica missed a record or did not start
+    // from the same state. A replica may publish to a feed of its own.
+    void attach_feed(FleetFeed* feed);
+    StatusType apply_change(const FleetChange& change);
+
+    // Persistence. open() moves an empty ocean into files in directory
+    // (created if missing), or loads the ocean last flushed there; only
+    // the heaps are rebuilt, lazily, so it takes milliseconds. It fails
+    // while another ocean, in this process or another, has the directory
+    // open. flush() writes the pages changed since the last flush to disk,
+    // all at once: whenever the process dies, open() finds the files as
+    // one flush or the next left them, and changes not flushed are lost.
+    // Queries write nothing. Neither is allowed in what-if mode. Until
+    // open() the ocean is on the heap only; open() fails off Linux.
+    StatusType open(const char* directory);
+    StatusType flush();
+
+    // Bytes this ocean holds, split into payload and overhead (see
+    // MemoryUsage.h). O(1) from the table sizes and entry counts. Heap
+    // entries beyond one per pirate are stale ones not yet dropped, and
+    // count as slack. In what-if mode the undo log also keeps old heap
+    // versions alive; only the log's own entries are counted for those.
+    MemoryUsage memory_usage() const;
 };
 
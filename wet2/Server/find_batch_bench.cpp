@@ -0,0 +1,87 @@
+// Benchmark of find_batch against one-at-a-time find on HashTable and
+// MappedHashTable, with the counters of PerfCounters.h per lookup.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -ICode Server/find_batch_bench.cpp -o find_batch_bench
+//   ./find_batch_bench [keys] [lookups]
+//
+// Each table holds keys random distinct keys (default 10^6); lookups
+// random keys (default 10^6), half of them present, are looked up in
+// rounds of both kinds, which must find the same values.
+#include "HashTable.h"
+#include "MappedHashTable.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static const int rounds = 3;
+
+enum Kind { HASH_FIND, HASH_FIND_BATCH, MAPPED_FIND, MAPPED_FIND_BATCH, KINDS };
+
+// Sums what a pass found, so no pass is optimized away and all compare
+template <class Table>
+static long long find_each(const Table& table, const std::vector<int>& keys) {
+    long long sum = 0;
+    for (int key : keys) {
+        const int* value = table.find(key);
+        sum += value ? *value : -1;
+    }
+    return sum;
+}
+
+template <class Table>
+static long long find_batch(const Table& table, const std::vector<int>& keys, std::vector<int*>& out) {
+    table.find_batch(keys.data(), keys.size(), out.data());
+    long long sum = 0;
+    for (int* value : out) sum += value ? *value : -1;
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    const size_t key_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const size_t lookup_count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+    // Even keys are stored, odd ones miss
+    std::mt19937 rng(1);
+    std::vector<int> stored(key_count);
+    for (size_t i = 0; i < key_count; ++i) stored[i] = static_cast<int>(2 * i);
+    std::shuffle(stored.begin(), stored.end(), rng);
+    std::vector<int> lookups(lookup_count);
+    for (int& key : lookups) key = static_cast<int>(rng() % (2 * key_count + 1));
+
+    HashTable<int, int> hash;
+    MappedHashTable<int, int> mapped;
+    for (int key : stored) {
+        hash.try_emplace(key, key / 2);
+        mapped.try_emplace(key, key / 2);
+    }
+
+    const std::vector<std::string> names = {
+        "HashTable find", "HashTable find_batch", "Mapped find", "Mapped find_batch"
+    };
+    PerfCounters counters;
+    PerfProfile profile(counters, names);
+    profile.calibrate();
+
+    std::vector<int*> out(lookup_count);
+    long long sums[KINDS] = {};
+    for (int round = 0; round < rounds; ++round) {
+        profile.measure(HASH_FIND, [&] { sums[HASH_FIND] += find_each(hash, lookups); }, lookup_count);
+        profile.measure(HASH_FIND_BATCH, [&] { sums[HASH_FIND_BATCH] += find_batch(hash, lookups, out); }, lookup_count);
+        profile.measure(MAPPED_FIND, [&] { sums[MAPPED_FIND] += find_each(mapped, lookups); }, lookup_count);
+        profile.measure(MAPPED_FIND_BATCH, [&] { sums[MAPPED_FIND_BATCH] += find_batch(mapped, lookups, out); }, lookup_count);
+    }
+
+    for (int kind = 1; kind < KINDS; ++kind) {
+        if (sums[kind] != sums[0]) {
+            std::fprintf(stderr, "%s found different values\n", names[kind].c_str());
+            return 1;
+        }
+    }
+    std::printf("%zu keys, %zu lookups x %d rounds; figures per lookup\n", key_count, lookup_count, rounds);
+    profile.print(stdout);
+    return 0;
+}
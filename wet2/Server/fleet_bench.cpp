@@ -0,0 +1,85 @@
+// In-process benchmark for oceans_t: runs a command script one command at
+// a time, calling the oceans_t method itself, and reports, per kind of
+// command, the wall time and the hardware counters of PerfCounters.h per
+// call.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -ICode Server/fleet_bench.cpp Code/pirates24b2.cpp -o fleet_bench
+//   ./fleet_bench < commands.txt
+//
+// The script is in the format main24b2.cpp reads ("add_pirate 1 7"), plus
+// pay_fleet and get_richest_pirate. It is parsed before anything is
+// measured, so no parsing or wire encoding shows in the counts. Counters
+// the machine does not offer (no PMU in the VM, kernel.perf_event_paranoid
+// above 2) show as n/a.
+#include "PerfCounters.h"
+#include "pirates24b2.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Command {
+    const char* name;
+    int args;
+};
+
+// Indexed by FleetCommand::Op
+static const Command commands[] = {
+    {"add_fleet", 1}, {"add_pirate", 2}, {"pay_pirate", 2}, {"num_ships_for_fleet", 1},
+    {"get_pirate_money", 1}, {"unite_fleets", 2}, {"pirate_argument", 2}, {"pay_fleet", 2},
+    {"get_richest_pirate", 1}
+};
+static const int ops = sizeof(commands) / sizeof(commands[0]);
+
+static void execute(oceans_t& ocean, const FleetCommand& command) {
+    const int a = command.arg1;
+    const int b = command.arg2;
+    switch (command.op) {
+        case FleetCommand::ADD_FLEET:           ocean.add_fleet(a); break;
+        case FleetCommand::ADD_PIRATE:          ocean.add_pirate(a, b); break;
+        case FleetCommand::PAY_PIRATE:          ocean.pay_pirate(a, b); break;
+        case FleetCommand::NUM_SHIPS_FOR_FLEET: ocean.num_ships_for_fleet(a); break;
+        case FleetCommand::GET_PIRATE_MONEY:    ocean.get_pirate_money(a); break;
+        case FleetCommand::UNITE_FLEETS:        ocean.unite_fleets(a, b); break;
+        case FleetCommand::PIRATE_ARGUMENT:     ocean.pirate_argument(a, b); break;
+        case FleetCommand::PAY_FLEET:           ocean.pay_fleet(a, b); break;
+        case FleetCommand::GET_RICHEST_PIRATE:  ocean.get_richest_pirate(a); break;
+    }
+}
+
+int main() {
+    std::vector<FleetCommand> script;
+    std::string op;
+    while (std::cin >> op) {
+        int kind = 0;
+        while (kind < ops && op != commands[kind].name) ++kind;
+        if (kind == ops) {
+            std::fprintf(stderr, "unknown command: %s\n", op.c_str());
+            return 1;
+        }
+        int args[2] = {0, 0};
+        for (int i = 0; i < commands[kind].args; ++i) std::cin >> args[i];
+        if (std::cin.fail()) {
+            std::fprintf(stderr, "invalid arguments to %s\n", op.c_str());
+            return 1;
+        }
+        script.push_back({static_cast<FleetCommand::Op>(kind), args[0], args[1]});
+    }
+
+    std::vector<std::string> names;
+    for (const Command& command : commands) names.push_back(command.name);
+    PerfCounters counters;
+    PerfProfile profile(counters, names);
+    profile.calibrate();
+
+    oceans_t ocean;
+    for (const FleetCommand& command : script) {
+        profile.measure(command.op, [&] { execute(ocean, command); });
+    }
+
+    if (!counters.any_available()) {
+        std::fprintf(stderr, "hardware counters unavailable; reporting wall time only\n");
+    }
+    profile.print(stdout);
+    return 0;
+}
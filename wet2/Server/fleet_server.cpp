@@ -0,0 +1,53 @@
+// Long-lived server mode for oceans_t: serves the binary protocol of
+// FleetServer.h on a Unix domain socket until SIGINT or SIGTERM. Given a
+// state directory, the ocean is kept there (see oceans_t::open) and
+// flushed when the server stops.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -ICode Server/fleet_server.cpp Code/pirates24b2.cpp -o fleet_server
+//   ./fleet_server /tmp/fleets.sock [state directory]
+#include "EpollServer.h"
+#include "FleetServer.h"
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+static EpollServer<FleetEngine>* running_server = nullptr;
+
+static void on_signal(int) {
+    if (running_server) running_server->stop();
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2 && argc != 3) {
+        std::fprintf(stderr, "usage: %s <socket path> [state directory]\n", argv[0]);
+        return 2;
+    }
+
+    oceans_t ocean;
+    if (argc == 3 && ocean.open(argv[2]) != StatusType::SUCCESS) {
+        std::fprintf(stderr, "%s: cannot open the saved ocean\n", argv[2]);
+        return 1;
+    }
+    FleetEngine engine(ocean);
+    EpollServer<FleetEngine> server(engine);
+    if (!server.listen(argv[1])) {
+        std::perror(argv[1]);
+        return 1;
+    }
+
+    // No SA_RESTART, so epoll_wait returns and sees the stop flag
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    running_server = &server;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    server.run();
+    unlink(argv[1]);
+    if (argc == 3 && ocean.flush() != StatusType::SUCCESS) {
+        std::fprintf(stderr, "%s: flush failed\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Throughput of ConcurrentUnionFind against UnionFind behind one mutex,
+// the global lock unite_fleets and find would otherwise need, from 1 up
+// to max_threads threads.
+//
+//   g++ -std=c++11 -O2 -DNDEBUG -Wall -pthread -ICode Server/union_find_bench.cpp -o union_find_bench
+//   ./union_find_bench [slots] [operations] [max_threads]
+//
+// slots sets (default 10^6) start with one pirate each. The operations
+// (default 4 * 10^6), split evenly between the threads, are one union of
+// the roots of two random slots for every three same_set queries on
+// random pairs. Reports million operations per second for each.
+#include "ConcurrentUnionFind.h"
+#include "UnionFind.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct Operation {
+    int slot1;
+    int slot2;
+    bool unite;
+};
+
+// Runs work(first, last) over the operations on threads threads and
+// returns the seconds taken
+template <class Work>
+static double timed(size_t count, unsigned threads, Work work) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> running;
+    for (unsigned t = 1; t < threads; ++t) {
+        running.emplace_back([=] { work(count * t / threads, count * (t + 1) / threads); });
+    }
+    work(0, count / threads);
+    for (std::thread& thread : running) thread.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double concurrent_run(int slots, const std::vector<Operation>& operations, unsigned threads) {
+    ConcurrentUnionFind sets(slots);
+    for (int i = 0; i < slots; ++i) sets.make_set(1, 1);
+    return timed(operations.size(), threads, [&](size_t first, size_t last) {
+        int offset1, offset2;
+        for (size_t i = first; i < last; ++i) {
+            const Operation& op = operations[i];
+            if (op.unite) {
+                sets.link_roots(sets.find(op.slot1), sets.find(op.slot2));
+            } else {
+                sets.same_set(op.slot1, op.slot2, offset1, offset2);
+            }
+        }
+    });
+}
+
+static double locked_run(int slots, const std::vector<Operation>& operations, unsigned threads) {
+    UnionFind sets;
+    std::mutex lock;
+    sets.reserve(slots);
+    for (int i = 0; i < slots; ++i) sets.add_pirate(sets.make_set());
+    return timed(operations.size(), threads, [&](size_t first, size_t last) {
+        int offset1, offset2;
+        for (size_t i = first; i < last; ++i) {
+            const Operation& op = operations[i];
+            std::lock_guard<std::mutex> guard(lock);
+            const int root1 = sets.find(op.slot1, offset1);
+            const int root2 = sets.find(op.slot2, offset2);
+            if (op.unite && root1 != root2) {
+                const bool first_is_primary = sets.num_pirates(root1) >= sets.num_pirates(root2);
+                sets.link(first_is_primary ? root1 : root2, first_is_primary ? root2 : root1);
+            }
+        }
+    });
+}
+
+int main(int argc, char** argv) {
+    const int slots = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4000000;
+    const unsigned max_threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10)
+                                          : std::max(1u, std::thread::hardware_concurrency());
+
+    std::mt19937 rng(1);
+    std::vector<Operation> operations(count);
+    for (Operation& op : operations) {
+        op = {static_cast<int>(rng() % slots), static_cast<int>(rng() % slots), rng() % 4 == 0};
+    }
+
+    std::printf("%d slots, %zu operations, %u cores\n", slots, count, std::thread::hardware_concurrency());
+    std::printf("%-8s %16s %16s\n", "threads", "lock-free Mop/s", "mutex Mop/s");
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        const double lock_free = count / concurrent_run(slots, operations, threads) / 1e6;
+        const double locked = count / locked_run(slots, operations, threads) / 1e6;
+        std::printf("%-8u %16.2f %16.2f\n", threads, lock_free, locked);
+    }
+    return 0;
+}
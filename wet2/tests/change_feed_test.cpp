@@ -0,0 +1,209 @@
+// ChangeFeed with several readers, and replicas of an oceans_t fed by it.
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -ICode tests/change_feed_test.cpp Code/pirates24b2.cpp -o change_feed_test
+//   ./change_feed_test [readers] [records] [operations]
+//
+// A new reader gets EMPTY, one a whole ring behind gets LOST, and one a
+// ring behind reads exactly a ring's worth. Then readers threads poll a
+// 64-record ring while records are published as fast as possible: every
+// record read must be whole, and a reader that gets LOST starts over from
+// the head. Last, as many replicas apply the feed of a primary running
+// random operations, with checkpoints, on their own threads; every change
+// must apply, and each replica must then answer every query as the
+// primary does. A replica that missed a record must fail to apply the
+// next one. Prints "ok" or what went wrong.
+#include "pirates24b2.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const int FLEETS = 300;
+static const int PIRATES = 3 * FLEETS + 3;
+
+// A record whose words all follow from its number, so a torn one shows
+struct Stamp {
+    uint32_t words[6];
+};
+
+static Stamp stamp(uint64_t n) {
+    Stamp record;
+    for (uint32_t i = 0; i < 6; ++i) record.words[i] = static_cast<uint32_t>(n * 2654435761u + i);
+    return record;
+}
+
+static bool whole(const Stamp& record, uint64_t n) {
+    const Stamp expected = stamp(n);
+    for (int i = 0; i < 6; ++i) {
+        if (record.words[i] != expected.words[i]) return false;
+    }
+    return true;
+}
+
+static bool fail(const char* what) {
+    std::printf("FAILED: %s\n", what);
+    return false;
+}
+
+static bool check_positions() {
+    ChangeFeed<Stamp> feed(16);
+    ChangeFeed<Stamp>::Reader early(feed, 0);
+    ChangeFeed<Stamp>::Reader at_head(feed);
+    Stamp record;
+    if (at_head.poll(record) != ChangeFeed<Stamp>::EMPTY) return fail("a reader of an empty feed got a record");
+
+    const uint64_t published = 3 * feed.capacity() + 5;
+    for (uint64_t n = 0; n < published; ++n) feed.publish(stamp(n));
+    if (early.poll(record) != ChangeFeed<Stamp>::LOST) return fail("a reader a ring behind did not get LOST");
+
+    ChangeFeed<Stamp>::Reader last_ring(feed, published - feed.capacity());
+    uint64_t read = 0;
+    while (last_ring.poll(record) == ChangeFeed<Stamp>::READ) {
+        if (!whole(record, published - feed.capacity() + read)) return fail("wrong record in the last ring");
+        ++read;
+    }
+    if (read != feed.capacity()) return fail("the last ring was not all readable");
+    if (last_ring.poll(record) != ChangeFeed<Stamp>::EMPTY) return fail("a reader at the head got no EMPTY");
+    return true;
+}
+
+static bool check_racing_readers(int readers, uint64_t records) {
+    ChangeFeed<Stamp> feed(64);
+    std::atomic<bool> done(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.emplace_back([&] {
+            uint64_t n = 0;
+            Stamp record;
+            while (!done.load() || n < feed.head()) {
+                const ChangeFeed<Stamp>::ReadStatus status = feed.read(n, record);
+                if (status == ChangeFeed<Stamp>::READ) {
+                    if (!whole(record, n)) ++torn;
+                    ++n;
+                } else if (status == ChangeFeed<Stamp>::LOST) {
+                    n = feed.head();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (uint64_t n = 0; n < records; ++n) feed.publish(stamp(n));
+    done = true;
+    for (std::thread& thread : threads) thread.join();
+    if (torn != 0) return fail("a reader got a torn record");
+    return true;
+}
+
+static void random_operations(oceans_t& ocean, std::mt19937& rng, int count, int depth) {
+    for (int i = 0; i < count; ++i) {
+        const int a = static_cast<int>(rng() % FLEETS) + 1;
+        const int b = static_cast<int>(rng() % FLEETS) + 1;
+        switch (rng() % 10) {
+            case 0: ocean.add_fleet(a); break;
+            case 1:
+            case 2: ocean.add_pirate(3 * a + b % 3, b); break;
+            case 3: ocean.pay_pirate(3 * a + b % 3, b); break;
+            case 4: ocean.get_pirate_money(a); break;
+            case 5: ocean.unite_fleets(a, b); break;
+            case 6: ocean.pirate_argument(3 * a + b % 3, 3 * b + a % 3); break;
+            case 7: ocean.pay_fleet(a, b); break;
+            case 8: ocean.get_richest_pirate(a); break;
+            default:
+                if (depth < 2 && rng() % 20 == 0) {
+                    ocean.checkpoint();
+                    random_operations(ocean, rng, static_cast<int>(rng() % 30), depth + 1);
+                    if (rng() % 2) {
+                        ocean.rollback();
+                    } else {
+                        ocean.commit();
+                    }
+                }
+                break;
+        }
+    }
+}
+
+static bool same(output_t<int> a, output_t<int> b) {
+    return a.status() == b.status() && (a.status() != StatusType::SUCCESS || a.ans() == b.ans());
+}
+
+static bool same_oceans(oceans_t& a, oceans_t& b) {
+    std::vector<int> members_a, members_b;
+    for (int fleet = 1; fleet <= FLEETS; ++fleet) {
+        const StatusType status = a.get_fleet_pirates(fleet, members_a);
+        if (status != b.get_fleet_pirates(fleet, members_b)) return false;
+        if (status == StatusType::SUCCESS && members_a != members_b) return false;
+        if (!same(a.num_ships_for_fleet(fleet), b.num_ships_for_fleet(fleet))) return false;
+        if (!same(a.get_richest_pirate(fleet), b.get_richest_pirate(fleet))) return false;
+    }
+    for (int pirate = 1; pirate <= PIRATES; ++pirate) {
+        if (!same(a.get_pirate_money(pirate), b.get_pirate_money(pirate))) return false;
+    }
+    return true;
+}
+
+static bool check_replicas(int readers, int operations) {
+    FleetFeed feed(1 << 20);
+    oceans_t primary;
+    primary.attach_feed(&feed);
+    std::unique_ptr<oceans_t[]> replicas(new oceans_t[readers]);
+    std::atomic<bool> done(false);
+    std::atomic<int> failed(0);
+    std::atomic<int> lost(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.emplace_back([&, i] {
+            FleetFeed::Reader reader(feed, 0);
+            FleetChange change;
+            while (!done.load() || reader.next() < feed.head()) {
+                const FleetFeed::ReadStatus status = reader.poll(change);
+                if (status == FleetFeed::READ) {
+                    if (replicas[i].apply_change(change) != StatusType::SUCCESS) ++failed;
+                } else if (status == FleetFeed::LOST) {
+                    ++lost;
+                    return;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::mt19937 rng(3);
+    random_operations(primary, rng, operations, 0);
+    done = true;
+    for (std::thread& thread : threads) thread.join();
+    if (lost != 0) return fail("a replica fell a whole ring behind");
+    if (failed != 0) return fail("a replica could not apply a change");
+    for (int i = 0; i < readers; ++i) {
+        if (!same_oceans(primary, replicas[i])) return fail("a replica answers differently from the primary");
+    }
+
+    // Skipping the first record leaves the replica without the fleet
+    FleetFeed small(16);
+    oceans_t publisher, behind;
+    publisher.attach_feed(&small);
+    publisher.add_fleet(1);
+    publisher.add_pirate(5, 1);
+    FleetFeed::Reader skipping(small, 1);
+    FleetChange change;
+    if (skipping.poll(change) != FleetFeed::READ || behind.apply_change(change) == StatusType::SUCCESS) {
+        return fail("a replica that missed a record applied the next one");
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int readers = argc > 1 ? std::atoi(argv[1]) : 3;
+    const uint64_t records = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000;
+    const int operations = argc > 3 ? std::atoi(argv[3]) : 100000;
+    if (!check_positions() || !check_racing_readers(readers, records) || !check_replicas(readers, operations)) {
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
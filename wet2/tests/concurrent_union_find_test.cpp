@@ -0,0 +1,184 @@
+// Multi-threaded stress test of ConcurrentUnionFind, and of
+// oceans_t::unite_fleets_parallel against a replica that applies the same
+// unions one by one.
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -ICode tests/concurrent_union_find_test.cpp Code/pirates24b2.cpp -o cuf_test
+//   ./cuf_test [threads] [slots] [operations per thread]
+//
+// Threads add pirates, link random slots and ask same_set all at once.
+// Afterwards every set must hold ranks exactly 1..num_pirates (each pirate
+// ranked at its add plus its slot's offset), as many ships as slots, and
+// the links numbered in an order that a sequential UnionFind could have
+// made them in. Prints "ok" or what went wrong.
+#include "ConcurrentUnionFind.h"
+#include "pirates24b2.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct Added {
+    int root;  // The root given to add_pirate, which ranks within it
+    int rank;
+};
+
+struct Same {
+    int slot1, slot2;
+    int offset_difference;
+};
+
+struct Record {
+    std::vector<Added> added;
+    std::vector<Same> same;
+    std::vector<ConcurrentUnionFind::Link> links;
+};
+
+static bool fail(const char* what) {
+    std::printf("FAILED: %s\n", what);
+    return false;
+}
+
+static bool stress(unsigned threads, int slots, int operations) {
+    ConcurrentUnionFind sets(slots);
+    for (int i = 0; i < slots; ++i) sets.make_set();
+
+    std::vector<Record> records(threads);
+    std::vector<std::thread> running;
+    for (unsigned t = 0; t < threads; ++t) {
+        running.emplace_back([&, t] {
+            std::mt19937 rng(t + 1);
+            Record& record = records[t];
+            for (int i = 0; i < operations; ++i) {
+                const int slot1 = static_cast<int>(rng() % slots);
+                const int slot2 = static_cast<int>(rng() % slots);
+                const unsigned kind = rng() % 20;
+                if (kind < 9) {
+                    const int root = sets.find(slot1);
+                    const int rank = sets.add_pirate(root);
+                    if (rank > 0) record.added.push_back({root, rank});
+                } else if (kind < 13) {
+                    ConcurrentUnionFind::Link link;
+                    if (sets.link_roots(sets.find(slot1), sets.find(slot2), &link)) record.links.push_back(link);
+                } else {
+                    int offset1, offset2;
+                    if (sets.same_set(slot1, slot2, offset1, offset2)) {
+                        record.same.push_back({slot1, slot2, offset1 - offset2});
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : running) thread.join();
+
+    std::vector<int> root(slots), offset(slots), ships(slots, 0);
+    for (int i = 0; i < slots; ++i) {
+        root[i] = sets.find(i, offset[i]);
+        ++ships[root[i]];
+    }
+    std::vector<std::vector<int>> ranks(slots);
+    std::vector<ConcurrentUnionFind::Link> links;
+    for (const Record& record : records) {
+        for (const Added& added : record.added) {
+            ranks[root[added.root]].push_back(added.rank + offset[added.root]);
+        }
+        for (const Same& same : record.same) {
+            if (root[same.slot1] != root[same.slot2]) return fail("same_set said yes for two sets");
+            if (offset[same.slot1] - offset[same.slot2] != same.offset_difference) {
+                return fail("offsets within a set changed");
+            }
+        }
+        links.insert(links.end(), record.links.begin(), record.links.end());
+    }
+
+    for (int i = 0; i < slots; ++i) {
+        if (root[i] != i) continue;
+        if (sets.num_ships(i) != ships[i]) return fail("ship count of a set is off");
+        if (sets.num_pirates(i) != static_cast<int>(ranks[i].size())) return fail("pirate count of a set is off");
+        std::sort(ranks[i].begin(), ranks[i].end());
+        for (size_t r = 0; r < ranks[i].size(); ++r) {
+            if (ranks[i][r] != static_cast<int>(r + 1)) return fail("ranks of a set are not 1..num_pirates");
+        }
+    }
+
+    // Replayed by sequence number, each link must join two roots
+    std::sort(links.begin(), links.end(), [](const ConcurrentUnionFind::Link& a,
+                                             const ConcurrentUnionFind::Link& b) {
+        return a.sequence < b.sequence;
+    });
+    std::vector<int> parent(slots);
+    for (int i = 0; i < slots; ++i) parent[i] = i;
+    for (size_t i = 0; i < links.size(); ++i) {
+        if (i > 0 && links[i].sequence == links[i - 1].sequence) return fail("two links share a number");
+        const ConcurrentUnionFind::Link& link = links[i];
+        if (parent[link.primary] != link.primary || parent[link.secondary] != link.secondary) {
+            return fail("links are numbered out of order");
+        }
+        parent[link.secondary] = link.primary;
+    }
+    for (int i = 0; i < slots; ++i) {
+        int top = i;
+        while (parent[top] != top) top = parent[top];
+        if (top != root[i]) return fail("replaying the links gives other sets");
+    }
+    return true;
+}
+
+// unite_fleets_parallel publishes its unions in the order they took
+// effect; a replica applying them one by one must agree on every union
+// and end up with the same fleets, members in the same rank order
+static bool parallel_ocean(unsigned threads, int fleets, int pairs) {
+    std::mt19937 rng(7);
+    FleetFeed feed(8 * static_cast<size_t>(fleets) + pairs);
+    oceans_t ocean, replica;
+    ocean.attach_feed(&feed);
+    FleetFeed::Reader reader(feed);
+
+    int pirate = 0;
+    for (int fleet = 1; fleet <= fleets; ++fleet) {
+        ocean.add_fleet(fleet);
+        const int pirates = static_cast<int>(rng() % 4);  // Some fleets stay empty
+        for (int i = 0; i < pirates; ++i) ocean.add_pirate(++pirate, fleet);
+    }
+    std::vector<std::pair<int, int>> unions(pairs);
+    for (std::pair<int, int>& pair : unions) {
+        pair = {static_cast<int>(rng() % (fleets + 2)), static_cast<int>(rng() % (fleets + 2))};
+    }
+    std::vector<StatusType> results;
+    if (ocean.unite_fleets_parallel(unions, results, threads) != StatusType::SUCCESS) {
+        return fail("unite_fleets_parallel failed");
+    }
+
+    FleetChange change;
+    int applied = 0;
+    while (reader.poll(change) == FleetFeed::READ) {
+        if (replica.apply_change(change) != StatusType::SUCCESS) return fail("replica disagrees on a change");
+        if (change.op == FleetChange::UNITE_FLEETS) ++applied;
+    }
+    if (applied != static_cast<int>(std::count(results.begin(), results.end(), StatusType::SUCCESS))) {
+        return fail("published unions do not match the results");
+    }
+
+    std::vector<int> members, replica_members;
+    for (int fleet = 1; fleet <= fleets; ++fleet) {
+        const StatusType status = ocean.get_fleet_pirates(fleet, members);
+        if (status != replica.get_fleet_pirates(fleet, replica_members)) return fail("fleet status differs");
+        if (status != StatusType::SUCCESS) continue;
+        if (members != replica_members) return fail("members differ from the replica");
+        if (ocean.num_ships_for_fleet(fleet).ans() != replica.num_ships_for_fleet(fleet).ans()) {
+            return fail("ship counts differ from the replica");
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const unsigned threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+    const int slots = argc > 2 ? std::atoi(argv[2]) : 100000;
+    const int operations = argc > 3 ? std::atoi(argv[3]) : 200000;
+    if (!stress(threads, slots, operations)) return 1;
+    if (!parallel_ocean(threads, slots, slots)) return 1;
+    std::printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+// oceans_t::open and flush: reopening, the directory lock, and crashes.
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -ICode tests/persistence_test.cpp Code/pirates24b2.cpp -o persistence_test
+//   ./persistence_test [kills]
+//
+// An ocean flushed and reopened must answer every query like one that ran
+// the same commands in memory, and changes made after the last flush must
+// be gone. While one ocean has a directory open, opening it again fails,
+// from this process or another. Then, kills times, a child process runs
+// batches of commands with a flush after each and is killed at a random
+// moment, often in the middle of a flush; the reopened ocean must be the
+// one of the last flush it reported or of the one after. Prints "ok" or
+// what went wrong.
+#include "pirates24b2.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const int FLEETS = 100;
+static const int PIRATES = 1000;
+static const int BATCH = 300;
+
+static bool fail(const char* what) {
+    std::printf("FAILED: %s\n", what);
+    return false;
+}
+
+// The commands of batch number batch, the same every time
+static std::vector<FleetCommand> batch_log(int batch) {
+    std::mt19937 rng(batch);
+    std::vector<FleetCommand> commands(BATCH);
+    for (FleetCommand& command : commands) {
+        const unsigned kind = rng() % 100;
+        const int fleet = static_cast<int>(rng() % FLEETS) + 1;
+        const int pirate = static_cast<int>(rng() % PIRATES) + 1;
+        const int other = static_cast<int>(rng() % PIRATES) + 1;
+        if (kind < 10) {
+            command = {FleetCommand::ADD_FLEET, fleet, 0};
+        } else if (kind < 45) {
+            command = {FleetCommand::ADD_PIRATE, pirate, fleet};
+        } else if (kind < 60) {
+            command = {FleetCommand::PAY_PIRATE, pirate, static_cast<int>(rng() % 100) + 1};
+        } else if (kind < 70) {
+            command = {FleetCommand::UNITE_FLEETS, fleet, static_cast<int>(rng() % FLEETS) + 1};
+        } else if (kind < 85) {
+            command = {FleetCommand::PIRATE_ARGUMENT, pirate, other};
+        } else if (kind < 95) {
+            command = {FleetCommand::PAY_FLEET, fleet, static_cast<int>(rng() % 100) + 1};
+        } else {
+            command = {FleetCommand::GET_RICHEST_PIRATE, fleet, 0};
+        }
+    }
+    return commands;
+}
+
+// An in-memory ocean after batches 1..batches
+static std::unique_ptr<oceans_t> expected(int batches) {
+    std::unique_ptr<oceans_t> ocean(new oceans_t());
+    std::vector<FleetResult> results;
+    for (int batch = 1; batch <= batches; ++batch) ocean->replay(batch_log(batch), results);
+    return ocean;
+}
+
+static bool same(output_t<int> a, output_t<int> b) {
+    return a.status() == b.status() && (a.status() != StatusType::SUCCESS || a.ans() == b.ans());
+}
+
+static bool same_oceans(oceans_t& a, oceans_t& b) {
+    std::vector<int> members_a, members_b;
+    for (int fleet = 1; fleet <= FLEETS; ++fleet) {
+        const StatusType status = a.get_fleet_pirates(fleet, members_a);
+        if (status != b.get_fleet_pirates(fleet, members_b)) return false;
+        if (status == StatusType::SUCCESS && members_a != members_b) return false;
+        if (!same(a.num_ships_for_fleet(fleet), b.num_ships_for_fleet(fleet))) return false;
+        if (!same(a.get_richest_pirate(fleet), b.get_richest_pirate(fleet))) return false;
+    }
+    for (int pirate = 1; pirate <= PIRATES; ++pirate) {
+        if (!same(a.get_pirate_money(pirate), b.get_pirate_money(pirate))) return false;
+    }
+    return true;
+}
+
+static std::string fresh_directory() {
+    char name[] = "/tmp/persistence_test.XXXXXX";
+    return mkdtemp(name) ? name : "";
+}
+
+static void remove_directory(const std::string& directory) {
+    std::system(("rm -rf " + directory).c_str());
+}
+
+// Whether a child process can open the directory
+static bool opens_elsewhere(const std::string& directory) {
+    const pid_t child = fork();
+    if (child == 0) {
+        oceans_t ocean;
+        _exit(ocean.open(directory.c_str()) == StatusType::SUCCESS ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool check_reopen() {
+    const std::string directory = fresh_directory();
+    if (directory.empty()) return fail("cannot make a directory");
+    std::vector<FleetResult> results;
+
+    std::unique_ptr<oceans_t> ocean(new oceans_t());
+    if (ocean->open(directory.c_str()) != StatusType::SUCCESS) return fail("open of a new directory failed");
+    ocean->replay(batch_log(1), results);
+    if (ocean->flush() != StatusType::SUCCESS) return fail("flush failed");
+
+    oceans_t second;
+    if (second.open(directory.c_str()) != StatusType::FAILURE) return fail("opened a directory twice");
+    if (opens_elsewhere(directory)) return fail("another process opened a directory in use");
+
+    // Not flushed, so lost
+    ocean->replay(batch_log(2), results);
+    ocean.reset();
+    if (!opens_elsewhere(directory)) return fail("the lock outlived the ocean");
+
+    ocean.reset(new oceans_t());
+    if (ocean->open(directory.c_str()) != StatusType::SUCCESS) return fail("reopen failed");
+    if (!same_oceans(*ocean, *expected(1))) return fail("reopened ocean differs from the flushed one");
+
+    // A torn log left by a crash is dropped
+    ocean->replay(batch_log(2), results);
+    if (ocean->flush() != StatusType::SUCCESS) return fail("second flush failed");
+    ocean.reset();
+    const int log = ::open((directory + "/journal").c_str(), O_WRONLY | O_APPEND);
+    if (log < 0 || write(log, "torn", 4) != 4) return fail("cannot write the journal");
+    close(log);
+    ocean.reset(new oceans_t());
+    if (ocean->open(directory.c_str()) != StatusType::SUCCESS) return fail("open with a torn journal failed");
+    if (!same_oceans(*ocean, *expected(2))) return fail("torn journal changed the ocean");
+
+    ocean.reset();
+    remove_directory(directory);
+    return true;
+}
+
+// Runs batches with a flush after each, writing the number of every
+// batch flushed to out, until killed
+static void flush_until_killed(const std::string& directory, int out) {
+    oceans_t ocean;
+    if (ocean.open(directory.c_str()) != StatusType::SUCCESS) _exit(1);
+    std::vector<FleetResult> results;
+    for (int batch = 1;; ++batch) {
+        ocean.replay(batch_log(batch), results);
+        if (ocean.flush() != StatusType::SUCCESS) _exit(1);
+        if (write(out, &batch, sizeof(batch)) != sizeof(batch)) _exit(1);
+    }
+}
+
+static bool check_kill(std::mt19937& rng) {
+    const std::string directory = fresh_directory();
+    if (directory.empty()) return fail("cannot make a directory");
+    int pipe_ends[2];
+    if (pipe(pipe_ends) != 0) return fail("cannot make a pipe");
+    const pid_t child = fork();
+    if (child == 0) {
+        close(pipe_ends[0]);
+        flush_until_killed(directory, pipe_ends[1]);
+    }
+    close(pipe_ends[1]);
+
+    // Wait for a few flushes, then kill it somewhere in a later one
+    int flushed = 0;
+    const int wait_for = static_cast<int>(rng() % 4) + 1;
+    while (flushed < wait_for && read(pipe_ends[0], &flushed, sizeof(flushed)) == sizeof(flushed)) {
+    }
+    usleep(rng() % 20000);
+    kill(child, SIGKILL);
+    int status = 0;
+    waitpid(child, &status, 0);
+    int batch;
+    while (read(pipe_ends[0], &batch, sizeof(batch)) == sizeof(batch)) flushed = batch;
+    close(pipe_ends[0]);
+    if (!WIFSIGNALED(status)) return fail("the child stopped before it was killed");
+
+    std::unique_ptr<oceans_t> ocean(new oceans_t());
+    if (ocean->open(directory.c_str()) != StatusType::SUCCESS) return fail("open after a kill failed");
+    if (!same_oceans(*ocean, *expected(flushed)) && !same_oceans(*ocean, *expected(flushed + 1))) {
+        return fail("ocean after a kill is not one that was flushed");
+    }
+    ocean.reset();
+    remove_directory(directory);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int kills = argc > 1 ? std::atoi(argv[1]) : 20;
+    if (!check_reopen()) return 1;
+    std::mt19937 rng(1);
+    for (int i = 0; i < kills; ++i) {
+        if (!check_kill(rng)) return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
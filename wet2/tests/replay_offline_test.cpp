@@ -0,0 +1,111 @@
+// oceans_t::replay_offline against replay on random command logs.
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -ICode tests/replay_offline_test.cpp Code/pirates24b2.cpp -o replay_offline_test
+//   ./replay_offline_test [commands] [max_threads]
+//
+// For 1 up to max_threads threads, and fleet and pirate IDs drawn from
+// ranges small enough to make one large component or many small ones,
+// both must give the same results and leave oceans that answer every
+// query alike, also after a second log replayed into each. Prints "ok"
+// or what went wrong.
+#include "pirates24b2.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static bool fail(const char* what) {
+    std::printf("FAILED: %s\n", what);
+    return false;
+}
+
+static std::vector<FleetCommand> random_log(std::mt19937& rng, int count, int fleets, int pirates) {
+    std::vector<FleetCommand> commands(count);
+    for (FleetCommand& command : commands) {
+        const unsigned kind = rng() % 100;
+        // A few out-of-range IDs and amounts for the INVALID_INPUT paths
+        auto fleet = [&] { return static_cast<int>(rng() % (fleets + 1)); };
+        auto pirate = [&] { return static_cast<int>(rng() % (pirates + 1)); };
+        auto amount = [&] { return static_cast<int>(rng() % 100) - 2; };
+        if (kind < 15) {
+            command = {FleetCommand::ADD_FLEET, fleet(), 0};
+        } else if (kind < 45) {
+            command = {FleetCommand::ADD_PIRATE, pirate(), fleet()};
+        } else if (kind < 55) {
+            command = {FleetCommand::PAY_PIRATE, pirate(), amount()};
+        } else if (kind < 60) {
+            command = {FleetCommand::NUM_SHIPS_FOR_FLEET, fleet(), 0};
+        } else if (kind < 65) {
+            command = {FleetCommand::GET_PIRATE_MONEY, pirate(), 0};
+        } else if (kind < 75) {
+            command = {FleetCommand::UNITE_FLEETS, fleet(), fleet()};
+        } else if (kind < 85) {
+            command = {FleetCommand::PIRATE_ARGUMENT, pirate(), pirate()};
+        } else if (kind < 92) {
+            command = {FleetCommand::PAY_FLEET, fleet(), amount()};
+        } else {
+            command = {FleetCommand::GET_RICHEST_PIRATE, fleet(), 0};
+        }
+    }
+    return commands;
+}
+
+static bool same_results(const std::vector<FleetResult>& a, const std::vector<FleetResult>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].status != b[i].status || a[i].ans != b[i].ans) return false;
+    }
+    return true;
+}
+
+static bool same(output_t<int> a, output_t<int> b) {
+    return a.status() == b.status() && (a.status() != StatusType::SUCCESS || a.ans() == b.ans());
+}
+
+static bool same_oceans(oceans_t& a, oceans_t& b, int fleets, int pirates) {
+    std::vector<int> members_a, members_b;
+    for (int fleet = 1; fleet <= fleets; ++fleet) {
+        const StatusType status = a.get_fleet_pirates(fleet, members_a);
+        if (status != b.get_fleet_pirates(fleet, members_b)) return false;
+        if (status == StatusType::SUCCESS && members_a != members_b) return false;
+        if (!same(a.num_ships_for_fleet(fleet), b.num_ships_for_fleet(fleet))) return false;
+        if (!same(a.get_richest_pirate(fleet), b.get_richest_pirate(fleet))) return false;
+    }
+    for (int pirate = 1; pirate <= pirates; ++pirate) {
+        if (!same(a.get_pirate_money(pirate), b.get_pirate_money(pirate))) return false;
+    }
+    return true;
+}
+
+static bool check(int count, unsigned threads, int fleets, int pirates, unsigned seed) {
+    std::mt19937 rng(seed);
+    const std::vector<FleetCommand> log = random_log(rng, count, fleets, pirates);
+    const std::vector<FleetCommand> more = random_log(rng, count / 4, fleets, pirates);
+
+    oceans_t offline, online;
+    std::vector<FleetResult> offline_results, online_results;
+    offline.replay_offline(log, offline_results, threads);
+    online.replay(log, online_results);
+    if (!same_results(offline_results, online_results)) return fail("results differ from replay");
+    if (!same_oceans(offline, online, fleets, pirates)) return fail("oceans differ after the log");
+
+    // The merged ocean must go on like the other one
+    offline.replay(more, offline_results);
+    online.replay(more, online_results);
+    if (!same_results(offline_results, online_results)) return fail("results differ after the merge");
+    if (!same_oceans(offline, online, fleets, pirates)) return fail("oceans differ after a second log");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const unsigned max_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+    const int id_ranges[][2] = {{count / 4, count / 4}, {count / 2, count}, {count, 2 * count}, {50, 200}};
+    for (unsigned threads = 1; threads <= max_threads; ++threads) {
+        for (const auto& ids : id_ranges) {
+            if (!check(count, threads, ids[0], ids[1], threads)) return 1;
+        }
+    }
+    std::printf("ok\n");
+    return 0;
+}
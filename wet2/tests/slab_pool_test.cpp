@@ -0,0 +1,108 @@
+// Allocation test of the node pools, with malloc interposed to count every
+// call into the system allocator (glibc).
+//
+//   g++ -std=c++11 -O2 -Wall -pthread -ICode tests/slab_pool_test.cpp Code/pirates24b2.cpp -o slab_pool_test
+//   ./slab_pool_test [fleets] [pirates] [rounds]
+//
+// An ocean sized by its capacity hints is filled, then goes through rounds
+// of payments, richest-pirate queries and unions. After one warm-up round
+// the rest must not call malloc at all. Once the ocean is gone the pools
+// must hold no memory, and blocks freed on a thread that then exits must
+// serve the next thread without a new slab. Prints "ok" or what went
+// wrong.
+#include "pirates24b2.h"
+#include "HashTable.h"
+#include "LeftistHeap.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* memory, size_t size);
+
+static bool counting = false;
+static size_t malloc_calls = 0;
+
+extern "C" void* malloc(size_t size) {
+    if (counting) ++malloc_calls;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    if (counting) ++malloc_calls;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* memory, size_t size) {
+    if (counting) ++malloc_calls;
+    return __libc_realloc(memory, size);
+}
+
+static bool fail(const char* what) {
+    std::printf("FAILED: %s\n", what);
+    return false;
+}
+
+static void round_of_work(oceans_t& ocean, std::mt19937& rng, int fleets, int pirates) {
+    for (int i = 0; i < pirates; ++i) {
+        ocean.pay_pirate(static_cast<int>(rng() % pirates) + 1, static_cast<int>(rng() % 100) + 1);
+        ocean.get_richest_pirate(static_cast<int>(rng() % fleets) + 1);
+        if (i % 8 == 0) ocean.pay_fleet(static_cast<int>(rng() % fleets) + 1, 1);
+        if (i % 64 == 0) ocean.unite_fleets(static_cast<int>(rng() % fleets) + 1, static_cast<int>(rng() % fleets) + 1);
+    }
+}
+
+static bool steady_state(int fleets, int pirates, int rounds) {
+    {
+        oceans_t ocean(fleets, pirates);
+        for (int fleet = 1; fleet <= fleets; ++fleet) ocean.add_fleet(fleet);
+        for (int pirate = 1; pirate <= pirates; ++pirate) ocean.add_pirate(pirate, pirate % fleets + 1);
+
+        std::mt19937 rng(1);
+        round_of_work(ocean, rng, fleets, pirates);
+        counting = true;
+        for (int round = 1; round < rounds; ++round) round_of_work(ocean, rng, fleets, pirates);
+        counting = false;
+        if (malloc_calls != 0) {
+            std::printf("%zu malloc calls after warm-up\n", malloc_calls);
+            return fail("warm rounds allocated");
+        }
+    }
+    if (AllocationCounters::system_bytes() != 0) return fail("slabs kept after the last user went away");
+    return true;
+}
+
+// Blocks freed on a thread that exits go to the next thread that needs them
+static bool handed_over(int entries) {
+    HashTable<int, int> keeper;  // A user throughout, so nothing is released
+    keeper.try_emplace(1, 1);
+    auto fill = [entries] {
+        LeftistHeap<int> heap;
+        HashTable<int, int> table(2 * entries);
+        for (int i = 0; i < entries; ++i) {
+            heap.push(i, i, i);
+            table.try_emplace(i, i);
+        }
+    };
+    std::thread(fill).join();
+    const size_t slabs = AllocationCounters::system_allocations();
+    const size_t bytes = AllocationCounters::system_bytes();
+    std::thread(fill).join();
+    if (AllocationCounters::system_allocations() != slabs || AllocationCounters::system_bytes() != bytes) {
+        return fail("the second thread took new slabs");
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int fleets = argc > 1 ? std::atoi(argv[1]) : 1000;
+    const int pirates = argc > 2 ? std::atoi(argv[2]) : 100000;
+    const int rounds = argc > 3 ? std::atoi(argv[3]) : 4;
+    if (!steady_state(fleets, pirates, rounds)) return 1;
+    if (!handed_over(pirates)) return 1;
+    if (AllocationCounters::system_bytes() != 0) return fail("slabs kept after the last user went away"), 1;
+    std::printf("ok\n");
+    return 0;
+}
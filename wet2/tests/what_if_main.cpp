@@ -0,0 +1,71 @@
+// Driver for the what-if tests: reads commands in the format of
+// main24b2.cpp and prints results the same way, and also takes pay_fleet,
+// get_richest_pirate, checkpoint, rollback and commit.
+//
+//   g++ -std=c++11 -O2 -Wall -ICode tests/what_if_main.cpp Code/pirates24b2.cpp -o what_if
+//   ./what_if < tests/what_if1.in | diff - tests/what_if1.out
+#include "pirates24b2.h"
+#include <iostream>
+#include <string>
+
+static const char* status_names[] = {"SUCCESS", "ALLOCATION_ERROR", "INVALID_INPUT", "FAILURE"};
+
+static void print(const std::string& op, StatusType status) {
+    std::cout << op << ": " << status_names[static_cast<int>(status)] << '\n';
+}
+
+static void print(const std::string& op, output_t<int> result) {
+    std::cout << op << ": " << status_names[static_cast<int>(result.status())];
+    if (result.status() == StatusType::SUCCESS) std::cout << ", " << result.ans();
+    std::cout << '\n';
+}
+
+int main() {
+    oceans_t ocean;
+    std::string op;
+    int a, b;
+    while (std::cin >> op) {
+        if (op == "add_fleet") {
+            std::cin >> a;
+            print(op, ocean.add_fleet(a));
+        } else if (op == "add_pirate") {
+            std::cin >> a >> b;
+            print(op, ocean.add_pirate(a, b));
+        } else if (op == "pay_pirate") {
+            std::cin >> a >> b;
+            print(op, ocean.pay_pirate(a, b));
+        } else if (op == "num_ships_for_fleet") {
+            std::cin >> a;
+            print(op, ocean.num_ships_for_fleet(a));
+        } else if (op == "get_pirate_money") {
+            std::cin >> a;
+            print(op, ocean.get_pirate_money(a));
+        } else if (op == "unite_fleets") {
+            std::cin >> a >> b;
+            print(op, ocean.unite_fleets(a, b));
+        } else if (op == "pirate_argument") {
+            std::cin >> a >> b;
+            print(op, ocean.pirate_argument(a, b));
+        } else if (op == "pay_fleet") {
+            std::cin >> a >> b;
+            print(op, ocean.pay_fleet(a, b));
+        } else if (op == "get_richest_pirate") {
+            std::cin >> a;
+            print(op, ocean.get_richest_pirate(a));
+        } else if (op == "checkpoint") {
+            print(op, ocean.checkpoint());
+        } else if (op == "rollback") {
+            print(op, ocean.rollback());
+        } else if (op == "commit") {
+            print(op, ocean.commit());
+        } else {
+            std::cout << "Unknown command: " << op << '\n';
+            return 1;
+        }
+        if (std::cin.fail()) {
+            std::cout << "Invalid input format\n";
+            return 1;
+        }
+    }
+    return 0;
+}